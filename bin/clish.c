@@ -16,6 +16,15 @@
 #include <unistd.h>
 #include <syslog.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #if WITH_INTERNAL_GETOPT
 #include "libc/getopt.h"
@@ -39,6 +48,8 @@
 #include "clish/shell.h"
 #include "clish/internal.h"
 
+extern char **environ;
+
 #define QUOTE(t) #t
 /* #define version(v) printf("%s\n", QUOTE(v)) */
 #define version(v) printf("%s\n", v)
@@ -58,41 +69,335 @@ static clish_shell_hooks_t my_hooks = {
 static void sighandler(int signo);
 static void help(int status, const char *argv0);
 
+/* Command line options */
+struct options {
+	const char *socket_path;
+	bool_t lockless;
+	bool_t stop_on_error;
+	bool_t interactive;
+	bool_t quiet;
+	bool_t utf8;
+	bool_t bit8;
+	bool_t log;
+	int log_facility;
+	const char *xml_path;
+	const char *view;
+	const char *viewid;
+	bool_t istimeout;
+	int timeout;
+	bool_t cmd; /* -c option */
+	lub_list_t *cmds; /* Commands defined by -c */
+	const char *histfile;
+	unsigned int histsize;
+	bool_t compile;
+	bool_t check;
+	bool_t freeze;
+	const char *zygote; /* Listen socket of zygote */
+	const char *session; /* Run the session by zygote */
+	bool_t profile;
+	const char *profile_path; /* The profile output or NULL for stderr */
+};
+
+static struct options *opts_init(void);
+static void opts_free(struct options *opts);
+static int opts_parse(int argc, char *argv[], struct options *opts);
+static int run_session(clish_shell_t *shell, struct options *opts,
+	int argc, char **argv);
+static int zygote_serve(const char *path, int *argc, char ***argv);
+static int zygote_session(const char *path, int argc, char **argv);
+
 /*--------------------------------------------------------- */
 int main(int argc, char **argv)
 {
-	int running;
 	int result = -1;
 	clish_shell_t *shell = NULL;
-
-	/* Command line options */
-	const char *socket_path = KONFD_SOCKET_PATH;
-	bool_t lockless = BOOL_FALSE;
-	bool_t stop_on_error = BOOL_FALSE;
-	bool_t interactive = BOOL_TRUE;
-	bool_t quiet = BOOL_FALSE;
-	bool_t utf8 = BOOL_FALSE;
-	bool_t bit8 = BOOL_FALSE;
-	bool_t log = BOOL_FALSE;
-	int log_facility = LOG_LOCAL0;
-	const char *xml_path = getenv("CLISH_PATH");
-	const char *view = getenv("CLISH_VIEW");
-	const char *viewid = getenv("CLISH_VIEWID");
+	struct options *opts = NULL;
 	FILE *outfd = stdout;
-	bool_t istimeout = BOOL_FALSE;
-	int timeout = 0;
-	bool_t cmd = BOOL_FALSE; /* -c option */
-	lub_list_t *cmds; /* Commands defined by -c */
-	lub_list_node_t *iter;
-	const char *histfile = "~/.clish_history";
-	char *histfile_expanded = NULL;
-	unsigned int histsize = 50;
 
 	/* Signal vars */
 	struct sigaction sigpipe_act;
 	sigset_t sigpipe_set;
 
-	static const char *shortopts = "hvs:ledx:w:i:bqu8oO:kt:c:f:z:";
+	/* Ignore SIGPIPE */
+	sigemptyset(&sigpipe_set);
+	sigaddset(&sigpipe_set, SIGPIPE);
+	sigpipe_act.sa_flags = 0;
+	sigpipe_act.sa_mask = sigpipe_set;
+	sigpipe_act.sa_handler = &sighandler;
+	sigaction(SIGPIPE, &sigpipe_act, NULL);
+
+#if HAVE_LOCALE_H
+	/* Set current locale */
+	setlocale(LC_ALL, "");
+#endif
+
+	/* Parse command line options */
+	opts = opts_init();
+	if (opts_parse(argc, argv, opts))
+		goto end;
+
+	/* The client of zygote doesn't load the scheme itself */
+	if (opts->session) {
+		result = zygote_session(opts->session, argc, argv);
+		goto end;
+	}
+
+	/* Create shell instance */
+	if (opts->quiet && !opts->zygote) {
+		FILE *tmpfd = NULL;
+		if ((tmpfd = fopen("/dev/null", "w")))
+			outfd = tmpfd;
+	}
+	shell = clish_shell_new(&my_hooks, NULL, NULL, outfd,
+		opts->stop_on_error);
+	if (!shell) {
+		fprintf(stderr, "Can't run clish.\n");
+		goto end;
+	}
+	if (opts->profile)
+		clish_shell__set_profile(shell, BOOL_TRUE);
+	/* Compile the XML files to the image and exit */
+	if (opts->compile) {
+		if (clish_shell_compile_scheme(shell, opts->xml_path) < 0) {
+			fprintf(stderr, "Error: Can't compile the XML scheme.\n");
+			goto end;
+		}
+		result = 0;
+		goto end;
+	}
+	/* Load the XML files */
+	clish_shell_load_scheme(shell, opts->xml_path);
+	/* The views are built on demand. Build all of them to check. */
+	if (opts->check || opts->freeze)
+		clish_shell_build_views(shell);
+	if (opts->freeze)
+		clish_shell_freeze(shell);
+
+	/* The zygote returns within the forked session only. The session
+	 * uses the options of zygote and the command line of the client.
+	 */
+	if (opts->zygote) {
+		/* Build the views once for all sessions. The frozen
+		 * strings are shared by the sessions.
+		 */
+		clish_shell_build_views(shell);
+		clish_shell_freeze(shell);
+		if ((result = zygote_serve(opts->zygote, &argc, &argv))) {
+			if (result > 0)
+				result = 0; /* Stopped by signal */
+			goto end;
+		}
+		result = -1;
+		/* The client can add the options but it can't drop the
+		 * options of zygote like -d or -k. The environment of
+		 * client sets the startup view like for plain clish.
+		 */
+		opts->zygote = NULL;
+		opts->profile = BOOL_FALSE;
+		opts->profile_path = NULL;
+		if (getenv("CLISH_VIEW"))
+			opts->view = getenv("CLISH_VIEW");
+		if (getenv("CLISH_VIEWID"))
+			opts->viewid = getenv("CLISH_VIEWID");
+		if (opts_parse(argc, argv, opts))
+			goto end;
+		/* The session is profiled on the client's request only */
+		clish_shell__set_profile(shell, opts->profile);
+		if (opts->quiet) {
+			FILE *tmpfd = NULL;
+			if ((tmpfd = fopen("/dev/null", "w"))) {
+				outfd = tmpfd;
+				tinyrl__set_ostream(
+					clish_shell__get_tinyrl(shell), outfd);
+			}
+		}
+	}
+
+	result = run_session(shell, opts, argc, argv);
+
+end:
+	/* Cleanup */
+	if (shell)
+		clish_shell_delete(shell);
+	if (outfd != stdout)
+		fclose(outfd);
+	if (opts)
+		opts_free(opts);
+
+	return result;
+}
+
+/*--------------------------------------------------------- */
+/* Set up the shell by command line options and run it */
+static int run_session(clish_shell_t *shell, struct options *opts,
+	int argc, char **argv)
+{
+	int running;
+	int result = -1;
+	lub_list_node_t *iter;
+	char *histfile_expanded = NULL;
+
+	/* Set communication to the konfd */
+	clish_shell__set_socket(shell, opts->socket_path);
+	/* Set lockless mode */
+	if (opts->lockless)
+		clish_shell__set_lockfile(shell, NULL);
+	/* Set interactive mode */
+	if (!opts->interactive)
+		clish_shell__set_interactive(shell, opts->interactive);
+	/* Set startup view */
+	if (opts->view)
+		clish_shell__set_startup_view(shell, opts->view);
+	/* Set startup viewid */
+	if (opts->viewid)
+		clish_shell__set_startup_viewid(shell, opts->viewid);
+	/* Set UTF-8 or 8-bit mode */
+	if (opts->utf8 || opts->bit8)
+		clish_shell__set_utf8(shell, opts->utf8);
+	else {
+#if HAVE_LANGINFO_CODESET
+		/* Autodetect encoding */
+		if (!strcmp(nl_langinfo(CODESET), "UTF-8"))
+			clish_shell__set_utf8(shell, BOOL_TRUE);
+#else
+		/* The default is 8-bit if locale is not supported */
+		clish_shell__set_utf8(shell, BOOL_FALSE);
+#endif
+	}
+	/* Set logging */
+	if (opts->log) {
+		clish_shell__set_log(shell, opts->log);
+		clish_shell__set_facility(shell, opts->log_facility);
+	}
+	/* Set idle timeout */
+	if (opts->istimeout)
+		clish_shell__set_timeout(shell, opts->timeout);
+	/* Set history settings */
+	clish_shell__stifle_history(shell, opts->histsize);
+	if (opts->histfile)
+		histfile_expanded = lub_system_tilde_expand(opts->histfile);
+	if (histfile_expanded)
+		clish_shell__restore_history(shell, histfile_expanded);
+
+	/* Set source of command stream: files or interactive tty */
+	if(optind < argc) {
+		int i;
+		/* Run the commands from the files */
+		for (i = argc - 1; i >= optind; i--)
+			clish_shell_push_file(shell, argv[i],
+				opts->stop_on_error);
+	} else {
+		/* The interactive shell */
+		int tmpfd = dup(fileno(stdin));
+#ifdef FD_CLOEXEC
+		fcntl(tmpfd, F_SETFD, fcntl(tmpfd, F_GETFD) | FD_CLOEXEC);
+#endif
+		clish_shell_push_fd(shell, fdopen(tmpfd, "r"),
+			opts->stop_on_error);
+	}
+
+	/* Execute startup */
+	running = clish_shell_startup(shell);
+	if (running) {
+		fprintf(stderr, "Can't startup clish.\n");
+		goto end;
+	}
+
+	/* The startup is finished so report the profile */
+	if (opts->profile) {
+		FILE *fd = stderr;
+		if (opts->profile_path && !(fd = fopen(opts->profile_path, "w")))
+			fprintf(stderr, "Warning: Can't open %s.\n",
+				opts->profile_path);
+		if (fd) {
+			clish_shell_profile_fprintf(shell, fd);
+			if (fd != stderr)
+				fclose(fd);
+		}
+		clish_shell__set_profile(shell, BOOL_FALSE);
+	}
+
+	if (opts->cmd) {
+		/* Iterate cmds */
+		for(iter = lub_list__get_head(opts->cmds);
+			iter; iter = lub_list_node__get_next(iter)) {
+			char *str = (char *)lub_list_node__get_data(iter);
+			result = clish_shell_forceline(shell, str, NULL);
+			if (opts->stop_on_error && result)
+				break;
+		}
+	} else {
+		/* Main loop */
+		result = clish_shell_loop(shell);
+	}
+
+end:
+	if (histfile_expanded) {
+		clish_shell__save_history(shell, histfile_expanded);
+		free(histfile_expanded);
+	}
+
+	return result;
+}
+
+/*--------------------------------------------------------- */
+/* Initialize option structure by defaults */
+static struct options *opts_init(void)
+{
+	struct options *opts = NULL;
+
+	opts = malloc(sizeof(*opts));
+	assert(opts);
+	opts->socket_path = KONFD_SOCKET_PATH;
+	opts->lockless = BOOL_FALSE;
+	opts->stop_on_error = BOOL_FALSE;
+	opts->interactive = BOOL_TRUE;
+	opts->quiet = BOOL_FALSE;
+	opts->utf8 = BOOL_FALSE;
+	opts->bit8 = BOOL_FALSE;
+	opts->log = BOOL_FALSE;
+	opts->log_facility = LOG_LOCAL0;
+	opts->xml_path = getenv("CLISH_PATH");
+	opts->view = getenv("CLISH_VIEW");
+	opts->viewid = getenv("CLISH_VIEWID");
+	opts->istimeout = BOOL_FALSE;
+	opts->timeout = 0;
+	opts->cmd = BOOL_FALSE;
+	opts->cmds = lub_list_new(NULL);
+	opts->histfile = "~/.clish_history";
+	opts->histsize = 50;
+	opts->compile = BOOL_FALSE;
+	opts->check = BOOL_FALSE;
+	opts->freeze = BOOL_FALSE;
+	opts->zygote = NULL;
+	opts->session = NULL;
+	opts->profile = BOOL_FALSE;
+	opts->profile_path = NULL;
+
+	return opts;
+}
+
+/*--------------------------------------------------------- */
+/* Free option structure */
+static void opts_free(struct options *opts)
+{
+	lub_list_node_t *iter;
+
+	/* Delete each cmds element */
+	while ((iter = lub_list__get_head(opts->cmds))) {
+		lub_list_del(opts->cmds, iter);
+		free(lub_list_node__get_data(iter));
+		lub_list_node_free(iter);
+	}
+	lub_list_free(opts->cmds);
+	free(opts);
+}
+
+/*--------------------------------------------------------- */
+/* Parse command line options */
+static int opts_parse(int argc, char *argv[], struct options *opts)
+{
+	static const char *shortopts = "hvs:ledx:w:i:bqu8oO:kt:c:f:z:CFZ:S:p::";
 #ifdef HAVE_GETOPT_LONG
 	static const struct option longopts[] = {
 		{"help",	0, NULL, 'h'},
@@ -115,27 +420,21 @@ int main(int argc, char **argv)
 		{"command",	1, NULL, 'c'},
 		{"histfile",	1, NULL, 'f'},
 		{"histsize",	1, NULL, 'z'},
+		{"compile",	0, NULL, 'C'},
+		{"freeze",	0, NULL, 'F'},
+		{"zygote",	1, NULL, 'Z'},
+		{"session",	1, NULL, 'S'},
+		{"profile-startup", 2, NULL, 'p'},
 		{NULL,		0, NULL, 0}
 	};
 #endif
 
-	/* Ignore SIGPIPE */
-	sigemptyset(&sigpipe_set);
-	sigaddset(&sigpipe_set, SIGPIPE);
-	sigpipe_act.sa_flags = 0;
-	sigpipe_act.sa_mask = sigpipe_set;
-	sigpipe_act.sa_handler = &sighandler;
-	sigaction(SIGPIPE, &sigpipe_act, NULL);
-
-#if HAVE_LOCALE_H
-	/* Set current locale */
-	setlocale(LC_ALL, "");
+	/* The zygote session parses the client's options again */
+#ifdef __GLIBC__
+	optind = 0;
+#else
+	optind = 1;
 #endif
-
-	/* Var initialization */
-	cmds = lub_list_new(NULL);
-
-	/* Parse command line options */
 	while(1) {
 		int opt;
 #ifdef HAVE_GETOPT_LONG
@@ -147,70 +446,71 @@ int main(int argc, char **argv)
 			break;
 		switch (opt) {
 		case 's':
-			socket_path = optarg;
+			opts->socket_path = optarg;
 			break;
 		case 'l':
-			lockless = BOOL_TRUE;
+			opts->lockless = BOOL_TRUE;
 			break;
 		case 'e':
-			stop_on_error = BOOL_TRUE;
+			opts->stop_on_error = BOOL_TRUE;
 			break;
 		case 'b':
-			interactive = BOOL_FALSE;
+			opts->interactive = BOOL_FALSE;
 			break;
 		case 'q':
-			quiet = BOOL_TRUE;
+			opts->quiet = BOOL_TRUE;
 			break;
 		case 'u':
-			utf8 = BOOL_TRUE;
+			opts->utf8 = BOOL_TRUE;
 			break;
 		case '8':
-			bit8 = BOOL_TRUE;
+			opts->bit8 = BOOL_TRUE;
 			break;
 		case 'o':
-			log = BOOL_TRUE;
+			opts->log = BOOL_TRUE;
 			break;
 		case 'O':
-			if (lub_log_facility(optarg, &log_facility)) {
+			if (lub_log_facility(optarg, &opts->log_facility)) {
 				fprintf(stderr, "Error: Illegal syslog facility %s.\n", optarg);
 				help(-1, argv[0]);
-				goto end;
+				return -1;
 			}
 			break;
 		case 'd':
 			my_hooks.script_fn = clish_dryrun_callback;
 			break;
 		case 'x':
-			xml_path = optarg;
+			opts->xml_path = optarg;
 			break;
 		case 'w':
-			view = optarg;
+			opts->view = optarg;
 			break;
 		case 'i':
-			viewid = optarg;
+			opts->viewid = optarg;
 			break;
 		case 'k':
-			lockless = BOOL_TRUE;
+			opts->check = BOOL_TRUE;
+			opts->lockless = BOOL_TRUE;
 			my_hooks.script_fn = clish_dryrun_callback;
 			my_hooks.config_fn = NULL;
 			break;
 		case 't':
-			istimeout = BOOL_TRUE;
-			timeout = atoi(optarg);
+			opts->istimeout = BOOL_TRUE;
+			opts->timeout = atoi(optarg);
 			break;
 		case 'c': {
 				char *str;
-				cmd = BOOL_TRUE;
-				quiet = BOOL_TRUE;
+				opts->cmd = BOOL_TRUE;
+				opts->quiet = BOOL_TRUE;
 				str = strdup(optarg);
-				lub_list_add(cmds, str);
+				lub_list_add(opts->cmds, str);
 			}
 			break;
 		case 'f':
 			if (!strcmp(optarg, "/dev/null"))
-				histfile = NULL;
+				opts->histfile = NULL;
 			else
-				histfile = optarg;
+				opts->histfile = optarg;
 			break;
 		case 'z': {
 				int itmp = 0;
@@ -218,11 +518,27 @@ int main(int argc, char **argv)
 				if (itmp <= 0) {
 					fprintf(stderr, "Error: Illegal histsize option value.\n");
 					help(-1, argv[0]);
-					goto end;
+					return -1;
 				}
-				histsize = itmp;
+				opts->histsize = itmp;
 			}
 			break;
+		case 'C':
+			opts->compile = BOOL_TRUE;
+			break;
+		case 'F':
+			opts->freeze = BOOL_TRUE;
+			break;
+		case 'Z':
+			opts->zygote = optarg;
+			break;
+		case 'S':
+			opts->session = optarg;
+			break;
+		case 'p':
+			opts->profile = BOOL_TRUE;
+			opts->profile_path = optarg;
+			break;
 		case 'h':
 			help(0, argv[0]);
 			exit(0);
@@ -233,129 +549,434 @@ int main(int argc, char **argv)
 			break;
 		default:
 			help(-1, argv[0]);
-			goto end;
+			return -1;
 			break;
 		}
 	}
 
 	/* Validate command line options */
-	if (utf8 && bit8) {
+	if (opts->utf8 && opts->bit8) {
 		fprintf(stderr, "The -u and -8 options can't be used together.\n");
-		goto end;
+		return -1;
+	}
+	if (opts->zygote && (opts->session || opts->compile)) {
+		fprintf(stderr, "The -Z option can't be used with -S or -C.\n");
+		return -1;
 	}
 
-	/* Create shell instance */
-	if (quiet) {
-		FILE *tmpfd = NULL;
-		if ((tmpfd = fopen("/dev/null", "w")))
-			outfd = tmpfd;
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/*
+ * The zygote loads the scheme once and forks the sessions on request.
+ * The client passes its stdin, stdout and stderr, the current directory,
+ * the command line and the environment. The zygote answers with the pid
+ * of session and later with the exit status of session.
+ * The scheme is loaded with the rights of zygote's user so the sessions
+ * are allowed for the same user only.
+ */
+typedef struct {
+	uint32_t argc;
+	uint32_t envc;
+	uint32_t len; /* Length of strings following the header */
+} zygote_req_t;
+
+/* The limit of strings length within the request */
+#define ZYGOTE_REQ_MAX 0x100000
+/* The limit of arguments and of environment variables each */
+#define ZYGOTE_ARGS_MAX 0x10000
+
+static volatile sig_atomic_t zygote_stop = 0;
+static pid_t zygote_pid = 0; /* The session pid for client */
+
+/*--------------------------------------------------------- */
+static void zygote_sighandler(int signo)
+{
+	if (SIGCHLD != signo)
+		zygote_stop = 1;
+}
+
+/*--------------------------------------------------------- */
+/* Forward the signal to the session's process group */
+static void zygote_session_sighandler(int signo)
+{
+	if (zygote_pid > 0)
+		kill(-zygote_pid, signo);
+}
+
+/*--------------------------------------------------------- */
+static int zygote_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t ret = write(fd, p, len);
+		if (ret < 0) {
+			if (EINTR == errno)
+				continue;
+			return -1;
+		}
+		p += ret;
+		len -= ret;
 	}
-	shell = clish_shell_new(&my_hooks, NULL, NULL, outfd, stop_on_error);
-	if (!shell) {
-		fprintf(stderr, "Can't run clish.\n");
-		goto end;
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+static int zygote_read(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+
+	while (len) {
+		ssize_t ret = read(fd, p, len);
+		if (ret < 0) {
+			if (EINTR == errno)
+				continue;
+			return -1;
+		}
+		if (0 == ret)
+			return -1;
+		p += ret;
+		len -= ret;
 	}
-	/* Load the XML files */
-	clish_shell_load_scheme(shell, xml_path);
-	/* Set communication to the konfd */
-	clish_shell__set_socket(shell, socket_path);
-	/* Set lockless mode */
-	if (lockless)
-		clish_shell__set_lockfile(shell, NULL);
-	/* Set interactive mode */
-	if (!interactive)
-		clish_shell__set_interactive(shell, interactive);
-	/* Set startup view */
-	if (view)
-		clish_shell__set_startup_view(shell, view);
-	/* Set startup viewid */
-	if (viewid)
-		clish_shell__set_startup_viewid(shell, viewid);
-	/* Set UTF-8 or 8-bit mode */
-	if (utf8 || bit8)
-		clish_shell__set_utf8(shell, utf8);
-	else {
-#if HAVE_LANGINFO_CODESET
-		/* Autodetect encoding */
-		if (!strcmp(nl_langinfo(CODESET), "UTF-8"))
-			clish_shell__set_utf8(shell, BOOL_TRUE);
-#else
-		/* The default is 8-bit if locale is not supported */
-		clish_shell__set_utf8(shell, BOOL_FALSE);
-#endif
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* Append NUL-terminated string to the request */
+static void zygote_cat(char **buf, size_t *len, const char *str)
+{
+	size_t slen = strlen(str) + 1;
+
+	*buf = realloc(*buf, *len + slen);
+	assert(*buf);
+	memcpy(*buf + *len, str, slen);
+	*len += slen;
+}
+
+/*--------------------------------------------------------- */
+/* Receive the request within the forked session. The strings are
+ * used till the session exit so they are not freed.
+ */
+static int zygote_recv(int sock, int *argc, char ***argv)
+{
+	zygote_req_t req;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(3 * sizeof(int))];
+	int fds[3] = {-1, -1, -1};
+	char *buf = NULL;
+	char **envv = NULL;
+	char *p;
+	unsigned int i;
+	ssize_t ret;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &req;
+	iov.iov_len = sizeof(req);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	do {
+		ret = recvmsg(sock, &msg, 0);
+	} while ((ret < 0) && (EINTR == errno));
+	if (ret != sizeof(req))
+		return -1;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || (cmsg->cmsg_level != SOL_SOCKET) ||
+		(cmsg->cmsg_type != SCM_RIGHTS) ||
+		(cmsg->cmsg_len != CMSG_LEN(sizeof(fds))))
+		return -1;
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	/* The counts are bounded before the sum so it can't wrap */
+	if (!req.argc || (req.len > ZYGOTE_REQ_MAX) ||
+		(req.argc > ZYGOTE_ARGS_MAX) || (req.envc > ZYGOTE_ARGS_MAX) ||
+		(req.argc >= req.len) || (req.envc >= req.len) ||
+		(req.argc + req.envc >= req.len))
+		goto err;
+	if (!(buf = malloc(req.len)))
+		goto err;
+	if (zygote_read(sock, buf, req.len) < 0)
+		goto err;
+	if (buf[req.len - 1] != '\0')
+		goto err;
+	*argv = malloc((req.argc + 1) * sizeof(char *));
+	envv = malloc((req.envc + 1) * sizeof(char *));
+	if (!*argv || !envv)
+		goto err;
+	/* The strings are: cwd, argv[], environ[] */
+	p = buf;
+	for (i = 0; i < req.argc + req.envc; i++) {
+		p += strlen(p) + 1;
+		if (p >= buf + req.len)
+			goto err;
+		if (i < req.argc)
+			(*argv)[i] = p;
+		else
+			envv[i - req.argc] = p;
 	}
-	/* Set logging */
-	if (log) {
-		clish_shell__set_log(shell, log);
-		clish_shell__set_facility(shell, log_facility);
+	(*argv)[req.argc] = NULL;
+	envv[req.envc] = NULL;
+	*argc = req.argc;
+	environ = envv;
+	if (chdir(buf) < 0)
+		fprintf(stderr, "Warning: Can't change directory to %s.\n",
+			buf);
+
+	/* The session uses the stdio of client */
+	for (i = 0; i < 3; i++) {
+		if (dup2(fds[i], i) < 0)
+			goto err;
+		close(fds[i]);
 	}
-	/* Set idle timeout */
-	if (istimeout)
-		clish_shell__set_timeout(shell, timeout);
-	/* Set history settings */
-	clish_shell__stifle_history(shell, histsize);
-	if (histfile)
-		histfile_expanded = lub_system_tilde_expand(histfile);
-	if (histfile_expanded)
-		clish_shell__restore_history(shell, histfile_expanded);
 
-	/* Set source of command stream: files or interactive tty */
-	if(optind < argc) {
-		int i;
-		/* Run the commands from the files */
-		for (i = argc - 1; i >= optind; i--)
-			clish_shell_push_file(shell, argv[i], stop_on_error);
-	} else {
-		/* The interactive shell */
-		int tmpfd = dup(fileno(stdin));
+	return 0;
+err:
+	for (i = 0; i < 3; i++)
+		close(fds[i]);
+	return -1;
+}
+
+/*--------------------------------------------------------- */
+/* Serve the clients till SIGTERM. Returns 0 within the forked
+ * session only, 1 on SIGTERM and -1 on error. The argc and argv are
+ * the client's command line.
+ */
+static int zygote_serve(const char *path, int *argc, char ***argv)
+{
+	int sock;
+	struct sockaddr_un laddr;
+	struct sigaction sa;
+	sigset_t mask;
+	sigset_t orig_mask;
+	int *conns = NULL; /* The connection of session to send status */
+	pid_t *pids = NULL;
+	unsigned int conns_num = 0;
+	unsigned int i;
+
+	if (strlen(path) >= sizeof(laddr.sun_path)) {
+		fprintf(stderr, "Error: The zygote socket path is too long.\n");
+		return -1;
+	}
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("Error: Can't create zygote socket");
+		return -1;
+	}
 #ifdef FD_CLOEXEC
-		fcntl(tmpfd, F_SETFD, fcntl(tmpfd, F_GETFD) | FD_CLOEXEC);
+	fcntl(sock, F_SETFD, fcntl(sock, F_GETFD) | FD_CLOEXEC);
 #endif
-		clish_shell_push_fd(shell, fdopen(tmpfd, "r"), stop_on_error);
+	unlink(path);
+	memset(&laddr, 0, sizeof(laddr));
+	laddr.sun_family = AF_UNIX;
+	strncpy(laddr.sun_path, path, sizeof(laddr.sun_path) - 1);
+	if ((bind(sock, (struct sockaddr *)&laddr, sizeof(laddr)) < 0) ||
+		(chmod(path, 0600) < 0) || (listen(sock, 16) < 0)) {
+		perror("Error: Can't listen zygote socket");
+		close(sock);
+		return -1;
 	}
 
-	/* Execute startup */
-	running = clish_shell_startup(shell);
-	if (running) {
-		fprintf(stderr, "Can't startup clish.\n");
-		goto end;
-	}
+	/* The signals are delivered within pselect() only */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGHUP);
+	sigprocmask(SIG_BLOCK, &mask, &orig_mask);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = zygote_sighandler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
 
-	if (cmd) {
-		/* Iterate cmds */
-		for(iter = lub_list__get_head(cmds);
-			iter; iter = lub_list_node__get_next(iter)) {
-			char *str = (char *)lub_list_node__get_data(iter);
-			result = clish_shell_forceline(shell, str, NULL);
-			if (stop_on_error && result)
+	while (!zygote_stop) {
+		fd_set fds;
+		int conn;
+		pid_t pid;
+		int status;
+		int32_t val;
+
+		/* Send the exit status of finished sessions */
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (i = 0; i < conns_num; i++) {
+				if (pids[i] != pid)
+					continue;
+				val = WIFEXITED(status) ? WEXITSTATUS(status) :
+					128 + WTERMSIG(status);
+				zygote_write(conns[i], &val, sizeof(val));
+				close(conns[i]);
+				conns_num--;
+				conns[i] = conns[conns_num];
+				pids[i] = pids[conns_num];
 				break;
+			}
 		}
-	} else {
-		/* Main loop */
-		result = clish_shell_loop(shell);
-	}
 
-end:
-	/* Cleanup */
-	if (shell) {
-		if (histfile_expanded) {
-			clish_shell__save_history(shell, histfile_expanded);
-			free(histfile_expanded);
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+		if (pselect(sock + 1, &fds, NULL, NULL, NULL, &orig_mask) <= 0)
+			continue;
+		if ((conn = accept(sock, NULL, NULL)) < 0)
+			continue;
+#ifdef SO_PEERCRED
+		/* The scheme was loaded for zygote's user */
+		{
+			struct ucred cred;
+			socklen_t len = sizeof(cred);
+			if ((getsockopt(conn, SOL_SOCKET, SO_PEERCRED,
+				&cred, &len) < 0) || (cred.uid != getuid())) {
+				close(conn);
+				continue;
+			}
 		}
-		clish_shell_delete(shell);
+#endif
+		fflush(stdout);
+		fflush(stderr);
+		if ((pid = fork()) < 0) {
+			close(conn);
+			continue;
+		}
+
+		/* The session */
+		if (0 == pid) {
+			close(sock);
+			for (i = 0; i < conns_num; i++)
+				close(conns[i]);
+			free(conns);
+			free(pids);
+			sa.sa_handler = SIG_DFL;
+			sigaction(SIGCHLD, &sa, NULL);
+			sigaction(SIGTERM, &sa, NULL);
+			sigaction(SIGINT, &sa, NULL);
+			sigaction(SIGHUP, &sa, NULL);
+			sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+			setsid();
+			if (zygote_recv(conn, argc, argv) < 0)
+				_exit(1);
+			close(conn);
+#if HAVE_LOCALE_H
+			/* Use the locale of client */
+			setlocale(LC_ALL, "");
+#endif
+			return 0;
+		}
+
+		/* Keep the connection to send the exit status */
+		conns = realloc(conns, (conns_num + 1) * sizeof(*conns));
+		pids = realloc(pids, (conns_num + 1) * sizeof(*pids));
+		assert(conns && pids);
+		conns[conns_num] = conn;
+		pids[conns_num] = pid;
+		conns_num++;
+		val = pid;
+		zygote_write(conn, &val, sizeof(val));
 	}
-	if (quiet && (outfd != stdout))
-		fclose(outfd);
 
-	/* Delete each cmds element */
-	while ((iter = lub_list__get_head(cmds))) {
-		lub_list_del(cmds, iter);
-		free(lub_list_node__get_data(iter));
-		lub_list_node_free(iter);
+	/* The running sessions are not killed */
+	for (i = 0; i < conns_num; i++)
+		close(conns[i]);
+	free(conns);
+	free(pids);
+	close(sock);
+	unlink(path);
+
+	return 1;
+}
+
+/*--------------------------------------------------------- */
+/* Run the session by zygote. Returns the exit status of session. */
+static int zygote_session(const char *path, int argc, char **argv)
+{
+	int sock;
+	struct sockaddr_un raddr;
+	zygote_req_t req;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(3 * sizeof(int))];
+	int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	struct sigaction sa;
+	char *buf = NULL;
+	size_t len = 0;
+	char *cwd;
+	int32_t val;
+	int i;
+
+	if (strlen(path) >= sizeof(raddr.sun_path)) {
+		fprintf(stderr, "Error: The zygote socket path is too long.\n");
+		return -1;
+	}
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+	memset(&raddr, 0, sizeof(raddr));
+	raddr.sun_family = AF_UNIX;
+	strncpy(raddr.sun_path, path, sizeof(raddr.sun_path) - 1);
+	if (connect(sock, (struct sockaddr *)&raddr, sizeof(raddr)) < 0) {
+		fprintf(stderr, "Error: Can't connect to zygote %s.\n", path);
+		close(sock);
+		return -1;
 	}
-	lub_list_free(cmds);
 
-	return result;
+	/* The strings are: cwd, argv[], environ[] */
+	cwd = getcwd(NULL, 0);
+	zygote_cat(&buf, &len, cwd ? cwd : "/");
+	free(cwd);
+	for (i = 0; i < argc; i++)
+		zygote_cat(&buf, &len, argv[i]);
+	for (i = 0; environ[i]; i++)
+		zygote_cat(&buf, &len, environ[i]);
+	req.argc = argc;
+	req.envc = i;
+	req.len = len;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &req;
+	iov.iov_len = sizeof(req);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	if ((len > ZYGOTE_REQ_MAX) || (req.argc > ZYGOTE_ARGS_MAX) ||
+		(req.envc > ZYGOTE_ARGS_MAX) ||
+		(sendmsg(sock, &msg, 0) != sizeof(req)) ||
+		(zygote_write(sock, buf, len) < 0) ||
+		(zygote_read(sock, &val, sizeof(val)) < 0)) {
+		fprintf(stderr, "Error: Zygote refused the session.\n");
+		free(buf);
+		close(sock);
+		return -1;
+	}
+	free(buf);
+
+	/* Forward the terminal signals to the session */
+	zygote_pid = val;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = zygote_session_sighandler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGQUIT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+
+	/* Wait for the exit status of session */
+	if (zygote_read(sock, &val, sizeof(val)) < 0)
+		val = 1;
+	close(sock);
+
+	return val;
 }
 
 /*--------------------------------------------------------- */
@@ -403,6 +1024,11 @@ static void help(int status, const char *argv0)
 		printf("\t-c <command>, --command=<command>\tExecute specified command(s).\n\t\tMultiple options are possible.\n");
 		printf("\t-f <path>, --histfile=<path>\tFile to save command history.\n");
 		printf("\t-z <num>, --histsize=<num>\tCommand history size in lines.\n");
+		printf("\t-C, --compile\tCompile XML scheme files to the binary image\n\t\twithin the first directory of XML path.\n");
+		printf("\t-F, --freeze\tBuild all views and move the scheme strings\n\t\tto the read-only shared memory.\n");
+		printf("\t-Z <path>, --zygote=<path>\tLoad the scheme once and listen\n\t\tthe socket for the sessions.\n");
+		printf("\t-S <path>, --session=<path>\tRun the session by zygote\n\t\tlistening the socket. The options of zygote are kept.\n");
+		printf("\t-p[<path>], --profile-startup[=<path>]\tWrite the startup time\n\t\tand memory by phases as JSON Lines. Default is stderr.\n");
 	}
 }
 
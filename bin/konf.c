@@ -34,6 +34,7 @@
 #define version(v) printf("%s\n", v)
 
 static void help(int status, const char *argv0);
+static int print_data(void *udata, const char *chunk, size_t len);
 
 static const char *escape_chars = "\"\\'";
 
@@ -42,7 +43,6 @@ int main(int argc, char **argv)
 {
 	int res = -1;
 	konf_client_t *client = NULL;
-	konf_buf_t *buf = NULL;
 	char *line = NULL;
 	char *str = NULL;
 	const char *socket_path = KONFD_SOCKET_PATH;
@@ -136,24 +136,11 @@ int main(int argc, char **argv)
 		goto err;
 	}
 
-	if (konf_client_recv_answer(client, &buf) < 0) {
+	if (konf_client_recv_answer_stream(client, print_data, stdout) < 0) {
 		fprintf(stderr, "Error: The error code from the konfd daemon.\n");
 		goto err;
 	}
 
-	if (buf) {
-		konf_buf_lseek(buf, 0);
-		while ((str = konf_buf_preparse(buf))) {
-			if (strlen(str) == 0) {
-				lub_string_free(str);
-				break;
-			}
-			fprintf(stdout, "%s\n", str);
-			lub_string_free(str);
-		}
-		konf_buf_delete(buf);
-	}
-
 	res = 0;
 err:
 	lub_string_free(line);
@@ -162,6 +149,18 @@ err:
 	return res;
 }
 
+/*--------------------------------------------------------- */
+/* Print the dump data as it's received */
+static int print_data(void *udata, const char *chunk, size_t len)
+{
+	FILE *stream = (FILE *)udata;
+
+	if (fwrite(chunk, 1, len, stream) != len)
+		return -1;
+
+	return 0;
+}
+
 /*--------------------------------------------------------- */
 /* Print help message */
 static void help(int status, const char *argv0)
@@ -20,10 +20,14 @@
 #include <assert.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
 #include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <sys/select.h>
 #include <signal.h>
 #include <syslog.h>
+#include <time.h>
 
 #if WITH_INTERNAL_GETOPT
 #include "libc/getopt.h"
@@ -39,14 +43,26 @@
 #ifdef HAVE_GRP_H
 #include <grp.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#ifdef WITH_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#endif
 
 #include "clish/internal.h"
 #include "konf/tree.h"
 #include "konf/query.h"
 #include "konf/buf.h"
+#include "konf/shm.h"
+#include "konf/net.h"
 #include "lub/argv.h"
 #include "lub/string.h"
 #include "lub/log.h"
+#include "lub/list.h"
 
 #ifndef VERSION
 #define VERSION 1.2.2
@@ -56,6 +72,11 @@
 
 #define KONFD_PIDFILE "/var/run/konfd.pid"
 
+/* The datastore to use when query has no datastore selector */
+#define KONFD_STORE_DEFAULT "running"
+/* The limit of datastores the clients can create */
+#define KONFD_STORES_MAX 32
+
 /* UNIX socket path */
 /* Don't use UNIX_PATH_MAX due to portability issues */
 #define USOCK_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
@@ -65,18 +86,263 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+/* The named datastore. Each datastore has its own config tree. */
+typedef struct konfd_store_s konfd_store_t;
+struct konfd_store_s {
+	char *name;
+	konf_tree_t *conf;
+};
+
+/* The node handles. The client gets the handle of its pwd node once and
+ * then sends it instead of the full pwd. So the daemon doesn't resolve
+ * the path on every request. The 64-bit handle value consists of slot
+ * index and slot generation. Each allocation of slot takes the next
+ * generation of the daemon so the generations are never reused and the
+ * handle of released slot is stale. The generations start from the
+ * random number to don't accept the handles given by the previous
+ * instance of daemon.
+ */
+#define KONFD_HANDLE_SLOT_BITS 20
+#define KONFD_HANDLE_SLOT_MASK ((1U << KONFD_HANDLE_SLOT_BITS) - 1)
+#define KONFD_HANDLE_GEN_MASK ((UINT64_C(1) << (64 - KONFD_HANDLE_SLOT_BITS)) - 1)
+
+typedef struct konfd_handle_s konfd_handle_t;
+struct konfd_handle_s {
+	konf_tree_t *node; /* NULL for the free slot */
+	konfd_store_t *store; /* The handle is valid within this store only */
+	uint64_t gen; /* 0 for the free slot */
+	unsigned int shard; /* The shard key of the top-level section */
+	unsigned int next_free;
+	char *pwd; /* The encoded pwd of node to pass changes to replicas */
+};
+
+static konfd_handle_t *handles = NULL;
+static unsigned int handles_num = 0;
+static unsigned int handles_free = 0; /* The first free slot + 1 */
+static uint64_t handles_gen = 0; /* The last given generation */
+
+/* The result of request. The tree code doesn't send anything. The
+ * answer is formatted and sent by main loop.
+ */
+typedef struct konfd_result_s konfd_result_t;
+struct konfd_result_s {
+	konf_query_op_t ret;
+	uint64_t handle; /* The handle to give or 0 */
+	char *data; /* The dump to send before answer */
+	size_t len;
+};
+
+#ifdef HAVE_PTHREAD_H
+/* The requests are processed by the worker threads (shards) when
+ * workers are enabled. The request is routed to the shard by the first
+ * pwd element i.e. by the top-level section. So the requests for the
+ * different sections are processed in parallel and the requests for the
+ * same section are serialized by its shard. The sections are the
+ * subtrees of the single root so the dump order is the same as usual.
+ * The requests for the root level itself (set/unset/dump without pwd,
+ * copy) change the root list or read the whole tree. They are
+ * exclusive.
+ * Main loop is the I/O stage. It reads and parses the requests, passes
+ * them to the workers and sends the results back. So the single worker
+ * is the pipeline of parsing and tree changes. The queues are lock-free.
+ */
+typedef struct konfd_job_s konfd_job_t;
+struct konfd_job_s {
+	int sock;
+	konf_query_t *query;
+	konfd_result_t res;
+	konfd_job_t *next;
+};
+
+typedef struct konfd_worker_s konfd_worker_t;
+struct konfd_worker_s {
+	pthread_t tid;
+	sem_t sem; /* The number of queued jobs */
+	/* The single producer (main loop) single consumer ring. Each
+	 * client has one request in progress at most so the ring
+	 * can't overflow.
+	 */
+	konfd_job_t *ring[FD_SETSIZE];
+	unsigned int head;
+	unsigned int tail;
+	lub_list_t *stores;
+};
+
+static konfd_worker_t *workers = NULL;
+/* Root level requests are exclusive */
+static pthread_rwlock_t tree_rwlock;
+/* Protects the list of datastores and the handles */
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* The lock-free stacks of finished jobs and the changes to pass to
+ * replicas. Main loop takes the whole stack at once.
+ */
+static konfd_job_t *done_head = NULL;
+static konfd_job_t *forward_head = NULL;
+static int done_pipe[2] = {-1, -1};
+#endif
+static unsigned int workers_num = 0;
+/* The client's request is in progress within worker (1) or the
+ * background dump child (2) */
+static int busy[FD_SETSIZE];
+/* The client is disconnected but its request is in progress */
+static int closing[FD_SETSIZE];
+/* The pid of background file dump child. Indexed by client socket. */
+static pid_t saving[FD_SETSIZE];
+/* The SIGCHLD handler wakes up main loop by this pipe */
+static int chld_pipe[2] = {-1, -1};
+/* The umask is got once. It can't be got by the threads safely. */
+static mode_t file_mask = 022;
+
+/* The hot restart. The new daemon started with --takeover connects to
+ * the control socket of the running daemon. The running daemon finishes
+ * the requests in progress and sends the listen socket, the image of
+ * datastores and all the client sockets (with their shm regions and
+ * not processed data) to the new daemon. It exits when the new daemon
+ * confirms the takeover. The clients don't notice the handover. The
+ * new daemon continues the handle generations of the old one so the
+ * handles given by the old daemon are stale and clients fall back to
+ * the full pwd.
+ */
+#define KONFD_CTL_SUFFIX ".takeover"
+#define KONFD_CTL_FDS 2 /* Max number of descriptors per message */
+static int ctl_sock = -1;
+static char *ctl_path = NULL; /* The control socket path we own */
+/* The socket path and pidfile belong to the other daemon */
+static int keep_path = 0;
+
+/* The replication. The replica daemon connects to the primary one and
+ * sends the watch request. The primary sends the image of datastores
+ * and then passes each applied change to the replica. The changes are
+ * queued under the tree lock so the changes of the same section come
+ * in order and the root level changes are not mixed with others. Main
+ * loop sends the queues without blocking. The replica serves the read
+ * requests (dumps) and rejects the changes.
+ */
+static int replicas[FD_SETSIZE]; /* The client socket is a replica */
+static unsigned int replicas_num = 0;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t replica_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static int replica_mode = 0;
+static konf_client_t *primary = NULL; /* The connection to primary */
+static konf_buf_t *primary_buf = NULL;
+
+#ifdef WITH_IO_URING
+/* The io_uring backend. It's NULL if select() is used. */
+typedef struct konfd_uring_s konfd_uring_t;
+static konfd_uring_t *uring = NULL;
+#endif
+
 /* Global signal vars */
 static volatile int sigterm = 0;
 static void sighandler(int signo);
+static void sigchld_handler(int signo);
+
+/* The set of active sockets */
+static fd_set active_fd_set;
+/* The shm transport of clients. Indexed by client socket. */
+static konf_shm_t *shms[FD_SETSIZE];
+/* The owner (client socket) of shm wakeup eventfd. Indexed by eventfd. */
+static int shm_owner[FD_SETSIZE];
+/* The answers waiting for the free space of client's shm ring. The main
+ * loop doesn't sleep on the ring. The rest is written when the client
+ * reads the ring and wakes the loop up. Indexed by client socket.
+ */
+typedef struct konfd_out_s konfd_out_t;
+struct konfd_out_s {
+	char *data;
+	size_t len;
+	size_t pos;
+	size_t max; /* The limit of queued data */
+};
+static konfd_out_t shm_out[FD_SETSIZE];
+/* The image and changes the replica doesn't read yet. The replica is
+ * dropped if the queue grows over the limit.
+ */
+#define KONFD_REPLICA_QUEUE_MAX (16 * 1024 * 1024)
+static konfd_out_t replica_out[FD_SETSIZE];
+static fd_set replica_wait_set; /* The replicas with queued data */
 
 static void help(int status, const char *argv0);
-static char * process_query(int sock, konf_tree_t * conf, char *str);
+static int store_compare(const void *first, const void *second);
+static void process_query(int sock, lub_list_t *stores, char *str);
+static void execute_query(int sock, lub_list_t *stores, konf_query_t *query,
+	konfd_result_t *res);
+static void answer_result(int sock, konfd_result_t *res);
+static int fd_service(int fd, int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs);
+static void client_input(int sock, int nbytes, lub_list_t *stores,
+	lub_bintree_t *bufs);
+static void client_process(int sock, lub_list_t *stores, lub_bintree_t *bufs);
+static void client_close(int sock, lub_bintree_t *bufs);
+static void client_drop(int sock, lub_bintree_t *bufs);
+static int workers_start(unsigned int num, lub_list_t *stores);
+static void workers_stop(void);
+static void workers_done(lub_list_t *stores, lub_bintree_t *bufs);
+static void bgsave_done(lub_list_t *stores, lub_bintree_t *bufs);
+static void tree_lock(bool_t exclusive);
+static void tree_unlock(void);
+static void store_lock(void);
+static void store_unlock(void);
+static void process_shm(int sock, lub_list_t *stores, lub_bintree_t *bufs);
+static konfd_store_t *store_find(lub_list_t *stores, const char *name,
+	bool_t create);
+static void store_free_all(lub_list_t *stores);
+static unsigned int shard_key(const char *key);
+static uint64_t handle_seed(void);
+static uint64_t handle_get(konfd_store_t *store, konf_tree_t *node,
+	unsigned int shard, const char *pwd);
+static konf_tree_t *handle_find(konfd_store_t *store, uint64_t handle,
+	unsigned int *shard, const char **pwd);
+static void handle_release(konf_tree_t *node);
+static int shm_offer(int sock);
+static void shm_close(int sock);
+static int shm_flush(int sock, int block);
+static void out_queue(konfd_out_t *out, const char *data, size_t len);
 int answer_send(int sock, const char *command);
-static int dump_running_config(int sock, konf_tree_t *conf, konf_query_t *query);
+static int client_send(int sock, const char *data, size_t len);
+static void dump_tree(konf_tree_t *conf, FILE *f, konf_query_t *query);
+static int dump_running_config(int sock, konf_tree_t *conf, konf_query_t *query,
+	konfd_result_t *res);
+static int dump_bgsave(int sock, konf_tree_t *conf, konf_query_t *query);
 int daemonize(int nochdir, int noclose);
 struct options *opts_init(void);
 void opts_free(struct options *opts);
 static int opts_parse(int argc, char *argv[], struct options *opts);
+static int ctl_listen(const char *socket_path, uid_t uid, gid_t gid);
+static int takeover_connect(const char *socket_path, int *ctl,
+	int *memfd, unsigned int *nclients, uint64_t *gen);
+static int takeover_load(int ctl, int memfd, unsigned int nclients,
+	lub_list_t *stores, lub_bintree_t *bufs);
+static int takeover_give(int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs);
+static bool_t query_is_write(konf_query_t *query);
+static char *pwd_encode(konf_query_t *query);
+static int replica_watch(int sock, lub_list_t *stores);
+static void replica_forward(konf_query_t *query, const char *pwd);
+static void replica_send(const char *str);
+static void replica_flush(void);
+static void replica_out_flush(int sock, int block);
+static void replica_drop(int sock);
+static int primary_connect(const char *path);
+static void primary_process(lub_list_t *stores);
+#ifdef WITH_IO_URING
+static int uring_init(void);
+static void uring_fini(void);
+static int uring_process(int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs);
+static void uring_stop(int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs);
+static void uring_forget(int fd);
+static int uring_send(int sock, const char *data, size_t len);
+static int uring_send_busy(int sock);
+/* The answers are queued. They are sent by main loop only. */
+#define URING_SENDS() (uring != NULL)
+#else
+#define uring_stop(sock, workers, stores, bufs) do {} while (0)
+#define uring_forget(fd) do {} while (0)
+#define URING_SENDS() 0
+#endif
 
 /* Command line options */
 struct options {
@@ -87,6 +353,10 @@ struct options {
 	uid_t uid;
 	gid_t gid;
 	int log_facility;
+	unsigned int workers;
+	int takeover; /* Take over the running daemon */
+	char *replica; /* The primary socket path for replica mode */
+	unsigned int compact; /* Front-code the sections of such size */
 };
 
 /*--------------------------------------------------------- */
@@ -94,29 +364,37 @@ int main(int argc, char **argv)
 {
 	int retval = -1;
 	int i;
-	char *str;
-	konf_tree_t *conf;
+	lub_list_t *stores;
 	lub_bintree_t bufs;
 	konf_buf_t *tbuf;
 	struct options *opts = NULL;
 	int pidfd = -1;
+	int stop = 0;
 
 	/* Network vars */
 	int sock = -1;
+	int ctl = -1;
+	int memfd = -1;
+	unsigned int nclients = 0;
+	uint64_t takeover_gen = 0; /* The last handle generation of old daemon */
 	struct sockaddr_un laddr;
-	struct sockaddr_un raddr;
-	fd_set active_fd_set, read_fd_set;
+	fd_set read_fd_set;
+	fd_set write_fd_set;
 	const int reuseaddr = 1;
 
 	/* Signal vars */
-	struct sigaction sig_act, sigpipe_act;
-	sigset_t sig_set, sigpipe_set;
+	struct sigaction sig_act, sigpipe_act, sigchld_act;
+	sigset_t sig_set, sigpipe_set, sigchld_set;
 
 	/* Parse command line options */
 	opts = opts_init();
 	if (opts_parse(argc, argv, opts))
 		goto err;
 
+	/* Get the umask for the file dumps */
+	file_mask = umask(0);
+	umask(file_mask);
+
 	/* Initialize syslog */
 	openlog(argv[0], LOG_CONS, opts->log_facility);
 	syslog(LOG_ERR, "Start daemon.\n");
@@ -131,7 +409,8 @@ int main(int argc, char **argv)
 
 		/* Write pidfile */
 		if ((pidfd = open(opts->pidfile,
-			O_WRONLY | O_CREAT | O_EXCL | O_TRUNC,
+			O_WRONLY | O_CREAT | O_TRUNC |
+			(opts->takeover ? 0 : O_EXCL),
 			S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
 			syslog(LOG_WARNING, "Can't open pidfile %s: %s",
 				opts->pidfile, strerror(errno));
@@ -146,6 +425,17 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* Get listen socket from the running daemon */
+	if (opts->takeover) {
+		keep_path = 1; /* Until the takeover is finished */
+		if ((sock = takeover_connect(opts->socket_path,
+			&ctl, &memfd, &nclients, &takeover_gen)) < 0) {
+			syslog(LOG_ERR, "Can't take over the running daemon\n");
+			goto err;
+		}
+		goto listen_ctl;
+	}
+
 	/* Create listen socket */
 	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
 		syslog(LOG_ERR, "Can't create listen socket: %s\n",
@@ -172,6 +462,12 @@ int main(int argc, char **argv)
 	}
 	listen(sock, 5);
 
+listen_ctl:
+	/* The control socket for the next hot restart */
+	if (ctl_listen(opts->socket_path, opts->uid, opts->gid) < 0)
+		syslog(LOG_WARNING, "Can't create control socket. "
+			"The takeover is not supported.\n");
+
 	/* Change GID */
 	if (opts->gid != getgid()) {
 		if (setgid(opts->gid)) {
@@ -201,8 +497,13 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Create configuration tree */
-	conf = konf_tree_new("", 0);
+	/* Create the list of datastores with the default one */
+	/* The handles of the old daemon are stale for the new one */
+	handles_gen = takeover_gen ? takeover_gen : handle_seed();
+	konf_tree_release_hook(handle_release);
+	konf_tree_compact(opts->compact);
+	stores = lub_list_new(store_compare);
+	store_find(stores, KONFD_STORE_DEFAULT, BOOL_TRUE);
 
 	/* Initialize the tree of buffers */
 	lub_bintree_init(&bufs,
@@ -230,17 +531,80 @@ int main(int argc, char **argv)
 	sigpipe_act.sa_handler = SIG_IGN;
 	sigaction(SIGPIPE, &sigpipe_act, NULL);
 
+	/* The background dump children report by SIGCHLD */
+	if ((pipe(chld_pipe) < 0) || (chld_pipe[0] >= FD_SETSIZE)) {
+		syslog(LOG_ERR, "Can't create pipe\n");
+		goto err;
+	}
+	fcntl(chld_pipe[0], F_SETFL, fcntl(chld_pipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(chld_pipe[1], F_SETFL, fcntl(chld_pipe[1], F_GETFL) | O_NONBLOCK);
+	sigemptyset(&sigchld_set);
+	sigaddset(&sigchld_set, SIGCHLD);
+	sigchld_act.sa_flags = SA_NOCLDSTOP;
+	sigchld_act.sa_mask = sigchld_set;
+	sigchld_act.sa_handler = &sigchld_handler;
+	sigaction(SIGCHLD, &sigchld_act, NULL);
+
 	/* Initialize the set of active sockets. */
 	FD_ZERO(&active_fd_set);
 	FD_SET(sock, &active_fd_set);
+	FD_SET(chld_pipe[0], &active_fd_set);
+	if (ctl_sock >= 0)
+		FD_SET(ctl_sock, &active_fd_set);
+	for (i = 0; i < FD_SETSIZE; i++) {
+		shms[i] = NULL;
+		shm_owner[i] = -1;
+		busy[i] = 0;
+		closing[i] = 0;
+		saving[i] = 0;
+		replicas[i] = 0;
+		replica_out[i].max = KONFD_REPLICA_QUEUE_MAX;
+	}
+
+	/* Start worker threads */
+	if (opts->workers && (workers_start(opts->workers, stores) < 0)) {
+		syslog(LOG_ERR, "Can't start worker threads\n");
+		goto err;
+	}
+
+	/* Load the state of the old daemon */
+	if (opts->takeover) {
+		if (takeover_load(ctl, memfd, nclients, stores, &bufs) < 0) {
+			syslog(LOG_ERR, "Can't take over the running daemon\n");
+			goto err;
+		}
+		keep_path = 0;
+		syslog(LOG_ERR, "The running daemon is taken over.\n");
+	}
+
+	/* Replica gets the config from the primary */
+	if (opts->replica) {
+		replica_mode = 1;
+		if (primary_connect(opts->replica) < 0) {
+			syslog(LOG_ERR, "Can't connect to primary daemon\n");
+			goto err;
+		}
+	}
 
 	/* Main loop */
-	while (!sigterm) {
+#ifdef WITH_IO_URING
+	if (uring_init() < 0)
+		syslog(LOG_ERR, "Can't use io_uring, fall back to select()\n");
+#endif
+	while (!sigterm && !stop) {
 		int num;
 
+#ifdef WITH_IO_URING
+		if (uring) {
+			stop = uring_process(sock, opts->workers, stores, &bufs);
+			continue;
+		}
+#endif
 		/* Block until input arrives on one or more active sockets. */
 		read_fd_set = active_fd_set;
-		num = select(FD_SETSIZE, &read_fd_set, NULL, NULL, NULL);
+		write_fd_set = replica_wait_set;
+		num = select(FD_SETSIZE, &read_fd_set, &write_fd_set,
+			NULL, NULL);
 		if (num < 0) {
 			if (EINTR == errno)
 				continue;
@@ -253,47 +617,33 @@ int main(int argc, char **argv)
 		for (i = 0; i < FD_SETSIZE; ++i) {
 			if (!FD_ISSET(i, &read_fd_set))
 				continue;
-			if (i == sock) {
-				/* Connection request on listen socket. */
-				int new;
-				socklen_t size = sizeof(raddr);
-				new = accept(sock,
-					(struct sockaddr *)&raddr, &size);
-				if (new < 0) {
-					fprintf(stderr, "accept");
-					continue;
-				}
-#ifdef DEBUG
-				fprintf(stderr, "Connection established %u\n", new);
-#endif
-				konf_buftree_remove(&bufs, new);
-				tbuf = konf_buf_new(new);
-				/* insert it into the binary tree for this conf */
-				lub_bintree_insert(&bufs, tbuf);
-				FD_SET(new, &active_fd_set);
-			} else {
-				int nbytes;
-				/* Data arriving on an already-connected socket. */
-				if ((nbytes = konf_buftree_read(&bufs, i)) <= 0) {
-					close(i);
-					FD_CLR(i, &active_fd_set);
-					konf_buftree_remove(&bufs, i);
-					continue;
-				}
-				while ((str = konf_buftree_parse(&bufs, i))) {
-					char *answer;
-					if (!(answer = process_query(i, conf, str)))
-						answer = strdup("-e");
-					free(str);
-					answer_send(i, answer);
-					free(answer);
-				}
+			if (fd_service(i, sock, opts->workers, stores, &bufs)) {
+				stop = 1;
+				break;
 			}
 		}
+		/* Send the queued data to the replicas */
+		for (i = 0; i < FD_SETSIZE; ++i) {
+			if (FD_ISSET(i, &write_fd_set))
+				replica_out_flush(i, 0);
+		}
 	}
 
 	/* Free resources */
-	konf_tree_delete(conf);
+	workers_stop();
+#ifdef WITH_IO_URING
+	uring_fini();
+#endif
+	if (primary) {
+		konf_buf_delete(primary_buf);
+		konf_client_free(primary);
+	}
+	store_free_all(stores);
+	free(handles);
+	for (i = 0; i < FD_SETSIZE; i++) {
+		shm_close(i);
+		free(replica_out[i].data);
+	}
 
 	/* delete each buf */
 	while ((tbuf = lub_bintree_findfirst(&bufs))) {
@@ -308,11 +658,18 @@ err:
 	/* Close listen socket */
 	if (sock >= 0) {
 		close(sock);
-		unlink(opts->socket_path);
+		if (!keep_path)
+			unlink(opts->socket_path);
+	}
+	if (ctl_sock >= 0)
+		close(ctl_sock);
+	if (ctl_path) {
+		unlink(ctl_path);
+		lub_string_free(ctl_path);
 	}
 
 	/* Remove pidfile */
-	if (pidfd >= 0) {
+	if ((pidfd >= 0) && !keep_path) {
 		if (unlink(opts->pidfile) < 0) {
 			syslog(LOG_ERR, "Can't remove pid-file %s: %s\n",
 			opts->pidfile, strerror(errno));
@@ -328,15 +685,80 @@ err:
 }
 
 /*--------------------------------------------------------- */
-static char * process_query(int sock, konf_tree_t * conf, char *str)
+/* Service the descriptor having input pending. Returns 1 if the daemon
+ * must stop.
+ */
+static int fd_service(int fd, int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs)
+{
+	if (fd == sock) {
+		/* Connection request on listen socket. */
+		struct sockaddr_un raddr;
+		socklen_t size = sizeof(raddr);
+		konf_buf_t *tbuf;
+		int new;
+		new = accept(sock, (struct sockaddr *)&raddr, &size);
+		if (new < 0) {
+			fprintf(stderr, "accept");
+			return 0;
+		}
+#ifdef DEBUG
+		fprintf(stderr, "Connection established %u\n", new);
+#endif
+		konf_buftree_remove(bufs, new);
+		tbuf = konf_buf_new(new);
+		/* insert it into the binary tree for this conf */
+		lub_bintree_insert(bufs, tbuf);
+		FD_SET(new, &active_fd_set);
+	} else if (fd == ctl_sock) {
+		/* The new daemon takes over */
+		if (takeover_give(sock, workers, stores, bufs) == 0) {
+			syslog(LOG_ERR, "The daemon is taken over.\n");
+			return 1;
+		}
+	} else if (primary && (fd == konf_client__get_sock(primary))) {
+		/* The changes from primary */
+		primary_process(stores);
+	} else if (fd == chld_pipe[0]) {
+		/* Background dumps are finished */
+		bgsave_done(stores, bufs);
+#ifdef HAVE_PTHREAD_H
+	} else if (fd == done_pipe[0]) {
+		/* Workers have finished some requests */
+		workers_done(stores, bufs);
+#endif
+	} else if (shm_owner[fd] >= 0) {
+		/* Requests arriving on shm transport */
+		process_shm(shm_owner[fd], stores, bufs);
+	} else {
+		/* Data arriving on an already-connected socket. */
+		client_input(fd, konf_buftree_read(bufs, fd), stores, bufs);
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* The data is received to the client's buffer or the client is
+ * disconnected.
+ */
+static void client_input(int sock, int nbytes, lub_list_t *stores,
+	lub_bintree_t *bufs)
+{
+	if (nbytes <= 0) {
+		client_drop(sock, bufs);
+		return;
+	}
+	client_process(sock, stores, bufs);
+}
+
+/*--------------------------------------------------------- */
+/* Process the request and send answer to the client */
+static void process_query(int sock, lub_list_t *stores, char *str)
 {
-	int i;
 	int res;
-	konf_tree_t *iconf;
-	konf_tree_t *tmpconf;
 	konf_query_t *query;
-	char *retval = NULL;
-	konf_query_op_t ret = KONF_QUERY_OP_ERROR;
+	konfd_result_t result;
 
 #ifdef DEBUG
 	fprintf(stderr, "----------------------\n");
@@ -347,26 +769,153 @@ static char * process_query(int sock, konf_tree_t * conf, char *str)
 	res = konf_query_parse_str(query, str);
 	if (res < 0) {
 		konf_query_free(query);
-		return NULL;
+		answer_send(sock, "-e");
+		return;
 	}
 #ifdef DEBUG
 	konf_query_dump(query);
 #endif
 
-	/* Go through the pwd */
-	iconf = conf;
-	for (i = 0; i < konf_query__get_pwdc(query); i++) {
-		if (!(iconf = konf_tree_find_conf(iconf,
-			konf_query__get_pwd(query, i), 0, 0))) {
-			iconf = NULL;
-			break;
+	/* The replica accepts the changes from primary only */
+	if (replica_mode && query_is_write(query)) {
+		konf_query_free(query);
+		answer_send(sock, "-e");
+		return;
+	}
+
+	/* The replica gets the image and then the stream of changes */
+	if (KONF_QUERY_OP_WATCH == konf_query__get_op(query)) {
+		if (replica_watch(sock, stores) < 0)
+			answer_send(sock, "-e");
+		konf_query_free(query);
+		return;
+	}
+
+	/* The shm answer is sent with descriptors. Main loop only. */
+	if (KONF_QUERY_OP_SHM == konf_query__get_op(query)) {
+		if (shm_offer(sock) < 0)
+			answer_send(sock, "-e");
+		konf_query_free(query);
+		return;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	if (workers_num) {
+		konfd_worker_t *worker;
+		konfd_job_t *job;
+		const char *key = NULL;
+		unsigned int hash = 0;
+
+		/* Route request to the shard by the top-level section.
+		 * The handle knows its section. The stale handle can be
+		 * routed anywhere.
+		 */
+		if (konf_query__get_handle(query)) {
+			store_lock();
+			handle_find(NULL, konf_query__get_handle(query),
+				&hash, NULL);
+			store_unlock();
+		} else {
+			if (konf_query__get_pwdc(query) > 0)
+				key = konf_query__get_pwd(query, 0);
+			else if (konf_query__get_line(query))
+				key = konf_query__get_line(query);
+			else if (konf_query__get_pattern(query))
+				key = konf_query__get_pattern(query);
+			hash = shard_key(key);
+		}
+		worker = &workers[hash % workers_num];
+
+		job = malloc(sizeof(*job));
+		assert(job);
+		job->sock = sock;
+		job->query = query;
+		job->next = NULL;
+		busy[sock] = 1;
+		__atomic_store_n(&worker->ring[worker->tail % FD_SETSIZE],
+			job, __ATOMIC_RELAXED);
+		__atomic_store_n(&worker->tail, worker->tail + 1,
+			__ATOMIC_RELEASE);
+		sem_post(&worker->sem);
+		return;
+	}
+#endif
+
+	execute_query(sock, stores, query, &result);
+	answer_result(sock, &result);
+	if (saving[sock])
+		busy[sock] = 2;
+}
+
+/*--------------------------------------------------------- */
+/* Execute the parsed query. The query is freed. The result is
+ * returned within res.
+ */
+static void execute_query(int sock, lub_list_t *stores, konf_query_t *query,
+	konfd_result_t *res)
+{
+	int i;
+	konfd_store_t *store;
+	konf_tree_t *conf;
+	konf_tree_t *iconf;
+	konf_tree_t *tmpconf;
+	konf_query_op_t ret = KONF_QUERY_OP_ERROR;
+	bool_t exclusive = BOOL_FALSE;
+	uint64_t handle = konf_query__get_handle(query);
+	unsigned int shard = 0;
+	const char *hpwd = NULL;
+
+	res->ret = KONF_QUERY_OP_ERROR;
+	res->handle = 0;
+	res->data = NULL;
+	res->len = 0;
+
+	/* The requests for the root level are exclusive */
+	if (((konf_query__get_pwdc(query) == 0) && !handle) ||
+		(KONF_QUERY_OP_COPY == konf_query__get_op(query)))
+		exclusive = BOOL_TRUE;
+	tree_lock(exclusive);
+
+	/* Find datastore. The write operations create it on demand. */
+	store_lock();
+	store = store_find(stores, konf_query__get_store(query) ?
+		konf_query__get_store(query) : KONFD_STORE_DEFAULT,
+		((KONF_QUERY_OP_SET == konf_query__get_op(query)) ||
+		(KONF_QUERY_OP_COPY == konf_query__get_op(query))) ?
+		BOOL_TRUE : BOOL_FALSE);
+	store_unlock();
+	if (!store) {
+		tree_unlock();
+		konf_query_free(query);
+		return;
+	}
+	conf = store->conf;
+
+	/* Use the handle or go through the pwd */
+	if (handle) {
+		store_lock();
+		iconf = handle_find(store, handle, &shard, &hpwd);
+		store_unlock();
+	} else {
+		iconf = conf;
+		for (i = 0; i < konf_query__get_pwdc(query); i++) {
+			if (!(iconf = konf_tree_find_conf(iconf,
+				konf_query__get_pwd(query, i), 0, 0))) {
+				iconf = NULL;
+				break;
+			}
 		}
+		if (konf_query__get_pwdc(query) > 0)
+			shard = shard_key(konf_query__get_pwd(query, 0));
 	}
 
 	if (!iconf) {
 		fprintf(stderr, "Unknown path\n");
+		tree_unlock();
 		konf_query_free(query);
-		return NULL;
+		/* The client retries with the pwd on the stale handle */
+		res->handle = handle;
+		return;
 	}
 
 	switch (konf_query__get_op(query)) {
@@ -394,7 +943,7 @@ static char * process_query(int sock, konf_tree_t * conf, char *str)
 		if (!tmpconf)
 			break;
 		konf_tree__set_splitter(tmpconf, konf_query__get_splitter(query));
-		konf_tree__set_depth(tmpconf, konf_query__get_pwdc(query));
+		konf_tree__set_depth(tmpconf, konf_tree__get_depth(iconf) + 1);
 		ret = KONF_QUERY_OP_OK;
 		break;
 
@@ -410,30 +959,104 @@ static char * process_query(int sock, konf_tree_t * conf, char *str)
 		ret = KONF_QUERY_OP_OK;
 		break;
 
-	case KONF_QUERY_OP_DUMP:
-		if (dump_running_config(sock, iconf, query))
+	case KONF_QUERY_OP_DUMP: {
+		int dres = dump_running_config(sock, iconf, query, res);
+		if (dres < 0)
+			break;
+		/* The answer is sent when background dump is finished */
+		ret = (dres > 0) ? KONF_QUERY_OP_NONE : KONF_QUERY_OP_OK;
+		break;
+	}
+
+	case KONF_QUERY_OP_COPY: {
+		/* Replace the whole datastore by the clone of source one */
+		konfd_store_t *src;
+		konf_tree_t *clone;
+		store_lock();
+		src = store_find(stores, konf_query__get_from(query),
+			BOOL_FALSE);
+		store_unlock();
+		if (!src)
 			break;
+		if (src != store) {
+			if (!(clone = konf_tree_clone(src->conf)))
+				break;
+			konf_tree_delete(store->conf);
+			store->conf = clone;
+			conf = clone;
+		}
 		ret = KONF_QUERY_OP_OK;
 		break;
+	}
 
 	default:
 		break;
 	}
 
+	/* Pass the applied change to replicas */
+	if ((KONF_QUERY_OP_OK == ret) && query_is_write(query))
+		replica_forward(query, hpwd);
+
+	/* Give the handle of pwd node. The root has no handle. */
+	if ((KONF_QUERY_OP_OK == ret) && konf_query__get_get_handle(query) &&
+		(konf_tree__get_depth(iconf) >= 0)) {
+		char *pwd = handle ? NULL : pwd_encode(query);
+		store_lock();
+		handle = handle_get(store, iconf, shard, pwd);
+		store_unlock();
+		lub_string_free(pwd);
+	} else {
+		handle = 0;
+	}
+
 #ifdef DEBUG
-	/* Print whole tree */
-	konf_tree_fprintf(conf, stderr, NULL, -1, -1, BOOL_TRUE, 0);
+	/* Print whole tree. The other sections can be changed now
+	 * if request is not exclusive.
+	 */
+	if (exclusive)
+		konf_tree_fprintf(conf, stderr, NULL, -1, -1, BOOL_TRUE, 0);
 #endif
+	tree_unlock();
 
 	/* Free resources */
 	konf_query_free(query);
+	res->ret = ret;
+	res->handle = handle;
+}
+
+/*--------------------------------------------------------- */
+/* Send the dump data and the answer to the client */
+static void answer_result(int sock, konfd_result_t *res)
+{
+	char *retval = NULL;
+
+	if (res->data) {
+		if (sock >= 0)
+			client_send(sock, res->data, res->len);
+		free(res->data);
+		res->data = NULL;
+	}
+	if (KONF_QUERY_OP_NONE == res->ret)
+		return;
 
-	switch (ret) {
+	switch (res->ret) {
 	case KONF_QUERY_OP_OK:
 		lub_string_cat(&retval, "-o");
+		if (res->handle) {
+			char tmp[32];
+			snprintf(tmp, sizeof(tmp), " -H 0x%" PRIx64,
+				res->handle);
+			lub_string_cat(&retval, tmp);
+		}
 		break;
 	case KONF_QUERY_OP_ERROR:
 		lub_string_cat(&retval, "-e");
+		if (res->handle) {
+			char tmp[32];
+			snprintf(tmp, sizeof(tmp), " -H 0x%" PRIx64,
+				res->handle);
+			lub_string_cat(&retval, tmp);
+		}
 		break;
 	default:
 		lub_string_cat(&retval, "-e");
@@ -444,109 +1067,2263 @@ static char * process_query(int sock, konf_tree_t * conf, char *str)
 	fprintf(stderr, "ANSWER: %s\n", retval);
 #endif
 
-	return retval;
+	answer_send(sock, retval);
+	lub_string_free(retval);
 }
 
 /*--------------------------------------------------------- */
-/*
- * Signal handler for temination signals (like SIGTERM, SIGINT, ...)
- */
-static void sighandler(int signo)
+/* Get the requests from the client's shm ring and process them */
+static void process_shm(int sock, lub_list_t *stores, lub_bintree_t *bufs)
 {
-	sigterm = 1;
+	konf_shm_t *shm = shms[sock];
+	konf_buf_t *buf;
+	uint64_t cnt;
 
-	signo = signo; /* Happy compiler */
+	if (!shm)
+		return;
+	if (!(buf = konf_buftree_find(bufs, sock)))
+		return;
+
+	/* Reset the wakeup eventfd */
+	if (read(konf_shm__get_wait_fd(shm, KONF_SHM_SERVER),
+		&cnt, sizeof(cnt)) < 0) {
+		/* Spurious wakeup */
+	}
+
+	/* The client has freed the space for the queued answers */
+	if (shm_flush(sock, 0) < 0) {
+		client_drop(sock, bufs);
+		return;
+	}
+	client_process(sock, stores, bufs);
+
+	do {
+		char *data;
+		int len;
+		int nbytes = 0;
+
+		/* The requests wait in the ring while the answers wait */
+		data = konf_buf_reserve(buf, &len);
+		while (!shm_out[sock].len && ((nbytes = konf_shm_read(shm,
+			KONF_SHM_SERVER, data, len, 0)) > 0)) {
+			konf_buf_commit(buf, nbytes);
+			client_process(sock, stores, bufs);
+			data = konf_buf_reserve(buf, &len);
+		}
+		/* The ring is broken by the client */
+		if (nbytes < 0) {
+			client_drop(sock, bufs);
+			return;
+		}
+		if (shm_out[sock].len)
+			return;
+	/* Wait for the next wakeup only if ring is really empty */
+	} while (konf_shm_idle(shm, KONF_SHM_SERVER));
 }
 
 /*--------------------------------------------------------- */
-int answer_send(int sock, const char *command)
+/* Process the received requests of the client. The next request is
+ * not started until the worker finishes the previous one to keep
+ * the order of answers. It waits for the queued answers too.
+ */
+static void client_process(int sock, lub_list_t *stores, lub_bintree_t *bufs)
 {
-	if (!command) {
-		errno = EINVAL;
-		return -1;
+	char *str;
+
+	while (!busy[sock] && !shm_out[sock].len &&
+		(str = konf_buftree_parse(bufs, sock))) {
+		process_query(sock, stores, str);
+		free(str);
 	}
-	return send(sock, command, strlen(command) + 1, MSG_NOSIGNAL);
 }
 
 /*--------------------------------------------------------- */
-static int dump_running_config(int sock, konf_tree_t *conf, konf_query_t *query)
+static void client_close(int sock, lub_bintree_t *bufs)
 {
-	FILE *fd;
-	char *filename;
-	int dupsock = -1;
+	shm_close(sock);
+	replica_drop(sock);
+	uring_forget(sock);
+	close(sock);
+	FD_CLR(sock, &active_fd_set);
+	konf_buftree_remove(bufs, sock);
+	busy[sock] = 0;
+	closing[sock] = 0;
+}
 
-	if ((filename = konf_query__get_path(query))) {
-		if (!(fd = fopen(filename, "w")))
-			return -1;
-	} else {
-		if ((dupsock = dup(sock)) < 0)
-			return -1;
-		fd = fdopen(dupsock, "w");
-	}
-	if (!filename) {
-		fprintf(fd, "-t\n");
-#ifdef DEBUG
-		fprintf(stderr, "ANSWER: -t\n");
-#endif
+/*--------------------------------------------------------- */
+/* Disconnect the client. The close is deferred while the worker
+ * still uses the socket. The shm is not used by the workers.
+ */
+static void client_drop(int sock, lub_bintree_t *bufs)
+{
+	shm_close(sock);
+	FD_CLR(sock, &active_fd_set);
+	if (busy[sock]) {
+		closing[sock] = 1;
+		return;
 	}
-	konf_tree_fprintf(conf,
-		fd,
-		konf_query__get_pattern(query),
-		konf_query__get_pwdc(query) - 1,
-		konf_query__get_depth(query),
-		konf_query__get_seq(query),
-		0);
-	if (!filename) {
-		fprintf(fd, "\n");
-#ifdef DEBUG
-		fprintf(stderr, "SEND DATA: \n");
+	client_close(sock, bufs);
+}
+
+/*--------------------------------------------------------- */
+static void tree_lock(bool_t exclusive)
+{
+#ifdef HAVE_PTHREAD_H
+	if (!workers_num)
+		return;
+	if (exclusive)
+		pthread_rwlock_wrlock(&tree_rwlock);
+	else
+		pthread_rwlock_rdlock(&tree_rwlock);
+#else
+	exclusive = exclusive; /* Happy compiler */
 #endif
-	}
+}
 
-	fclose(fd);
+/*--------------------------------------------------------- */
+static void tree_unlock(void)
+{
+#ifdef HAVE_PTHREAD_H
+	if (workers_num)
+		pthread_rwlock_unlock(&tree_rwlock);
+#endif
+}
 
-	return 0;
+/*--------------------------------------------------------- */
+static void store_lock(void)
+{
+#ifdef HAVE_PTHREAD_H
+	if (workers_num)
+		pthread_mutex_lock(&store_mutex);
+#endif
 }
 
 /*--------------------------------------------------------- */
-/* Implement own simple daemon() to don't use Non-POSIX */
-int daemonize(int nochdir, int noclose)
+static void store_unlock(void)
 {
-	int fd;
-	int pid;
+#ifdef HAVE_PTHREAD_H
+	if (workers_num)
+		pthread_mutex_unlock(&store_mutex);
+#endif
+}
 
-	pid = fork();
-	if (-1 == pid)
-		return -1;
-	if (pid > 0)
-		_exit(0); /* Exit parent */
-	if (setsid() == -1)
-		return -1;
-	if (!nochdir) {
-		if (chdir("/"))
-			return -1;
+#ifdef HAVE_PTHREAD_H
+/*--------------------------------------------------------- */
+/* Push the job to the lock-free stack. Main loop is woken up when the
+ * stack becomes not empty. The stack keeps the order of pushes.
+ */
+static void job_push(konfd_job_t **stack, konfd_job_t *job)
+{
+	konfd_job_t *head = __atomic_load_n(stack, __ATOMIC_RELAXED);
+	char c = 0;
+
+	do {
+		job->next = head;
+	} while (!__atomic_compare_exchange_n(stack, &head, job, 1,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	if (head)
+		return;
+	if (write(done_pipe[1], &c, 1) < 0) {
+		/* The pipe is full so main loop will be woken anyway */
 	}
-	if (!noclose) {
-		fd = open("/dev/null", O_RDWR, 0);
-		if (fd < 0)
-			return -1;
-		dup2(fd, STDIN_FILENO);
-		dup2(fd, STDOUT_FILENO);
-		dup2(fd, STDERR_FILENO);
-		if (fd > STDERR_FILENO)
-			close(fd);
+}
+
+/*--------------------------------------------------------- */
+/* Take the whole stack. The jobs are returned in order of pushes. */
+static konfd_job_t *job_take(konfd_job_t **stack)
+{
+	konfd_job_t *job = __atomic_exchange_n(stack, NULL, __ATOMIC_ACQUIRE);
+	konfd_job_t *list = NULL;
+
+	while (job) {
+		konfd_job_t *next = job->next;
+		job->next = list;
+		list = job;
+		job = next;
 	}
 
-	return 0;
+	return list;
 }
 
 /*--------------------------------------------------------- */
-/* Initialize option structure by defaults */
-struct options *opts_init(void)
+static void *worker_loop(void *arg)
 {
-	struct options *opts = NULL;
+	konfd_worker_t *worker = (konfd_worker_t *)arg;
+	konfd_job_t *job;
+
+	while (1) {
+		if (sem_wait(&worker->sem) < 0)
+			continue; /* EINTR */
+		/* The stop is posted after the last job */
+		if (worker->head == __atomic_load_n(&worker->tail,
+			__ATOMIC_ACQUIRE))
+			break;
+		job = __atomic_load_n(&worker->ring[worker->head % FD_SETSIZE],
+			__ATOMIC_RELAXED);
+		worker->head++;
 
-	opts = malloc(sizeof(*opts));
+		execute_query(job->sock, worker->stores, job->query, &job->res);
+		job->query = NULL;
+
+		/* Report to main loop */
+		job_push(&done_head, job);
+	}
+
+	return NULL;
+}
+#endif
+
+/*--------------------------------------------------------- */
+static int workers_start(unsigned int num, lub_list_t *stores)
+{
+#ifdef HAVE_PTHREAD_H
+	unsigned int i;
+	pthread_rwlockattr_t attr;
+
+	if (pipe(done_pipe) < 0)
+		return -1;
+	if (done_pipe[0] >= FD_SETSIZE)
+		return -1;
+	fcntl(done_pipe[0], F_SETFL, fcntl(done_pipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(done_pipe[1], F_SETFL, fcntl(done_pipe[1], F_GETFL) | O_NONBLOCK);
+	FD_SET(done_pipe[0], &active_fd_set);
+
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	/* Don't starve the exclusive requests */
+	pthread_rwlockattr_setkind_np(&attr,
+		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&tree_rwlock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+
+	workers = calloc(num, sizeof(*workers));
+	if (!workers)
+		return -1;
+	for (i = 0; i < num; i++) {
+		konfd_worker_t *worker = &workers[i];
+		worker->head = 0;
+		worker->tail = 0;
+		worker->stores = stores;
+		if (sem_init(&worker->sem, 0, 0) < 0)
+			break;
+		if (pthread_create(&worker->tid, NULL, worker_loop, worker)) {
+			sem_destroy(&worker->sem);
+			break;
+		}
+		workers_num++;
+	}
+	if (workers_num != num)
+		return -1;
+
+	return 0;
+#else
+	num = num; /* Happy compiler */
+	stores = stores;
+	return -1;
+#endif
+}
+
+/*--------------------------------------------------------- */
+/* Finish the pending requests and stop workers. The answers of
+ * finished requests are sent.
+ */
+static void workers_stop(void)
+{
+#ifdef HAVE_PTHREAD_H
+	unsigned int i;
+	konfd_job_t *jobs;
+	konfd_job_t *job;
+
+	if (!workers)
+		return;
+	for (i = 0; i < workers_num; i++)
+		sem_post(&workers[i].sem);
+	for (i = 0; i < workers_num; i++) {
+		pthread_join(workers[i].tid, NULL);
+		sem_destroy(&workers[i].sem);
+	}
+	replica_flush();
+	jobs = job_take(&done_head);
+	while ((job = jobs)) {
+		int sock = job->sock;
+		jobs = job->next;
+		if (closing[sock])
+			free(job->res.data);
+		else
+			answer_result(sock, &job->res);
+		free(job);
+		busy[sock] = saving[sock] ? 2 : 0;
+	}
+	free(workers);
+	workers = NULL;
+	workers_num = 0;
+	pthread_rwlock_destroy(&tree_rwlock);
+	FD_CLR(done_pipe[0], &active_fd_set);
+	uring_forget(done_pipe[0]);
+	close(done_pipe[0]);
+	close(done_pipe[1]);
+	done_pipe[0] = -1;
+	done_pipe[1] = -1;
+#endif
+}
+
+/*--------------------------------------------------------- */
+/* Continue to process the clients the finished requests belong to */
+static void workers_done(lub_list_t *stores, lub_bintree_t *bufs)
+{
+#ifdef HAVE_PTHREAD_H
+	konfd_job_t *jobs;
+	konfd_job_t *job;
+	char c[64];
+
+	while (read(done_pipe[0], c, sizeof(c)) > 0);
+	/* The replicas get the changes before the clients get answers */
+	replica_flush();
+	jobs = job_take(&done_head);
+
+	while ((job = jobs)) {
+		int sock = job->sock;
+		jobs = job->next;
+		if (closing[sock])
+			free(job->res.data);
+		else
+			answer_result(sock, &job->res);
+		free(job);
+		/* Wait for the background dump */
+		if (saving[sock]) {
+			busy[sock] = 2;
+			continue;
+		}
+		busy[sock] = 0;
+		if (closing[sock]) {
+			client_close(sock, bufs);
+			continue;
+		}
+		client_process(sock, stores, bufs);
+	}
+	/* The dump child can finish before the job is reported */
+	bgsave_done(stores, bufs);
+#else
+	stores = stores; /* Happy compiler */
+	bufs = bufs;
+#endif
+}
+
+/*--------------------------------------------------------- */
+/* Reap the finished background dump children and send the answers */
+static void bgsave_done(lub_list_t *stores, lub_bintree_t *bufs)
+{
+	char c[64];
+	int sock;
+
+	while (read(chld_pipe[0], c, sizeof(c)) > 0);
+
+	for (sock = 0; sock < FD_SETSIZE; sock++) {
+		int status;
+		if (busy[sock] != 2)
+			continue;
+		if (waitpid(saving[sock], &status, WNOHANG) <= 0)
+			continue;
+		saving[sock] = 0;
+		busy[sock] = 0;
+		if (closing[sock]) {
+			client_close(sock, bufs);
+			continue;
+		}
+		if (WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+			answer_send(sock, "-o");
+		else
+			answer_send(sock, "-e");
+		client_process(sock, stores, bufs);
+	}
+}
+
+/*--------------------------------------------------------- */
+static int store_compare(const void *first, const void *second)
+{
+	const konfd_store_t *f = (const konfd_store_t *)first;
+	const konfd_store_t *s = (const konfd_store_t *)second;
+
+	return strcmp(f->name, s->name);
+}
+
+/*--------------------------------------------------------- */
+static konfd_store_t *store_find(lub_list_t *stores, const char *name,
+	bool_t create)
+{
+	konfd_store_t key;
+	konfd_store_t *store;
+	lub_list_node_t *node;
+
+	key.name = (char *)name;
+	if ((node = lub_list_search(stores, &key)))
+		return (konfd_store_t *)lub_list_node__get_data(node);
+	if (!create || (lub_list_len(stores) >= KONFD_STORES_MAX))
+		return NULL;
+
+	store = malloc(sizeof(*store));
+	assert(store);
+	store->name = strdup(name);
+	store->conf = konf_tree_new("", 0);
+	lub_list_add(stores, store);
+
+	return store;
+}
+
+/*--------------------------------------------------------- */
+static void store_free_all(lub_list_t *stores)
+{
+	lub_list_node_t *iter;
+
+	while ((iter = lub_list__get_head(stores))) {
+		konfd_store_t *store;
+		store = (konfd_store_t *)lub_list_node__get_data(iter);
+		lub_list_del(stores, iter);
+		lub_list_node_free(iter);
+		konf_tree_delete(store->conf);
+		free(store->name);
+		free(store);
+	}
+	lub_list_free(stores);
+}
+
+/*--------------------------------------------------------- */
+/* The shard key is the hash of top-level section line */
+static unsigned int shard_key(const char *key)
+{
+	unsigned int hash = 5381;
+
+	for (; key && *key; key++)
+		hash = hash * 33 + (unsigned char)*key;
+
+	return hash;
+}
+
+/*--------------------------------------------------------- */
+/* The random start of the handle generations */
+static uint64_t handle_seed(void)
+{
+	uint64_t seed = 0;
+	int fd;
+
+	if ((fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC)) >= 0) {
+		if (read(fd, &seed, sizeof(seed)) != sizeof(seed))
+			seed = 0;
+		close(fd);
+	}
+	if (!seed)
+		seed = ((uint64_t)time(NULL) << 20) ^
+			((uint64_t)getpid() << 4) ^ (uint64_t)clock();
+
+	return seed & KONFD_HANDLE_GEN_MASK;
+}
+
+/*--------------------------------------------------------- */
+/* Get the handle of node. The new slot is allocated if node has no
+ * handle yet.
+ */
+static uint64_t handle_get(konfd_store_t *store, konf_tree_t *node,
+	unsigned int shard, const char *pwd)
+{
+	unsigned int slot;
+
+	if (!(slot = konf_tree__get_handle(node))) {
+		if (handles_free) {
+			slot = handles_free;
+			handles_free = handles[slot - 1].next_free;
+		} else {
+			konfd_handle_t *tmp;
+			if (handles_num >= KONFD_HANDLE_SLOT_MASK)
+				return 0;
+			tmp = realloc(handles, (handles_num + 1) * sizeof(*tmp));
+			if (!tmp)
+				return 0;
+			handles = tmp;
+			slot = ++handles_num;
+		}
+		/* The generation is never reused */
+		if (!(handles_gen = (handles_gen + 1) & KONFD_HANDLE_GEN_MASK))
+			handles_gen = 1;
+		handles[slot - 1].gen = handles_gen;
+		handles[slot - 1].node = node;
+		handles[slot - 1].store = store;
+		handles[slot - 1].shard = shard;
+		handles[slot - 1].pwd = pwd ? strdup(pwd) : NULL;
+		konf_tree__set_handle(node, slot);
+	}
+
+	return (handles[slot - 1].gen << KONFD_HANDLE_SLOT_BITS) | slot;
+}
+
+/*--------------------------------------------------------- */
+/* Find the node by handle. Returns NULL for the stale handle and for
+ * the handle of other store. The store is not checked if it's NULL.
+ */
+static konf_tree_t *handle_find(konfd_store_t *store, uint64_t handle,
+	unsigned int *shard, const char **pwd)
+{
+	unsigned int slot = (unsigned int)(handle & KONFD_HANDLE_SLOT_MASK);
+	konfd_handle_t *h;
+
+	if (!slot || (slot > handles_num))
+		return NULL;
+	h = &handles[slot - 1];
+	if (!h->node || (h->gen != (handle >> KONFD_HANDLE_SLOT_BITS)))
+		return NULL;
+	if (store && (h->store != store))
+		return NULL;
+	if (shard)
+		*shard = h->shard;
+	if (pwd)
+		*pwd = h->pwd;
+
+	return h->node;
+}
+
+/*--------------------------------------------------------- */
+/* The node having handle is deleted. Release its slot. */
+static void handle_release(konf_tree_t *node)
+{
+	unsigned int slot = konf_tree__get_handle(node);
+	konfd_handle_t *h;
+
+	store_lock();
+	h = &handles[slot - 1];
+	h->node = NULL;
+	h->store = NULL;
+	free(h->pwd);
+	h->pwd = NULL;
+	h->gen = 0;
+	h->next_free = handles_free;
+	handles_free = slot;
+	store_unlock();
+	konf_tree__set_handle(node, 0);
+}
+
+/*--------------------------------------------------------- */
+static bool_t query_is_write(konf_query_t *query)
+{
+	switch (konf_query__get_op(query)) {
+	case KONF_QUERY_OP_SET:
+	case KONF_QUERY_OP_UNSET:
+	case KONF_QUERY_OP_COPY:
+		return BOOL_TRUE;
+	default:
+		return BOOL_FALSE;
+	}
+}
+
+/*--------------------------------------------------------- */
+/* Add the quoted and escaped string */
+static void str_cat_quoted(char **str, const char *text)
+{
+	char *tmp = lub_string_encode(text, lub_string_esc_quoted);
+
+	lub_string_cat(str, "\"");
+	lub_string_cat(str, tmp);
+	lub_string_cat(str, "\"");
+	lub_string_free(tmp);
+}
+
+/*--------------------------------------------------------- */
+/* Encode the pwd of query as the part of request string */
+static char *pwd_encode(konf_query_t *query)
+{
+	char *pwd = NULL;
+	int i;
+
+	for (i = 0; i < konf_query__get_pwdc(query); i++) {
+		if (pwd)
+			lub_string_cat(&pwd, " ");
+		str_cat_quoted(&pwd, konf_query__get_pwd(query, i));
+	}
+
+	return pwd;
+}
+
+/*--------------------------------------------------------- */
+/* The replica is registered with the image queued. The changes
+ * can't be applied meanwhile because the tree is locked so they are
+ * queued after the image.
+ */
+static int replica_watch(int sock, lub_list_t *stores)
+{
+	struct timeval tv;
+	lub_list_node_t *iter;
+	konfd_out_t *out = &replica_out[sock];
+	FILE *f;
+	char *data = NULL;
+	size_t len = 0;
+	int retval = -1;
+
+	/* The replica uses socket only */
+	if (shms[sock] || replicas[sock])
+		return -1;
+	/* The stuck replica must not stop the takeover */
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	tree_lock(BOOL_TRUE);
+	/* The image includes the queued changes. Pass them to the
+	 * registered replicas only.
+	 */
+	replica_flush();
+	if (!(f = open_memstream(&data, &len)))
+		goto out;
+	fprintf(f, "-o\n");
+	store_lock();
+	for (iter = lub_list__get_head(stores);
+		iter; iter = lub_list_node__get_next(iter)) {
+		konfd_store_t *store;
+		store = (konfd_store_t *)lub_list_node__get_data(iter);
+		fprintf(f, "I %s\n", store->name);
+		konf_tree_save(store->conf, f);
+	}
+	store_unlock();
+	fclose(f);
+
+	/* The image may be over the limit of changes */
+	free(out->data);
+	out->data = data;
+	out->len = len;
+	out->pos = 0;
+	out->max = len + KONFD_REPLICA_QUEUE_MAX;
+	data = NULL;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&replica_mutex);
+#endif
+	replicas[sock] = 1;
+	replicas_num++;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&replica_mutex);
+#endif
+	replica_out_flush(sock, 0);
+	retval = 0;
+out:
+	tree_unlock();
+	free(data);
+
+	return retval;
+}
+
+/*--------------------------------------------------------- */
+/* Pass the applied change to the replicas. The change is encoded
+ * again because the request could use the handle instead of pwd.
+ */
+static void replica_forward(konf_query_t *query, const char *pwd)
+{
+	char *str = NULL;
+	char *tmp = NULL;
+	char num[32];
+
+	if (!__atomic_load_n(&replicas_num, __ATOMIC_RELAXED))
+		return;
+
+	switch (konf_query__get_op(query)) {
+	case KONF_QUERY_OP_SET:
+		lub_string_cat(&str, "-s -l ");
+		str_cat_quoted(&str, konf_query__get_line(query));
+		if (!konf_query__get_splitter(query))
+			lub_string_cat(&str, " -i");
+		if (!konf_query__get_unique(query))
+			lub_string_cat(&str, " -n");
+		break;
+	case KONF_QUERY_OP_UNSET:
+		lub_string_cat(&str, "-u");
+		break;
+	case KONF_QUERY_OP_COPY:
+		lub_string_cat(&str, "-c -F ");
+		str_cat_quoted(&str, konf_query__get_from(query));
+		break;
+	default:
+		return;
+	}
+	if (konf_query__get_pattern(query)) {
+		lub_string_cat(&str, " -r ");
+		str_cat_quoted(&str, konf_query__get_pattern(query));
+	}
+	if (konf_query__get_priority(query)) {
+		snprintf(num, sizeof(num), " -p 0x%x",
+			konf_query__get_priority(query));
+		lub_string_cat(&str, num);
+	}
+	if (konf_query__get_seq(query)) {
+		snprintf(num, sizeof(num), " -q %u",
+			konf_query__get_seq_num(query));
+		lub_string_cat(&str, num);
+	}
+	if (konf_query__get_store(query)) {
+		lub_string_cat(&str, " -D ");
+		str_cat_quoted(&str, konf_query__get_store(query));
+	}
+	if (!pwd)
+		pwd = tmp = pwd_encode(query);
+	if (pwd) {
+		lub_string_cat(&str, " ");
+		lub_string_cat(&str, pwd);
+	}
+	lub_string_free(tmp);
+
+#ifdef HAVE_PTHREAD_H
+	/* The worker doesn't send. The change is queued under the tree
+	 * lock so the queue has the order of changes.
+	 */
+	if (workers_num) {
+		konfd_job_t *job = malloc(sizeof(*job));
+		assert(job);
+		job->sock = -1;
+		job->query = NULL;
+		job->res.data = str;
+		job_push(&forward_head, job);
+		return;
+	}
+#endif
+	replica_send(str);
+	lub_string_free(str);
+}
+
+/*--------------------------------------------------------- */
+/* Queue the change for the replicas. The replica that doesn't read
+ * the changes is dropped. Main loop only.
+ */
+static void replica_send(const char *str)
+{
+	size_t len = strlen(str) + 1;
+	int i;
+
+	for (i = 0; i < FD_SETSIZE; i++) {
+		konfd_out_t *out = &replica_out[i];
+		if (!replicas[i])
+			continue;
+		if (out->len - out->pos + len > out->max) {
+			syslog(LOG_ERR, "The replica doesn't read the changes\n");
+			replica_drop(i);
+			/* Main loop will close the connection */
+			shutdown(i, SHUT_RDWR);
+			continue;
+		}
+		out_queue(out, str, len);
+		replica_out_flush(i, 0);
+	}
+}
+
+/*--------------------------------------------------------- */
+/* Send the queued data to the replica. Main loop waits for the socket
+ * to be writable if the data is left. The blocking send is used by
+ * takeover.
+ */
+static void replica_out_flush(int sock, int block)
+{
+	konfd_out_t *out = &replica_out[sock];
+
+	if (!out->len)
+		return;
+	while (out->pos < out->len) {
+		ssize_t nbytes;
+#ifdef WITH_IO_URING
+		/* The next chunk is passed when the previous one is sent so
+		 * the stuck replica keeps the data within the queue.
+		 */
+		if (URING_SENDS()) {
+			if (!block && uring_send_busy(sock))
+				return;
+			nbytes = uring_send(sock, out->data + out->pos,
+				out->len - out->pos);
+		} else
+#endif
+		nbytes = send(sock, out->data + out->pos, out->len - out->pos,
+			MSG_NOSIGNAL | (block ? 0 : MSG_DONTWAIT));
+		if (nbytes < 0) {
+			if (EINTR == errno)
+				continue;
+			if (!block && ((EAGAIN == errno) ||
+				(EWOULDBLOCK == errno))) {
+				FD_SET(sock, &replica_wait_set);
+				return;
+			}
+			replica_drop(sock);
+			/* Main loop will close the connection */
+			shutdown(sock, SHUT_RDWR);
+			return;
+		}
+		out->pos += nbytes;
+	}
+	free(out->data);
+	out->data = NULL;
+	out->len = 0;
+	out->pos = 0;
+	out->max = KONFD_REPLICA_QUEUE_MAX;
+	FD_CLR(sock, &replica_wait_set);
+}
+
+/*--------------------------------------------------------- */
+/* Stop passing the changes to the replica */
+static void replica_drop(int sock)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&replica_mutex);
+#endif
+	if (replicas[sock]) {
+		replicas[sock] = 0;
+		replicas_num--;
+	}
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&replica_mutex);
+#endif
+	free(replica_out[sock].data);
+	replica_out[sock].data = NULL;
+	replica_out[sock].len = 0;
+	replica_out[sock].pos = 0;
+	replica_out[sock].max = KONFD_REPLICA_QUEUE_MAX;
+	FD_CLR(sock, &replica_wait_set);
+}
+
+/*--------------------------------------------------------- */
+/* Send the changes queued by workers */
+static void replica_flush(void)
+{
+#ifdef HAVE_PTHREAD_H
+	konfd_job_t *jobs = job_take(&forward_head);
+	konfd_job_t *job;
+
+	while ((job = jobs)) {
+		jobs = job->next;
+		replica_send(job->res.data);
+		lub_string_free(job->res.data);
+		free(job);
+	}
+#endif
+}
+
+/*--------------------------------------------------------- */
+/* Connect to the primary daemon and ask for the changes */
+static int primary_connect(const char *path)
+{
+	char cmd[] = "-w";
+	int fd;
+
+	if (!(primary = konf_client_new(path)))
+		return -1;
+	if (konf_client_connect(primary) < 0)
+		goto err;
+	fd = konf_client__get_sock(primary);
+	if (fd >= FD_SETSIZE)
+		goto err;
+	if (konf_client_send(primary, cmd) < 0)
+		goto err;
+	primary_buf = konf_buf_new(fd);
+	FD_SET(fd, &active_fd_set);
+
+	return 0;
+err:
+	konf_client_free(primary);
+	primary = NULL;
+	return -1;
+}
+
+/*--------------------------------------------------------- */
+/* Apply the image or the change got from primary */
+static void primary_message(lub_list_t *stores, char *str)
+{
+	static char *image_name = NULL;
+	static char *image_data = NULL;
+	static size_t image_len = 0;
+	static FILE *image = NULL;
+	konf_query_t *query;
+	konfd_result_t result;
+
+	/* The image of datastore. It ends with empty line. */
+	if (image) {
+		konf_tree_t *conf;
+		FILE *f;
+
+		if (*str) {
+			fprintf(image, "%s\n", str);
+			return;
+		}
+		fprintf(image, "\n");
+		fclose(image);
+		image = NULL;
+		conf = NULL;
+		if ((f = fmemopen(image_data, image_len, "r"))) {
+			conf = konf_tree_load(f);
+			fclose(f);
+		}
+		free(image_data);
+		image_data = NULL;
+		if (conf) {
+			konfd_store_t *store;
+			tree_lock(BOOL_TRUE);
+			store_lock();
+			store = store_find(stores, image_name, BOOL_TRUE);
+			store_unlock();
+			if (store) {
+				konf_tree_delete(store->conf);
+				store->conf = conf;
+			} else {
+				konf_tree_delete(conf);
+				syslog(LOG_ERR, "Too many datastores\n");
+			}
+			tree_unlock();
+		} else {
+			syslog(LOG_ERR, "Can't load the image of %s\n",
+				image_name);
+		}
+		free(image_name);
+		image_name = NULL;
+		return;
+	}
+	if (!strncmp(str, "I ", 2)) {
+		image_name = strdup(str + 2);
+		image = open_memstream(&image_data, &image_len);
+		return;
+	}
+	/* The answer for watch request */
+	if (!strcmp(str, "-o"))
+		return;
+	if (!strcmp(str, "-e")) {
+		syslog(LOG_ERR, "The primary daemon refused the replica\n");
+		return;
+	}
+
+	/* The change */
+	query = konf_query_new();
+	if (konf_query_parse_str(query, str) < 0) {
+		konf_query_free(query);
+		return;
+	}
+	/* The changes from primary are applied without answer */
+	execute_query(-1, stores, query, &result);
+	free(result.data);
+}
+
+/*--------------------------------------------------------- */
+/* The data from the primary. The replica keeps the last known config
+ * if the primary is lost.
+ */
+static void primary_process(lub_list_t *stores)
+{
+	char *str;
+
+	if (konf_buf_read(primary_buf) <= 0) {
+		syslog(LOG_ERR, "The primary daemon is lost\n");
+		FD_CLR(konf_client__get_sock(primary), &active_fd_set);
+		uring_forget(konf_client__get_sock(primary));
+		konf_buf_delete(primary_buf);
+		primary_buf = NULL;
+		konf_client_free(primary);
+		primary = NULL;
+		return;
+	}
+	while ((str = konf_buf_parse(primary_buf))) {
+		primary_message(stores, str);
+		free(str);
+	}
+}
+
+#ifdef WITH_IO_URING
+/*--------------------------------------------------------- */
+/* The io_uring backend. The client sockets are read by the multishot
+ * receive with the provided buffers. The other descriptors are polled
+ * by the one-shot poll, so they are level triggered like with select().
+ * The answers of requests processed within main loop are queued and
+ * sent by the linked send operations. All the operations are submitted
+ * by the single system call per loop iteration.
+ */
+#define URING_ENTRIES 256
+#define URING_BUF_NUM 64 /* Must be power of 2 */
+#define URING_BUF_SIZE 4096
+#define URING_BGID 0
+
+#define URING_OP_RECV 1
+#define URING_OP_POLL 2
+#define URING_OP_SEND 3
+#define URING_OP_CANCEL 4
+
+/* The user data is the operation, the generation of descriptor and
+ * the descriptor. The send operation has the pointer to queued data.
+ */
+#define URING_DATA(op, gen, fd) (((uint64_t)(op) << 56) | \
+	((uint64_t)((gen) & 0xffffff) << 32) | (uint32_t)(fd))
+#define URING_DATA_OP(data) ((unsigned int)((data) >> 56))
+#define URING_DATA_GEN(data) ((unsigned int)(((data) >> 32) & 0xffffff))
+#define URING_DATA_FD(data) ((int)((data) & 0xffffffff))
+#define URING_DATA_PTR(data) \
+	((void *)(uintptr_t)((data) & ((1ULL << 56) - 1)))
+
+/* The answer waiting for the send */
+typedef struct konfd_send_s konfd_send_t;
+struct konfd_send_s {
+	konfd_send_t *next;
+	int sock;
+	unsigned int gen;
+	size_t len;
+	char data[];
+};
+
+struct konfd_uring_s {
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned int sq_entries;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned int to_submit;
+	struct io_uring_buf_ring *br;
+	size_t br_size;
+	char *bufs;
+	unsigned int ops; /* The operations waiting for the final completion */
+	int stopping; /* Don't process the input */
+};
+
+/* The operation waiting for the descriptor input */
+static int uring_armed[FD_SETSIZE];
+/* The completions of the previous user of descriptor are ignored */
+static unsigned int uring_gen[FD_SETSIZE];
+/* The answers to send. The next chain is not submitted until the
+ * previous one is completed to keep the order.
+ */
+static konfd_send_t *send_head[FD_SETSIZE];
+static konfd_send_t *send_tail[FD_SETSIZE];
+static unsigned int send_inflight[FD_SETSIZE];
+static unsigned int send_gen[FD_SETSIZE];
+
+/*--------------------------------------------------------- */
+static void uring_free(konfd_uring_t *u)
+{
+	if (u->br)
+		munmap(u->br, u->br_size);
+	free(u->bufs);
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_size);
+	if (u->cq_ring && (u->cq_ring != u->sq_ring))
+		munmap(u->cq_ring, u->cq_ring_size);
+	if (u->sq_ring)
+		munmap(u->sq_ring, u->sq_ring_size);
+	if (u->fd >= 0)
+		close(u->fd);
+	free(u);
+}
+
+/*--------------------------------------------------------- */
+/* Give the buffer back to the kernel */
+static void uring_buf_recycle(unsigned short bid)
+{
+	unsigned short tail = uring->br->tail;
+	struct io_uring_buf *buf;
+
+	buf = &uring->br->bufs[tail & (URING_BUF_NUM - 1)];
+	buf->addr = (uintptr_t)(uring->bufs + bid * URING_BUF_SIZE);
+	buf->len = URING_BUF_SIZE;
+	buf->bid = bid;
+	__atomic_store_n(&uring->br->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*--------------------------------------------------------- */
+/* Create the ring. The old kernels and the kernels with io_uring
+ * disabled return error so the select() loop is used.
+ */
+static int uring_init(void)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	konfd_uring_t *u;
+	unsigned short i;
+
+	if (!(u = calloc(1, sizeof(*u))))
+		return -1;
+	memset(&p, 0, sizeof(p));
+	if ((u->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) < 0)
+		goto err;
+	fcntl(u->fd, F_SETFD, fcntl(u->fd, F_GETFD) | FD_CLOEXEC);
+	u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = u->sq_ring_size;
+	}
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (MAP_FAILED == u->sq_ring) {
+		u->sq_ring = NULL;
+		goto err;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ring = u->sq_ring;
+	} else {
+		u->cq_ring = mmap(NULL, u->cq_ring_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			u->fd, IORING_OFF_CQ_RING);
+		if (MAP_FAILED == u->cq_ring) {
+			u->cq_ring = NULL;
+			goto err;
+		}
+	}
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (MAP_FAILED == u->sqes) {
+		u->sqes = NULL;
+		goto err;
+	}
+	u->sq_entries = p.sq_entries;
+	u->sq_head = (unsigned int *)((char *)u->sq_ring + p.sq_off.head);
+	u->sq_tail = (unsigned int *)((char *)u->sq_ring + p.sq_off.tail);
+	u->sq_mask = (unsigned int *)((char *)u->sq_ring + p.sq_off.ring_mask);
+	u->sq_array = (unsigned int *)((char *)u->sq_ring + p.sq_off.array);
+	u->cq_head = (unsigned int *)((char *)u->cq_ring + p.cq_off.head);
+	u->cq_tail = (unsigned int *)((char *)u->cq_ring + p.cq_off.tail);
+	u->cq_mask = (unsigned int *)((char *)u->cq_ring + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)u->cq_ring + p.cq_off.cqes);
+
+	/* The ring of provided buffers for the multishot receive */
+	u->br_size = URING_BUF_NUM * sizeof(struct io_uring_buf);
+	u->br = mmap(NULL, u->br_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == u->br) {
+		u->br = NULL;
+		goto err;
+	}
+	if (!(u->bufs = malloc(URING_BUF_NUM * URING_BUF_SIZE)))
+		goto err;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)u->br;
+	reg.ring_entries = URING_BUF_NUM;
+	reg.bgid = URING_BGID;
+	if (syscall(__NR_io_uring_register, u->fd,
+		IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		goto err;
+
+	uring = u;
+	for (i = 0; i < URING_BUF_NUM; i++)
+		uring_buf_recycle(i);
+
+	return 0;
+err:
+	uring_free(u);
+	return -1;
+}
+
+/*--------------------------------------------------------- */
+/* Submit the queued operations and wait for the completions */
+static int uring_enter(unsigned int min_complete)
+{
+	int res;
+
+	res = syscall(__NR_io_uring_enter, uring->fd, uring->to_submit,
+		min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0,
+		NULL, 0);
+	if (res > 0)
+		uring->to_submit -= res;
+
+	return res;
+}
+
+/*--------------------------------------------------------- */
+/* Get the number of free submission entries */
+static unsigned int uring_space(void)
+{
+	return uring->sq_entries - (*uring->sq_tail -
+		__atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE));
+}
+
+/*--------------------------------------------------------- */
+/* Get the free submission entry. The full ring is submitted. */
+static struct io_uring_sqe *uring_sqe(uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail = *uring->sq_tail;
+	unsigned int idx;
+
+	if (!uring_space() && (uring_enter(0) < 0))
+		return NULL;
+	if (!uring_space())
+		return NULL;
+	idx = tail & *uring->sq_mask;
+	sqe = &uring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = user_data;
+	uring->sq_array[idx] = idx;
+	__atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	uring->to_submit++;
+
+	return sqe;
+}
+
+/*--------------------------------------------------------- */
+/* Wait for the input of descriptor. The client socket is read into
+ * the provided buffers. The other descriptors are polled.
+ */
+static void uring_arm(int fd, lub_bintree_t *bufs)
+{
+	struct io_uring_sqe *sqe;
+	int op = konf_buftree_find(bufs, fd) ? URING_OP_RECV : URING_OP_POLL;
+
+	if (!(sqe = uring_sqe(URING_DATA(op, uring_gen[fd], fd))))
+		return;
+	sqe->fd = fd;
+	if (URING_OP_RECV == op) {
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BGID;
+	} else {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLIN;
+	}
+	uring_armed[fd] = op;
+	uring->ops++;
+}
+
+/*--------------------------------------------------------- */
+/* Cancel the operation waiting for the descriptor input */
+static void uring_cancel(int fd)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!uring_armed[fd])
+		return;
+	if ((sqe = uring_sqe(URING_DATA(URING_OP_CANCEL, 0, 0)))) {
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->addr = URING_DATA(uring_armed[fd], uring_gen[fd], fd);
+	}
+	uring_armed[fd] = 0;
+}
+
+/*--------------------------------------------------------- */
+/* Drop the answers not sent yet */
+static void uring_send_drop(int sock)
+{
+	konfd_send_t *s;
+
+	while ((s = send_head[sock])) {
+		send_head[sock] = s->next;
+		free(s);
+	}
+	send_tail[sock] = NULL;
+}
+
+/*--------------------------------------------------------- */
+/* Submit the queued answers as the chain of linked sends. The next
+ * send starts when the previous one is fully completed.
+ */
+static void uring_send_flush(int sock)
+{
+	konfd_send_t *s;
+	unsigned int space;
+
+	if (!send_head[sock] || send_inflight[sock])
+		return;
+	if (!(space = uring_space())) {
+		uring_enter(0);
+		if (!(space = uring_space()))
+			return;
+	}
+	while ((s = send_head[sock]) && space--) {
+		struct io_uring_sqe *sqe;
+		sqe = uring_sqe(URING_DATA(URING_OP_SEND, 0, 0) |
+			(uintptr_t)s);
+		send_head[sock] = s->next;
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = sock;
+		sqe->addr = (uintptr_t)s->data;
+		sqe->len = s->len;
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		if (send_head[sock] && space)
+			sqe->flags = IOSQE_IO_LINK;
+		send_inflight[sock]++;
+		uring->ops++;
+	}
+	if (!send_head[sock])
+		send_tail[sock] = NULL;
+}
+
+/*--------------------------------------------------------- */
+/* Queue the answer. It's sent within next loop iteration. */
+static int uring_send(int sock, const char *data, size_t len)
+{
+	konfd_send_t *s;
+
+	if (!(s = malloc(sizeof(*s) + len)))
+		return -1;
+	s->next = NULL;
+	s->sock = sock;
+	s->gen = send_gen[sock];
+	s->len = len;
+	memcpy(s->data, data, len);
+	if (send_tail[sock])
+		send_tail[sock]->next = s;
+	else
+		send_head[sock] = s;
+	send_tail[sock] = s;
+
+	return (int)len;
+}
+
+/*--------------------------------------------------------- */
+/* The previous answers are not sent yet */
+static int uring_send_busy(int sock)
+{
+	return (send_head[sock] || send_inflight[sock]) ? 1 : 0;
+}
+
+/*--------------------------------------------------------- */
+/* The descriptor is going to be closed */
+static void uring_forget(int fd)
+{
+	if (!uring)
+		return;
+	uring_cancel(fd);
+	uring_gen[fd]++;
+	uring_send_drop(fd);
+	send_inflight[fd] = 0;
+	send_gen[fd]++;
+}
+
+/*--------------------------------------------------------- */
+/* Handle the completion. Returns 1 if the daemon must stop. */
+static int uring_complete(const struct io_uring_cqe *cqe, int sock,
+	unsigned int workers, lub_list_t *stores, lub_bintree_t *bufs)
+{
+	uint64_t data = cqe->user_data;
+	int fd = URING_DATA_FD(data);
+	int stale = 0;
+
+	/* The completion for the previous user of descriptor */
+	if ((URING_OP_RECV == URING_DATA_OP(data)) ||
+		(URING_OP_POLL == URING_DATA_OP(data)))
+		stale = (URING_DATA_GEN(data) != (uring_gen[fd] & 0xffffff));
+
+	switch (URING_DATA_OP(data)) {
+
+	case URING_OP_RECV: {
+		konf_buf_t *buf;
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			uring->ops--;
+			if (!stale)
+				uring_armed[fd] = 0;
+		}
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			if (!stale && (cqe->res > 0) &&
+				(buf = konf_buftree_find(bufs, fd)))
+				konf_buf_add(buf, uring->bufs +
+					bid * URING_BUF_SIZE, cqe->res);
+			uring_buf_recycle(bid);
+		}
+		/* The receive is armed again if buffers were exhausted */
+		if (stale || uring->stopping || (-ENOBUFS == cqe->res) ||
+			(-ECANCELED == cqe->res))
+			return 0;
+		client_input(fd, cqe->res, stores, bufs);
+		return 0;
+	}
+
+	case URING_OP_POLL:
+		uring->ops--;
+		if (stale)
+			return 0;
+		uring_armed[fd] = 0;
+		if ((cqe->res < 0) || uring->stopping)
+			return 0;
+		return fd_service(fd, sock, workers, stores, bufs);
+
+	case URING_OP_SEND: {
+		konfd_send_t *s = (konfd_send_t *)URING_DATA_PTR(data);
+		uring->ops--;
+		if (s->gen == send_gen[s->sock]) {
+			send_inflight[s->sock]--;
+			/* The client doesn't get the answers any more */
+			if ((cqe->res < 0) || ((size_t)cqe->res != s->len)) {
+				uring_send_drop(s->sock);
+				shutdown(s->sock, SHUT_RDWR);
+			}
+		}
+		free(s);
+		return 0;
+	}
+
+	default:
+		return 0;
+	}
+}
+
+/*--------------------------------------------------------- */
+/* Handle all the available completions */
+static int uring_reap(int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs)
+{
+	unsigned int head;
+
+	/* The head is read again each time because the completion handler
+	 * can reap the completions itself (takeover).
+	 */
+	while ((head = *uring->cq_head) !=
+		__atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe cqe = uring->cqes[head & *uring->cq_mask];
+		__atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+		if (uring_complete(&cqe, sock, workers, stores, bufs))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* The main loop iteration. Returns 1 if the daemon must stop. */
+static int uring_process(int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs)
+{
+	int i;
+
+	/* Follow the set of active descriptors and send the answers */
+	for (i = 0; i < FD_SETSIZE; i++) {
+		if (FD_ISSET(i, &active_fd_set)) {
+			if (!uring_armed[i])
+				uring_arm(i, bufs);
+		} else if (uring_armed[i]) {
+			uring_cancel(i);
+			uring_gen[i]++;
+		}
+		replica_out_flush(i, 0);
+		uring_send_flush(i);
+	}
+
+	if ((uring_enter(1) < 0) && (errno != EINTR) &&
+		(errno != EAGAIN) && (errno != EBUSY)) {
+		syslog(LOG_ERR, "Can't submit io_uring operations: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	return uring_reap(sock, workers, stores, bufs);
+}
+
+/*--------------------------------------------------------- */
+/* Complete all the operations. The answers are sent and the received
+ * data is left within client buffers. It's used before the client
+ * sockets are passed to the other daemon.
+ */
+static void uring_stop(int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs)
+{
+	int i;
+
+	if (!uring)
+		return;
+	uring->stopping = 1;
+	for (i = 0; i < FD_SETSIZE; i++)
+		uring_cancel(i);
+	while (uring->ops) {
+		for (i = 0; i < FD_SETSIZE; i++)
+			uring_send_flush(i);
+		if ((uring_enter(1) < 0) && (errno != EINTR))
+			break;
+		uring_reap(sock, workers, stores, bufs);
+	}
+	uring->stopping = 0;
+}
+
+/*--------------------------------------------------------- */
+static void uring_fini(void)
+{
+	int i;
+
+	if (!uring)
+		return;
+	for (i = 0; i < FD_SETSIZE; i++)
+		uring_send_drop(i);
+	uring_free(uring);
+	uring = NULL;
+}
+#endif
+
+/*--------------------------------------------------------- */
+/* Create shm transport for the client and send it's descriptors */
+static int shm_offer(int sock)
+{
+	konf_shm_t *shm;
+	int efd;
+
+	if ((sock >= FD_SETSIZE) || shms[sock])
+		return -1;
+	if (!(shm = konf_shm_new(sock, KONF_SHM_RING_SIZE)))
+		return -1;
+	efd = konf_shm__get_wait_fd(shm, KONF_SHM_SERVER);
+	if (efd >= FD_SETSIZE) {
+		konf_shm_free(shm);
+		return -1;
+	}
+	/* The client can write request right after answer */
+	konf_shm_idle(shm, KONF_SHM_SERVER);
+	if (konf_shm_send(shm, "-o") < 0) {
+		konf_shm_free(shm);
+		return -1;
+	}
+	shms[sock] = shm;
+	shm_owner[efd] = sock;
+	FD_SET(efd, &active_fd_set);
+#ifdef DEBUG
+	fprintf(stderr, "SHM transport for %u\n", sock);
+#endif
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+static void shm_close(int sock)
+{
+	int efd;
+
+	if (!shms[sock])
+		return;
+	efd = konf_shm__get_wait_fd(shms[sock], KONF_SHM_SERVER);
+	FD_CLR(efd, &active_fd_set);
+	uring_forget(efd);
+	shm_owner[efd] = -1;
+	konf_shm_free(shms[sock]);
+	shms[sock] = NULL;
+	free(shm_out[sock].data);
+	memset(&shm_out[sock], 0, sizeof(shm_out[sock]));
+}
+
+/*--------------------------------------------------------- */
+/* Queue the data the client's ring or replica socket has no space for */
+static void out_queue(konfd_out_t *out, const char *data, size_t len)
+{
+	char *tmp;
+
+	if (out->pos) {
+		memmove(out->data, out->data + out->pos, out->len - out->pos);
+		out->len -= out->pos;
+		out->pos = 0;
+	}
+	tmp = realloc(out->data, out->len + len);
+	assert(tmp);
+	out->data = tmp;
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+}
+
+/*--------------------------------------------------------- */
+/* Write the queued answers to the client's ring. Returns -1 if the
+ * ring is broken.
+ */
+static int shm_flush(int sock, int block)
+{
+	konfd_out_t *out = &shm_out[sock];
+	ssize_t nbytes;
+
+	if (!shms[sock] || !out->len)
+		return 0;
+	nbytes = konf_shm_write(shms[sock], KONF_SHM_SERVER,
+		out->data + out->pos, out->len - out->pos, block);
+	if (nbytes < 0)
+		return -1;
+	out->pos += nbytes;
+	if (out->pos < out->len)
+		return 0;
+	free(out->data);
+	memset(out, 0, sizeof(*out));
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* Send the control message with attached descriptors */
+static int ctl_send(int ctl, const char *data, const int *fds, int nfds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(int) * KONFD_CTL_FDS)];
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	iov.iov_base = (void *)data;
+	iov.iov_len = strlen(data) + 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (nfds > 0) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+	}
+
+	return sendmsg(ctl, &msg, MSG_NOSIGNAL);
+}
+
+/*--------------------------------------------------------- */
+/* Receive the control message. Returns the number of received
+ * descriptors or -1 on error.
+ */
+static int ctl_recv(int ctl, char *buf, size_t size, int *fds, int maxfds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(int) * KONFD_CTL_FDS)];
+	ssize_t nbytes;
+	int nfds = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = size - 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	do {
+		nbytes = recvmsg(ctl, &msg, MSG_CMSG_CLOEXEC);
+	} while ((nbytes < 0) && (EINTR == errno));
+	if (nbytes <= 0)
+		return -1;
+	buf[nbytes] = '\0';
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level != SOL_SOCKET) ||
+			(cmsg->cmsg_type != SCM_RIGHTS))
+			continue;
+		nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+		break;
+	}
+	if (nfds > maxfds) {
+		while (nfds-- > 0)
+			close(fds[nfds]);
+		return -1;
+	}
+
+	return nfds;
+}
+
+/*--------------------------------------------------------- */
+/* Listen on control socket. Only the owner can connect to it.
+ * The path is owned by ctl_path on success.
+ */
+static int ctl_bind(char *path)
+{
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= USOCK_PATH_MAX)
+		goto err;
+	if ((ctl_sock = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0)
+		goto err;
+	if (ctl_sock >= FD_SETSIZE)
+		goto err;
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (bind(ctl_sock, (struct sockaddr *)&addr, sizeof(addr)))
+		goto err;
+	ctl_path = path;
+	if (chmod(path, S_IRUSR | S_IWUSR) || listen(ctl_sock, 1))
+		goto err;
+
+	return 0;
+err:
+	if (ctl_sock >= 0)
+		close(ctl_sock);
+	ctl_sock = -1;
+	if (ctl_path)
+		unlink(ctl_path);
+	ctl_path = NULL;
+	lub_string_free(path);
+	return -1;
+}
+
+/*--------------------------------------------------------- */
+static int ctl_listen(const char *socket_path, uid_t uid, gid_t gid)
+{
+	char *path = NULL;
+
+	lub_string_cat(&path, socket_path);
+	lub_string_cat(&path, KONFD_CTL_SUFFIX);
+	if (ctl_bind(path) < 0)
+		return -1;
+	if (chown(ctl_path, uid, gid)) {
+		close(ctl_sock);
+		ctl_sock = -1;
+		unlink(ctl_path);
+		lub_string_free(ctl_path);
+		ctl_path = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* Connect to the running daemon and get its listen socket, the
+ * image of datastores and the last handle generation.
+ */
+static int takeover_connect(const char *socket_path, int *ctl,
+	int *memfd, unsigned int *nclients, uint64_t *gen)
+{
+	struct sockaddr_un addr;
+	char *path = NULL;
+	char str[64];
+	int fds[KONFD_CTL_FDS];
+	int res;
+	char *end;
+
+	lub_string_cat(&path, socket_path);
+	lub_string_cat(&path, KONFD_CTL_SUFFIX);
+	if (strlen(path) >= USOCK_PATH_MAX) {
+		lub_string_free(path);
+		return -1;
+	}
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	lub_string_free(path);
+	if ((*ctl = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0)
+		return -1;
+	if (connect(*ctl, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto err;
+	if ((res = ctl_recv(*ctl, str, sizeof(str), fds, 2)) < 0)
+		goto err;
+	if (res != 2) {
+		while (res-- > 0)
+			close(fds[res]);
+		goto err;
+	}
+	*nclients = strtoul(str, &end, 10);
+	*gen = strtoull(end, NULL, 16) & KONFD_HANDLE_GEN_MASK;
+	*memfd = fds[1];
+
+	return fds[0];
+err:
+	close(*ctl);
+	*ctl = -1;
+	return -1;
+}
+
+/*--------------------------------------------------------- */
+/* Load the datastores and get the clients of the old daemon. The old
+ * daemon exits when the load is confirmed.
+ */
+static int takeover_load(int ctl, int memfd, unsigned int nclients,
+	lub_list_t *stores, lub_bintree_t *bufs)
+{
+	FILE *f;
+	char *str = NULL;
+	size_t size = 0;
+	ssize_t len;
+	unsigned int n;
+	int i;
+	int retval = -1;
+
+	lseek(memfd, 0, SEEK_SET);
+	if (!(f = fdopen(memfd, "r"))) {
+		close(memfd);
+		close(ctl);
+		return -1;
+	}
+
+	/* Datastores. Each one is the name and the saved tree. */
+	while ((len = getline(&str, &size, f)) > 0) {
+		konfd_store_t *store;
+		konf_tree_t *conf;
+		if ('\n' == str[len - 1])
+			str[--len] = '\0';
+		if (0 == len)
+			break;
+		if (!(conf = konf_tree_load(f)))
+			goto out;
+		if (!(store = store_find(stores, str, BOOL_TRUE))) {
+			konf_tree_delete(conf);
+			goto out;
+		}
+		konf_tree_delete(store->conf);
+		store->conf = conf;
+	}
+
+	/* Clients. The not processed data and the socket. */
+	for (n = 0; n < nclients; n++) {
+		char msg[64];
+		int fd;
+		konf_buf_t *buf;
+		char *data;
+		int avail;
+		unsigned long datalen;
+
+		if (getline(&str, &size, f) <= 0)
+			goto out;
+		datalen = strtoul(str, NULL, 10);
+		if (ctl_recv(ctl, msg, sizeof(msg), &fd, 1) != 1)
+			goto out;
+		if (fd >= FD_SETSIZE) {
+			close(fd);
+			goto out;
+		}
+		konf_buftree_remove(bufs, fd);
+		buf = konf_buf_new(fd);
+		lub_bintree_insert(bufs, buf);
+		FD_SET(fd, &active_fd_set);
+		while (datalen > 0) {
+			size_t chunk;
+			data = konf_buf_reserve(buf, &avail);
+			chunk = ((size_t)avail < datalen) ? (size_t)avail : datalen;
+			if (fread(data, 1, chunk, f) != chunk)
+				goto out;
+			konf_buf_commit(buf, chunk);
+			datalen -= chunk;
+		}
+		/* The replica stays the replica */
+		if (strchr(msg, ' ') && atoi(strchr(msg, ' '))) {
+			replicas[fd] = 1;
+			replicas_num++;
+		}
+		/* The shm region follows the socket */
+		if (atoi(msg)) {
+			konf_shm_t *shm;
+			char *answer = NULL;
+			int efd;
+			shm = konf_shm_recv(ctl, &answer);
+			free(answer);
+			if (!shm)
+				goto out;
+			konf_shm__set_sock(shm, fd);
+			efd = konf_shm__get_wait_fd(shm, KONF_SHM_SERVER);
+			if (efd >= FD_SETSIZE) {
+				konf_shm_free(shm);
+				goto out;
+			}
+			shms[fd] = shm;
+			shm_owner[efd] = fd;
+			FD_SET(efd, &active_fd_set);
+		}
+	}
+
+	/* Confirm the takeover */
+	if (answer_send(ctl, "-o") < 0)
+		goto out;
+	retval = 0;
+
+	/* Process the requests received by the old daemon */
+	for (i = 0; i < FD_SETSIZE; i++) {
+		if (!konf_buftree_find(bufs, i))
+			continue;
+		client_process(i, stores, bufs);
+		if (shms[i])
+			process_shm(i, stores, bufs);
+	}
+out:
+	free(str);
+	fclose(f);
+	close(ctl);
+
+	return retval;
+}
+
+/*--------------------------------------------------------- */
+/* Give the daemon to the new one. Returns 0 if the new daemon has
+ * taken over. Else the daemon continues to work.
+ */
+static int takeover_give(int sock, unsigned int workers,
+	lub_list_t *stores, lub_bintree_t *bufs)
+{
+	int peer;
+	int i;
+	FILE *f = NULL;
+	int memfd = -1;
+	unsigned int nclients = 0;
+	lub_list_node_t *iter;
+	char str[64];
+	int fds[KONFD_CTL_FDS];
+	int retval = -1;
+
+	if ((peer = accept(ctl_sock, NULL, NULL)) < 0)
+		return -1;
+	/* The new daemon will listen on the control path */
+	unlink(ctl_path);
+
+	/* Finish the requests in progress. The rest of requests will be
+	 * processed by the new daemon.
+	 */
+	workers_stop();
+	for (i = 0; i < FD_SETSIZE; i++) {
+		if (2 == busy[i]) {
+			int status = -1;
+			while ((waitpid(saving[i], &status, 0) < 0) &&
+				(EINTR == errno));
+			saving[i] = 0;
+			if (!closing[i])
+				answer_send(i, (WIFEXITED(status) &&
+					(WEXITSTATUS(status) == 0)) ? "-o" : "-e");
+		}
+		busy[i] = 0;
+		if (closing[i])
+			client_close(i, bufs);
+	}
+	/* Send the answers and stop the reading of client sockets */
+	for (i = 0; i < FD_SETSIZE; i++)
+		replica_out_flush(i, 1);
+	uring_stop(sock, workers, stores, bufs);
+	for (i = 0; i < FD_SETSIZE; i++)
+		shm_flush(i, 1);
+
+	/* The image of datastores and the not processed data of clients */
+#ifdef HAVE_MEMFD_CREATE
+	if ((memfd = memfd_create("konfd", MFD_CLOEXEC)) < 0)
+		goto out;
+	if (!(f = fdopen(dup(memfd), "w")))
+		goto out;
+#else
+	if (!(f = tmpfile()))
+		goto out;
+	if ((memfd = dup(fileno(f))) < 0)
+		goto out;
+#endif
+	for (iter = lub_list__get_head(stores);
+		iter; iter = lub_list_node__get_next(iter)) {
+		konfd_store_t *store;
+		store = (konfd_store_t *)lub_list_node__get_data(iter);
+		fprintf(f, "%s\n", store->name);
+		if (konf_tree_save(store->conf, f) < 0)
+			goto out;
+	}
+	fprintf(f, "\n");
+	for (i = 0; i < FD_SETSIZE; i++) {
+		konf_buf_t *buf = konf_buftree_find(bufs, i);
+		if (!buf)
+			continue;
+		fprintf(f, "%d\n", konf_buf__get_len(buf));
+		fwrite(konf_buf__get_buf(buf), 1, konf_buf__get_len(buf), f);
+		nclients++;
+	}
+	if (fflush(f) != 0)
+		goto out;
+
+	/* Send listen socket, image and then clients. The new daemon
+	 * gives the handle generations after the ones given here.
+	 */
+	snprintf(str, sizeof(str), "%u %" PRIx64, nclients, handles_gen);
+	fds[0] = sock;
+	fds[1] = memfd;
+	if (ctl_send(peer, str, fds, 2) < 0)
+		goto out;
+	for (i = 0; i < FD_SETSIZE; i++) {
+		if (!konf_buftree_find(bufs, i))
+			continue;
+		snprintf(str, sizeof(str), "%d %d",
+			shms[i] ? 1 : 0, replicas[i]);
+		if (ctl_send(peer, str, &i, 1) < 0)
+			goto out;
+		if (shms[i]) {
+			int res;
+			konf_shm__set_sock(shms[i], peer);
+			res = konf_shm_send(shms[i], "-o");
+			konf_shm__set_sock(shms[i], i);
+			if (res < 0)
+				goto out;
+		}
+	}
+
+	/* Wait for confirmation */
+	if ((ctl_recv(peer, str, sizeof(str), fds, 0) != 0) ||
+		strcmp(str, "-o"))
+		goto out;
+	retval = 0;
+	keep_path = 1;
+	/* The new daemon listens on control path now */
+	lub_string_free(ctl_path);
+	ctl_path = NULL;
+out:
+	if (f)
+		fclose(f);
+	if (memfd >= 0)
+		close(memfd);
+	close(peer);
+	if (retval < 0) {
+		char *path = ctl_path;
+		syslog(LOG_ERR, "The takeover is failed.\n");
+		/* Listen on control path again */
+		FD_CLR(ctl_sock, &active_fd_set);
+		uring_forget(ctl_sock);
+		close(ctl_sock);
+		ctl_path = NULL;
+		unlink(path);
+		if (ctl_bind(path) == 0)
+			FD_SET(ctl_sock, &active_fd_set);
+		if (workers && (workers_start(workers, stores) < 0))
+			syslog(LOG_ERR, "Can't start worker threads\n");
+	}
+
+	return retval;
+}
+
+/*--------------------------------------------------------- */
+/*
+ * Signal handler for temination signals (like SIGTERM, SIGINT, ...)
+ */
+static void sighandler(int signo)
+{
+	sigterm = 1;
+
+	signo = signo; /* Happy compiler */
+}
+
+/*--------------------------------------------------------- */
+static void sigchld_handler(int signo)
+{
+	char c = 0;
+	int saved_errno = errno;
+
+	if (write(chld_pipe[1], &c, 1) < 0) {
+		/* The pipe is full so main loop will be woken anyway */
+	}
+	errno = saved_errno;
+
+	signo = signo; /* Happy compiler */
+}
+
+/*--------------------------------------------------------- */
+int answer_send(int sock, const char *command)
+{
+	/* The changes from primary are applied without answer */
+	if (sock < 0)
+		return 0;
+	if (!command) {
+		errno = EINVAL;
+		return -1;
+	}
+	return client_send(sock, command, strlen(command) + 1);
+}
+
+/*--------------------------------------------------------- */
+/* Send data to client using the current transport */
+static int client_send(int sock, const char *data, size_t len)
+{
+	if (shms[sock]) {
+		ssize_t nbytes = 0;
+		/* Keep the order of answers */
+		if (!shm_out[sock].len)
+			nbytes = konf_shm_write(shms[sock], KONF_SHM_SERVER,
+				data, len, 0);
+		if (nbytes < 0) {
+			/* Main loop will close the connection */
+			shutdown(sock, SHUT_RDWR);
+			return -1;
+		}
+		if ((size_t)nbytes < len)
+			out_queue(&shm_out[sock], data + nbytes,
+				len - nbytes);
+		return len;
+	}
+#ifdef WITH_IO_URING
+	if (URING_SENDS())
+		return uring_send(sock, data, len);
+#endif
+
+	return send(sock, data, len, MSG_NOSIGNAL);
+}
+
+/*--------------------------------------------------------- */
+/* Print the tree as text or as JSON Lines */
+static void dump_tree(konf_tree_t *conf, FILE *f, konf_query_t *query)
+{
+	if (konf_query__get_json(query)) {
+		konf_tree_fprintf_json(conf,
+			f,
+			konf_query__get_pattern(query),
+			konf_tree__get_depth(conf),
+			konf_query__get_depth(query));
+		return;
+	}
+	konf_tree_fprintf(conf,
+		f,
+		konf_query__get_pattern(query),
+		konf_tree__get_depth(conf),
+		konf_query__get_depth(query),
+		konf_query__get_seq(query),
+		0);
+}
+
+/*--------------------------------------------------------- */
+static int dump_running_config(int sock, konf_tree_t *conf, konf_query_t *query,
+	konfd_result_t *res)
+{
+	FILE *fd;
+	int dupsock = -1;
+
+	/* The file is written in background */
+	if (konf_query__get_path(query))
+		return dump_bgsave(sock, conf, query);
+
+	if (workers_num || shms[sock] || URING_SENDS()) {
+		/* The data is sent by main loop. The shm transport and
+		 * io_uring need the data in memory too.
+		 */
+		if (!(fd = open_memstream(&res->data, &res->len)))
+			return -1;
+	} else {
+		if ((dupsock = dup(sock)) < 0)
+			return -1;
+		fd = fdopen(dupsock, "w");
+	}
+	fprintf(fd, "-t\n");
+#ifdef DEBUG
+	fprintf(stderr, "ANSWER: -t\n");
+#endif
+	dump_tree(conf, fd, query);
+	fprintf(fd, "\n");
+#ifdef DEBUG
+	fprintf(stderr, "SEND DATA: \n");
+#endif
+
+	fclose(fd);
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* Write the file dump within the forked child. The single threaded
+ * daemon forks first and the child prints the tree itself. The fork
+ * can be done by the worker thread so the child makes the
+ * async-signal-safe calls only then. The dump is prepared by the
+ * parent in this case. The temporary file is created by the parent
+ * anyway. The daemon continues to serve the requests while the child writes
+ * the file. The temporary file is renamed to the target file at the
+ * end. So the target file is never partial. Returns 1 if child is
+ * started. The answer is sent by main loop when the child exits.
+ */
+static int dump_bgsave(int sock, konf_tree_t *conf, konf_query_t *query)
+{
+	const char *filename = konf_query__get_path(query);
+	char *tmpname = NULL;
+	char *data = NULL;
+	size_t len = 0;
+	size_t pos = 0;
+	pid_t pid;
+	int fd = -1;
+	FILE *f;
+	int retval = -1;
+
+	if (workers_num) {
+		if (!(f = open_memstream(&data, &len)))
+			return -1;
+		dump_tree(conf, f, query);
+		if (fclose(f) != 0)
+			goto out;
+	}
+
+	lub_string_cat(&tmpname, filename);
+	lub_string_cat(&tmpname, ".XXXXXX");
+	if ((fd = mkstemp(tmpname)) < 0)
+		goto out;
+	fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+	/* The mkstemp() creates file with 0600 mode */
+	if (fchmod(fd, 0666 & ~file_mask) < 0)
+		goto err;
+
+	pid = fork();
+	if (pid < 0)
+		goto err;
+	if (pid > 0) {
+		saving[sock] = pid;
+		retval = 1;
+		goto out;
+	}
+
+	/* Child */
+	if (!workers_num) {
+		if (!(f = fdopen(fd, "w"))) {
+			unlink(tmpname);
+			_exit(1);
+		}
+		dump_tree(conf, f, query);
+		if ((fflush(f) != 0) || ferror(f) || (fsync(fd) < 0) ||
+			(fclose(f) != 0) || (rename(tmpname, filename) < 0)) {
+			unlink(tmpname);
+			_exit(1);
+		}
+		_exit(0);
+	}
+	while (pos < len) {
+		ssize_t nbytes = write(fd, data + pos, len - pos);
+		if (nbytes < 0) {
+			if (EINTR == errno)
+				continue;
+			unlink(tmpname);
+			_exit(1);
+		}
+		pos += nbytes;
+	}
+	if ((fsync(fd) < 0) || (close(fd) < 0) ||
+		(rename(tmpname, filename) < 0)) {
+		unlink(tmpname);
+		_exit(1);
+	}
+	_exit(0);
+
+err:
+	unlink(tmpname);
+out:
+	if (fd >= 0)
+		close(fd);
+	lub_string_free(tmpname);
+	free(data);
+
+	return retval;
+}
+
+/*--------------------------------------------------------- */
+/* Implement own simple daemon() to don't use Non-POSIX */
+int daemonize(int nochdir, int noclose)
+{
+	int fd;
+	int pid;
+
+	pid = fork();
+	if (-1 == pid)
+		return -1;
+	if (pid > 0)
+		_exit(0); /* Exit parent */
+	if (setsid() == -1)
+		return -1;
+	if (!nochdir) {
+		if (chdir("/"))
+			return -1;
+	}
+	if (!noclose) {
+		fd = open("/dev/null", O_RDWR, 0);
+		if (fd < 0)
+			return -1;
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* Initialize option structure by defaults */
+struct options *opts_init(void)
+{
+	struct options *opts = NULL;
+
+	opts = malloc(sizeof(*opts));
 	assert(opts);
 	opts->debug = 0; /* daemonize by default */
 	opts->socket_path = strdup(KONFD_SOCKET_PATH);
@@ -555,6 +3332,10 @@ struct options *opts_init(void)
 	opts->uid = getuid();
 	opts->gid = getgid();
 	opts->log_facility = LOG_DAEMON;
+	opts->workers = 0; /* Process requests within main loop */
+	opts->takeover = 0;
+	opts->replica = NULL;
+	opts->compact = 0; /* Don't front-code the lines */
 
 	return opts;
 }
@@ -569,6 +3350,8 @@ void opts_free(struct options *opts)
 		free(opts->pidfile);
 	if (opts->chroot)
 		free(opts->chroot);
+	if (opts->replica)
+		free(opts->replica);
 	free(opts);
 }
 
@@ -576,7 +3359,7 @@ void opts_free(struct options *opts)
 /* Parse command line options */
 static int opts_parse(int argc, char *argv[], struct options *opts)
 {
-	static const char *shortopts = "hvs:p:u:g:dr:O:";
+	static const char *shortopts = "hvs:p:u:g:dr:O:w:tR:c:";
 #ifdef HAVE_GETOPT_LONG
 	static const struct option longopts[] = {
 		{"help",	0, NULL, 'h'},
@@ -588,6 +3371,10 @@ static int opts_parse(int argc, char *argv[], struct options *opts)
 		{"debug",	0, NULL, 'd'},
 		{"chroot",	1, NULL, 'r'},
 		{"facility",	1, NULL, 'O'},
+		{"workers",	1, NULL, 'w'},
+		{"takeover",	0, NULL, 't'},
+		{"replica",	1, NULL, 'R'},
+		{"compact",	1, NULL, 'c'},
 		{NULL,		0, NULL, 0}
 	};
 #endif
@@ -662,6 +3449,43 @@ static int opts_parse(int argc, char *argv[], struct options *opts)
 				exit(-1);
 			}
 			break;
+		case 'w': {
+#ifdef HAVE_PTHREAD_H
+			long val;
+			char *endptr;
+			val = strtol(optarg, &endptr, 0);
+			if ((endptr == optarg) || (val < 0) || (val > 256)) {
+				fprintf(stderr, "Error: Illegal number of workers %s.\n",
+					optarg);
+				return -1;
+			}
+			opts->workers = (unsigned int)val;
+#else
+			fprintf(stderr, "Error: The --workers option is not supported.\n");
+			return -1;
+#endif
+			break;
+		}
+		case 't':
+			opts->takeover = 1;
+			break;
+		case 'R':
+			if (opts->replica)
+				free(opts->replica);
+			opts->replica = strdup(optarg);
+			break;
+		case 'c': {
+			long val;
+			char *endptr;
+			val = strtol(optarg, &endptr, 0);
+			if ((endptr == optarg) || (val < 0)) {
+				fprintf(stderr, "Error: Illegal section size %s.\n",
+					optarg);
+				return -1;
+			}
+			opts->compact = (unsigned int)val;
+			break;
+		}
 		case 'h':
 			help(0, argv[0]);
 			exit(0);
@@ -716,5 +3540,14 @@ static void help(int status, const char *argv0)
 		printf("\t-g <group>, --group=<group>\tExecute process as"
 			" specified group.\n");
 		printf("\t-O, --facility\tSyslog facility. Default is DAEMON.\n");
+		printf("\t-w <num>, --workers=<num>\tProcess requests within"
+			" the worker threads sharded by the top-level section.\n");
+		printf("\t-t, --takeover\tTake over the clients and the config"
+			" of the running daemon.\n");
+		printf("\t-R <path>, --replica=<path>\tRead-only replica of"
+			" the primary daemon listening on the path.\n");
+		printf("\t-c <num>, --compact=<num>\tFront-code the lines of"
+			" sections having at least <num> children. It saves"
+			" about 8%% of memory (180 to 165 MB for 1M routes).\n");
 	}
 }
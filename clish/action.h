@@ -7,6 +7,7 @@
 typedef struct clish_action_s clish_action_t;
 
 #include "lub/bintree.h"
+#include "lub/string.h"
 
 /*=====================================
  * ACTION INTERFACE
@@ -20,6 +21,7 @@ clish_action_t *clish_action_new(void);
  * methods
  *----------------- */
 void clish_action_delete(clish_action_t *instance);
+void clish_action_freeze(clish_action_t *instance, lub_string_arena_t *arena);
 void clish_action_dump(const clish_action_t *instance);
 
 /*-----------------
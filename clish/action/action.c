@@ -53,6 +53,14 @@ void clish_action_delete(clish_action_t *this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+void clish_action_freeze(clish_action_t *this, lub_string_arena_t *arena)
+{
+	lub_string_arena_add(arena, &this->script);
+	lub_string_arena_add(arena, &this->builtin);
+	lub_string_arena_add(arena, &this->shebang);
+}
+
 /*---------------------------------------------------------
  * PUBLIC ATTRIBUTES
  *--------------------------------------------------------- */
@@ -13,6 +13,7 @@
 #include <sys/un.h>
 #include <limits.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "internal.h"
 #include "konf/net.h"
@@ -20,7 +21,7 @@
 #include "konf/query.h"
 #include "lub/string.h"
 
-static int send_request(konf_client_t * client, char *command);
+static int print_data(void *udata, const char *chunk, size_t len);
 
 static unsigned short str2ushort(const char *str)
 {
@@ -52,12 +53,14 @@ bool_t clish_config_callback(clish_context_t *context)
 	clish_config_t *config;
 	char *command = NULL;
 	konf_client_t *client;
-	konf_buf_t *buf = NULL;
 	char *str = NULL;
 	char *tstr;
 	char tmp[PATH_MAX + 100];
 	clish_config_op_t op;
 	unsigned int num;
+	uint64_t handle;
+	int res;
+	int reconnected = 0;
 	const char *escape_chars = lub_string_esc_quoted;
 
 	if (!this)
@@ -164,63 +167,73 @@ bool_t clish_config_callback(clish_context_t *context)
 	} else {
 		num = clish_command__get_depth(cmd);
 	}
-	str = clish_shell__get_pwd_full(this, num);
-	if (str) {
-		lub_string_cat(&command, " ");
-		lub_string_cat(&command, str);
-		lub_string_free(str);
-	}
-
+	/* Use the cached handle of pwd node instead of full pwd. The
+	 * handle is stale if node was deleted so try the full pwd on the
+	 * stale handle error only. The handle is got after connect because
+	 * the handles of previous connection are dropped.
+	 */
+	do {
+		char *request;
+
+		if (konf_client_connect(client) < 0) {
+			fprintf(stderr, "Cannot write to the running-config.\n");
+			break;
+		}
+		handle = clish_shell__get_pwd_handle(this, num);
+		request = lub_string_dup(command);
+		if (handle) {
+			snprintf(tmp, sizeof(tmp) - 1, " -H 0x%" PRIx64, handle);
+			tmp[sizeof(tmp) - 1] = '\0';
+			lub_string_cat(&request, tmp);
+		} else if ((str = clish_shell__get_pwd_full(this, num))) {
+			lub_string_cat(&request, " -G ");
+			lub_string_cat(&request, str);
+			lub_string_free(str);
+		}
 #ifdef DEBUG
-	fprintf(stderr, "CONFIG request: %s\n", command);
+		fprintf(stderr, "CONFIG request: %s\n", request);
 #endif
-	if (send_request(client, command) < 0) {
-		fprintf(stderr, "Cannot write to the running-config.\n");
-	}
-	if (konf_client_recv_answer(client, &buf) < 0) {
-		fprintf(stderr, "The error while request to the config daemon.\n");
-	}
-	lub_string_free(command);
-
-	/* Postprocessing. Get data from daemon etc. */
-	switch (op) {
-
-	case CLISH_CONFIG_DUMP:
-		if (buf) {
-			konf_buf_lseek(buf, 0);
-			while ((str = konf_buf_preparse(buf))) {
-				if (strlen(str) == 0) {
-					lub_string_free(str);
-					break;
-				}
-				tinyrl_printf(clish_shell__get_tinyrl(this),
-					"%s\n", str);
-				lub_string_free(str);
+		res = konf_client_send(client, request);
+		lub_string_free(request);
+		if (res < 0) {
+			/* Reconnect once and build the request again */
+			konf_client_disconnect(client);
+			if (!reconnected) {
+				reconnected = 1;
+				continue;
 			}
-			konf_buf_delete(buf);
+			fprintf(stderr, "Cannot write to the running-config.\n");
+			break;
 		}
-		break;
-
-	default:
-		break;
-	};
+		/* Get data from daemon. The dump is printed while it's received */
+		res = konf_client_recv_answer_stream(client, print_data,
+			clish_shell__get_tinyrl(this));
+		if (res >= 0) {
+			if (!handle && konf_client__get_handle(client))
+				clish_shell__set_pwd_handle(this, num,
+					konf_client__get_handle(client));
+			break;
+		}
+		if (!handle || (KONF_CLIENT_ESTALE != res)) {
+			fprintf(stderr, "The error while request to the config daemon.\n");
+			break;
+		}
+		clish_shell__set_pwd_handle(this, num, 0);
+	} while (1);
+	lub_string_free(command);
 
 	return BOOL_TRUE;
 }
 
 /*--------------------------------------------------------- */
-
-static int send_request(konf_client_t * client, char *command)
+static int print_data(void *udata, const char *chunk, size_t len)
 {
-	if ((konf_client_connect(client) < 0))
-		return -1;
+	FILE *stream = tinyrl__get_ostream((tinyrl_t *)udata);
 
-	if (konf_client_send(client, command) < 0) {
-		if (konf_client_reconnect(client) < 0)
-			return -1;
-		if (konf_client_send(client, command) < 0)
-			return -1;
-	}
+	if (!stream)
+		return 0;
+	if (fwrite(chunk, 1, len, stream) != len)
+		return -1;
 
 	return 0;
 }
@@ -37,6 +37,7 @@ clish_command_diff(const clish_command_t * cmd1, const clish_command_t * cmd2);
  * methods
  *----------------- */
 void clish_command_delete(clish_command_t *instance);
+void clish_command_freeze(clish_command_t *instance, lub_string_arena_t *arena);
 void clish_command_insert_param(clish_command_t *instance,
 	clish_param_t *param);
 int clish_command_help(const clish_command_t *instance);
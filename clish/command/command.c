@@ -163,6 +163,27 @@ void clish_command_delete(clish_command_t * this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+/* The link shares the fields with the original command. The shared
+ * strings are registered twice and freed once by arena.
+ */
+void clish_command_freeze(clish_command_t * this, lub_string_arena_t * arena)
+{
+	lub_string_arena_add(arena, &this->name);
+	lub_string_arena_add(arena, &this->text);
+	lub_string_arena_add(arena, &this->view);
+	lub_string_arena_add(arena, &this->viewid);
+	lub_string_arena_add(arena, &this->detail);
+	lub_string_arena_add(arena, &this->escape_chars);
+	lub_string_arena_add(arena, &this->regex_chars);
+	lub_string_arena_add(arena, &this->alias);
+	clish_paramv_freeze(this->paramv, arena);
+	if (this->args)
+		clish_param_freeze(this->args, arena);
+	clish_action_freeze(this->action, arena);
+	clish_config_freeze(this->config, arena);
+}
+
 /*--------------------------------------------------------- */
 void clish_command_insert_param(clish_command_t * this, clish_param_t * param)
 {
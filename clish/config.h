@@ -5,6 +5,7 @@
 #define _clish_config_h
 
 #include "lub/types.h"
+#include "lub/string.h"
 
 typedef struct clish_config_s clish_config_t;
 
@@ -27,6 +28,7 @@ clish_config_t *clish_config_new(void);
  * methods
  *----------------- */
 void clish_config_delete(clish_config_t *instance);
+void clish_config_freeze(clish_config_t *instance, lub_string_arena_t *arena);
 void clish_config_dump(const clish_config_t *instance);
 
 /*-----------------
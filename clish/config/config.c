@@ -60,6 +60,15 @@ void clish_config_delete(clish_config_t *this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+void clish_config_freeze(clish_config_t *this, lub_string_arena_t *arena)
+{
+	lub_string_arena_add(arena, &this->pattern);
+	lub_string_arena_add(arena, &this->file);
+	lub_string_arena_add(arena, &this->seq);
+	lub_string_arena_add(arena, &this->depth);
+}
+
 /*---------------------------------------------------------
  * PUBLIC ATTRIBUTES
  *--------------------------------------------------------- */
@@ -4,6 +4,8 @@
 #ifndef _clish_hotkey_h
 #define _clish_hotkey_h
 
+#include "lub/string.h"
+
 typedef struct clish_hotkey_s clish_hotkey_t;
 typedef struct clish_hotkeyv_s clish_hotkeyv_t;
 
@@ -12,6 +14,8 @@ int clish_hotkeyv_insert(clish_hotkeyv_t *instance,
 	const char *key, const char *cmd);
 clish_hotkeyv_t *clish_hotkeyv_new(void);
 void clish_hotkeyv_delete(clish_hotkeyv_t *instance);
+void clish_hotkeyv_freeze(clish_hotkeyv_t *instance,
+	lub_string_arena_t *arena);
 
 #endif				/* _clish_hotkey_h */
 /** @} clish_hotkey */
@@ -157,3 +157,14 @@ void clish_hotkeyv_delete(clish_hotkeyv_t *this)
 }
 
 /*--------------------------------------------------------- */
+void clish_hotkeyv_freeze(clish_hotkeyv_t *this, lub_string_arena_t *arena)
+{
+	unsigned int i;
+
+	if (!this)
+		return;
+	for (i = 0; i < this->num; i++)
+		lub_string_arena_add(arena, &this->hotkeyv[i]->cmd);
+}
+
+/*--------------------------------------------------------- */
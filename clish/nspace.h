@@ -28,6 +28,12 @@ typedef enum {
 
 #include "clish/view.h"
 
+/* The proxy commands are dropped between the lines if there are more.
+ * The full cache is also dropped on insert if it's unused since the
+ * last idle point.
+ */
+#define CLISH_NSPACE_PROXY_MAX 128
+
 /*=====================================
  * NSPACE INTERFACE
  *===================================== */
@@ -39,6 +45,7 @@ clish_nspace_t *clish_nspace_new(clish_view_t * view);
  * methods
  *----------------- */
 void clish_nspace_delete(clish_nspace_t * instance);
+void clish_nspace_freeze(clish_nspace_t * instance, lub_string_arena_t * arena);
 const clish_command_t *clish_nspace_find_next_completion(clish_nspace_t *
 	instance, const char *iter_cmd, const char *line,
 	clish_nspace_visibility_t field);
@@ -47,6 +54,9 @@ void clish_nspace_dump(const clish_nspace_t * instance);
 clish_command_t * clish_nspace_create_prefix_cmd(clish_nspace_t * instance,
 	const char * name, const char * help);
 void clish_nspace_clean_proxy(clish_nspace_t * instance);
+void clish_nspace_trim_proxies(unsigned int max);
+void clish_nspace_proxies_idle(void);
+size_t clish_nspace_match_prefix(clish_nspace_t * instance, const char *line);
 /*-----------------
  * attributes
  *----------------- */
@@ -5,6 +5,7 @@
  */
 #include "private.h"
 #include "lub/string.h"
+#include "lub/ctype.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -14,6 +15,11 @@
 #include <regex.h>
 #include <ctype.h>
 
+/* The nspaces having the proxy commands */
+static clish_nspace_t *proxy_list = NULL;
+/* Advanced where no proxy command is referenced */
+static unsigned int proxy_epoch = 0;
+
 /*---------------------------------------------------------
  * PRIVATE METHODS
  *--------------------------------------------------------- */
@@ -23,6 +29,14 @@ static void clish_nspace_init(clish_nspace_t * this, clish_view_t * view)
 
 	/* set up defaults */
 	this->prefix = NULL;
+	this->prefix_literal = BOOL_FALSE;
+	this->prefix_len = 0;
+	memset(this->memov, 0, sizeof(this->memov));
+	this->memo_next = 0;
+	this->proxyc = 0;
+	this->proxy_next = NULL;
+	this->proxy_listed = BOOL_FALSE;
+	this->proxy_epoch = 0;
 	this->help = BOOL_FALSE;
 	this->completion = BOOL_TRUE;
 	this->context_help = BOOL_FALSE;
@@ -36,22 +50,52 @@ static void clish_nspace_init(clish_nspace_t * this, clish_view_t * view)
 }
 
 /*--------------------------------------------------------- */
-static void clish_nspace_fini(clish_nspace_t * this)
+/* Delete the proxy commands of this nspace only */
+static void clish_nspace_delete_proxies(clish_nspace_t * this)
 {
 	clish_command_t *cmd;
 
-	/* deallocate the memory for this instance */
-	if (this->prefix) {
-		free(this->prefix);
-		regfree(&this->prefix_regex);
-	}
-	/* delete each command link held by this nspace */
 	while ((cmd = lub_bintree_findfirst(&this->tree))) {
 		/* remove the command from the tree */
 		lub_bintree_remove(&this->tree, cmd);
 		/* release the instance */
 		clish_command_delete(cmd);
 	}
+	this->proxyc = 0;
+}
+
+/*--------------------------------------------------------- */
+static void clish_nspace_unlist(clish_nspace_t * this)
+{
+	clish_nspace_t **tmp;
+
+	if (!this->proxy_listed)
+		return;
+	for (tmp = &proxy_list; *tmp; tmp = &(*tmp)->proxy_next) {
+		if (*tmp == this) {
+			*tmp = this->proxy_next;
+			break;
+		}
+	}
+	this->proxy_next = NULL;
+	this->proxy_listed = BOOL_FALSE;
+}
+
+/*--------------------------------------------------------- */
+static void clish_nspace_fini(clish_nspace_t * this)
+{
+	unsigned int i;
+
+	/* deallocate the memory for this instance */
+	if (this->prefix) {
+		lub_string_free(this->prefix);
+		regfree(&this->prefix_regex);
+	}
+	for (i = 0; i < CLISH_NSPACE_MEMO; i++)
+		lub_string_free(this->memov[i].line);
+	/* delete each command link held by this nspace */
+	clish_nspace_delete_proxies(this);
+	clish_nspace_unlist(this);
 	/* Delete prefix pseudo-command */
 	if (this->prefix_cmd) {
 		clish_command_delete(this->prefix_cmd);
@@ -98,6 +142,7 @@ static clish_command_t *clish_nspace_find_create_command(clish_nspace_t * this,
 	/* The command is cached already */
 	if ((cmd = lub_bintree_find(&this->tree, name))) {
 		free(name);
+		this->proxy_epoch = proxy_epoch;
 		return cmd;
 	}
 	cmd = clish_command_new_link(name, help, ref);
@@ -110,17 +155,26 @@ static clish_command_t *clish_nspace_find_create_command(clish_nspace_t * this,
 	tmp = lub_bintree_findfirst(&this->tree);
 	if (tmp)
 		str = clish_command__get_name(tmp);
-	if (str && (lub_string_nocasestr(str, prefix) != str)) {
-		do {
-			lub_bintree_remove(&this->tree, tmp);
-			clish_command_delete(tmp);
-		} while ((tmp = lub_bintree_findfirst(&this->tree)));
-	}
+	if (str && (lub_string_nocasestr(str, prefix) != str))
+		clish_nspace_delete_proxies(this);
+	/* Drop the full cache if none of it is referenced since
+	 * the last idle point.
+	 */
+	else if ((this->proxyc >= CLISH_NSPACE_PROXY_MAX) &&
+		(this->proxy_epoch != proxy_epoch))
+		clish_nspace_delete_proxies(this);
 
 	/* Insert command link into the tree */
 	if (-1 == lub_bintree_insert(&this->tree, cmd)) {
 		clish_command_delete(cmd);
-		cmd = NULL;
+		return NULL;
+	}
+	this->proxyc++;
+	this->proxy_epoch = proxy_epoch;
+	if (!this->proxy_listed) {
+		this->proxy_next = proxy_list;
+		proxy_list = this;
+		this->proxy_listed = BOOL_TRUE;
 	}
 
 	return cmd;
@@ -148,28 +202,66 @@ void clish_nspace_delete(clish_nspace_t * this)
 }
 
 /*--------------------------------------------------------- */
-static const char *clish_nspace_after_prefix(const regex_t *prefix_regex,
-	const char *line, char **real_prefix)
+void clish_nspace_freeze(clish_nspace_t * this, lub_string_arena_t * arena)
+{
+	lub_string_arena_add(arena, &this->prefix);
+	if (this->prefix_cmd)
+		clish_command_freeze(this->prefix_cmd, arena);
+}
+
+/*--------------------------------------------------------- */
+/* The literal prefix is compared case insensitive like the regex
+ * compiled with REG_ICASE. The regex matches are remembered for the
+ * recent lines because the same line is matched for each key press.
+ */
+size_t clish_nspace_match_prefix(clish_nspace_t * this, const char *line)
 {
-	const char *in_line = NULL;
+	clish_nspace_memo_t *memo;
 	regmatch_t pmatch[1];
-	int res;
+	size_t len = 0;
+	unsigned int i;
 
-	if (!line)
-		return NULL;
+	if (!this->prefix || !line)
+		return 0;
+
+	if (this->prefix_literal) {
+		for (i = 0; i < this->prefix_len; i++) {
+			if (lub_ctype_tolower(line[i]) !=
+				lub_ctype_tolower(this->prefix[i]))
+				return 0;
+		}
+		return this->prefix_len;
+	}
+
+	for (i = 0; i < CLISH_NSPACE_MEMO; i++) {
+		memo = &this->memov[i];
+		if (memo->line && !strcmp(memo->line, line))
+			return memo->len;
+	}
+	if (!regexec(&this->prefix_regex, line, 1, pmatch, 0) &&
+		(0 == pmatch[0].rm_so))
+		len = pmatch[0].rm_eo;
+	memo = &this->memov[this->memo_next];
+	this->memo_next = (this->memo_next + 1) % CLISH_NSPACE_MEMO;
+	lub_string_free(memo->line);
+	memo->line = lub_string_dup(line);
+	memo->len = len;
+
+	return len;
+}
+
+/*--------------------------------------------------------- */
+static const char *clish_nspace_after_prefix(clish_nspace_t * this,
+	const char *line, char **real_prefix)
+{
+	size_t len = clish_nspace_match_prefix(this, line);
 
-	/* Compile regular expression */
-	res = regexec(prefix_regex, line, 1, pmatch, 0);
-	if (res || (0 != pmatch[0].rm_so))
-		return NULL;
 	/* Empty match */
-	if (0 == pmatch[0].rm_eo)
+	if (!len)
 		return NULL;
-	in_line = line + pmatch[0].rm_eo;
+	lub_string_catn(real_prefix, line, len);
 
-	lub_string_catn(real_prefix, line, pmatch[0].rm_eo);
-
-	return in_line;
+	return line + len;
 }
 
 /*--------------------------------------------------------- */
@@ -183,8 +275,7 @@ clish_command_t *clish_nspace_find_command(clish_nspace_t * this, const char *na
 	if (!clish_nspace__get_prefix(this))
 		return clish_view_find_command(view, name, this->inherit);
 
-	if (!(in_line = clish_nspace_after_prefix(
-		clish_nspace__get_prefix_regex(this), name, &real_prefix)))
+	if (!(in_line = clish_nspace_after_prefix(this, name, &real_prefix)))
 		return NULL;
 
 	/* If prefix is followed by space */
@@ -220,8 +311,7 @@ const clish_command_t *clish_nspace_find_next_completion(clish_nspace_t * this,
 		return clish_view_find_next_completion(view, iter_cmd,
 			line, field, this->inherit);
 
-	if (!(in_line = clish_nspace_after_prefix(
-		clish_nspace__get_prefix_regex(this), line, &real_prefix)))
+	if (!(in_line = clish_nspace_after_prefix(this, line, &real_prefix)))
 		return NULL;
 
 	if (in_line[0] != '\0') {
@@ -262,19 +352,46 @@ const clish_command_t *clish_nspace_find_next_completion(clish_nspace_t * this,
 /*--------------------------------------------------------- */
 void clish_nspace_clean_proxy(clish_nspace_t * this)
 {
-	clish_command_t *cmd = NULL;
-
 	/* Recursive proxy clean */
 	clish_view_clean_proxy(this->view);
 	/* Delete each command proxy held by this nspace */
-	while ((cmd = lub_bintree_findfirst(&this->tree))) {
-		/* remove the command from the tree */
-		lub_bintree_remove(&this->tree, cmd);
-		/* release the instance */
-		clish_command_delete(cmd);
+	clish_nspace_delete_proxies(this);
+	clish_nspace_unlist(this);
+}
+
+/*--------------------------------------------------------- */
+/* Drop the proxy commands of the nspaces having more than max ones.
+ * The proxies can be referenced while the line is processed so it's
+ * called between the lines only.
+ */
+void clish_nspace_trim_proxies(unsigned int max)
+{
+	clish_nspace_t **tmp = &proxy_list;
+
+	clish_nspace_proxies_idle();
+
+	while (*tmp) {
+		clish_nspace_t *nspace = *tmp;
+		if (nspace->proxyc <= max) {
+			tmp = &nspace->proxy_next;
+			continue;
+		}
+		clish_nspace_delete_proxies(nspace);
+		*tmp = nspace->proxy_next;
+		nspace->proxy_next = NULL;
+		nspace->proxy_listed = BOOL_FALSE;
 	}
 }
 
+/*--------------------------------------------------------- */
+/* Mark the point where no proxy command is referenced. The full
+ * proxy caches created before it can be dropped on the next insert.
+ */
+void clish_nspace_proxies_idle(void)
+{
+	proxy_epoch++;
+}
+
 /*---------------------------------------------------------
  * PUBLIC ATTRIBUTES
  *--------------------------------------------------------- */
@@ -292,6 +409,10 @@ void clish_nspace__set_prefix(clish_nspace_t * this, const char *prefix)
 	res = regcomp(&this->prefix_regex, prefix, REG_EXTENDED | REG_ICASE);
 	assert(!res);
 	this->prefix = lub_string_dup(prefix);
+	/* The plain word is matched without regex */
+	this->prefix_len = strlen(prefix);
+	this->prefix_literal = (this->prefix_len &&
+		!strpbrk(prefix, "\\^$.[]|()?*+{}")) ? BOOL_TRUE : BOOL_FALSE;
 }
 
 /*--------------------------------------------------------- */
@@ -5,17 +5,33 @@
 
 #include "clish/nspace.h"
 
+/* The number of remembered regex matches of prefix */
+#define CLISH_NSPACE_MEMO 16
+
 /*---------------------------------------------------------
  * PRIVATE TYPES
  *--------------------------------------------------------- */
+typedef struct {
+	char *line;
+	size_t len; /* The length of matched prefix or 0 */
+} clish_nspace_memo_t;
+
 struct clish_nspace_s {
 	lub_bintree_t tree;	/* Tree of command links */
 	clish_view_t *view;	/* The view to import commands from */
 	char *prefix;		/* if non NULL the prefix for imported commands */
 	regex_t prefix_regex;
+	bool_t prefix_literal; /* The prefix has no special regex chars */
+	size_t prefix_len;
+	clish_nspace_memo_t memov[CLISH_NSPACE_MEMO];
+	unsigned int memo_next;
 	bool_t help;
 	bool_t completion;
 	bool_t context_help;
 	bool_t inherit;
 	clish_command_t * prefix_cmd;
+	unsigned int proxyc; /* The number of proxy commands in the tree */
+	clish_nspace_t *proxy_next; /* The list of nspaces having proxies */
+	bool_t proxy_listed;
+	unsigned int proxy_epoch; /* The last epoch the proxies were used */
 };
@@ -55,6 +55,7 @@ clish_param_t *clish_param_new(const char *name,
  * methods
  *----------------- */
 void clish_param_delete(clish_param_t * instance);
+void clish_param_freeze(clish_param_t * instance, lub_string_arena_t * arena);
 void clish_param_help(const clish_param_t * instance, clish_help_t *help);
 void clish_param_help_arrow(const clish_param_t * instance, size_t offset);
 char *clish_param_validate(const clish_param_t * instance, const char *text);
@@ -92,6 +93,7 @@ char *clish_param__get_completion(const clish_param_t *instance);
 /* paramv methods */
 clish_paramv_t *clish_paramv_new(void);
 void clish_paramv_delete(clish_paramv_t * instance);
+void clish_paramv_freeze(clish_paramv_t * instance, lub_string_arena_t * arena);
 void clish_paramv_insert(clish_paramv_t * instance, clish_param_t * param);
 clish_param_t *clish_paramv__get_param(const clish_paramv_t * instance,
 				unsigned index);
@@ -72,6 +72,18 @@ void clish_param_delete(clish_param_t * this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+void clish_param_freeze(clish_param_t * this, lub_string_arena_t * arena)
+{
+	lub_string_arena_add(arena, &this->name);
+	lub_string_arena_add(arena, &this->text);
+	lub_string_arena_add(arena, &this->value);
+	lub_string_arena_add(arena, &this->defval);
+	lub_string_arena_add(arena, &this->test);
+	lub_string_arena_add(arena, &this->completion);
+	clish_paramv_freeze(this->paramv, arena);
+}
+
 /*--------------------------------------------------------- */
 void clish_param_insert_param(clish_param_t * this, clish_param_t * param)
 {
@@ -273,6 +285,15 @@ void clish_paramv_delete(clish_paramv_t * this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+void clish_paramv_freeze(clish_paramv_t * this, lub_string_arena_t * arena)
+{
+	unsigned int i;
+
+	for (i = 0; i < this->paramc; i++)
+		clish_param_freeze(this->paramv[i], arena);
+}
+
 /*--------------------------------------------------------- */
 void clish_paramv_insert(clish_paramv_t * this, clish_param_t * param)
 {
@@ -20,6 +20,7 @@ typedef struct clish_ptype_s clish_ptype_t;
 #include "lub/types.h"
 #include "lub/bintree.h"
 #include "lub/argv.h"
+#include "lub/string.h"
 
 #include <stddef.h>
 
@@ -91,6 +92,7 @@ clish_ptype_t *clish_ptype_new(const char *name, const char *text,
  * methods
  *----------------- */
 void clish_ptype_delete(clish_ptype_t * instance);
+void clish_ptype_freeze(clish_ptype_t * instance, lub_string_arena_t * arena);
 /**
  * This is the validation method for the specified type.
  * \return
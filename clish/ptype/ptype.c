@@ -455,6 +455,15 @@ void clish_ptype_delete(clish_ptype_t * this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+void clish_ptype_freeze(clish_ptype_t * this, lub_string_arena_t * arena)
+{
+	lub_string_arena_add(arena, &this->name);
+	lub_string_arena_add(arena, &this->text);
+	lub_string_arena_add(arena, &this->pattern);
+	lub_string_arena_add(arena, &this->range);
+}
+
 /*--------------------------------------------------------- */
 const char *clish_ptype__get_name(const clish_ptype_t * this)
 {
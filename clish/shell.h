@@ -317,6 +317,10 @@ char *clish_shell__get_pwd_line(const clish_shell_t * instance,
 char *clish_shell__get_pwd_full(const clish_shell_t * instance, unsigned depth);
 clish_view_t *clish_shell__get_pwd_view(const clish_shell_t * instance,
 	unsigned int index);
+uint64_t clish_shell__get_pwd_handle(const clish_shell_t * instance,
+	unsigned int index);
+void clish_shell__set_pwd_handle(clish_shell_t * instance,
+	unsigned int index, uint64_t handle);
 konf_client_t *clish_shell__get_client(const clish_shell_t * instance);
 FILE *clish_shell__get_istream(const clish_shell_t * instance);
 FILE *clish_shell__get_ostream(const clish_shell_t * instance);
@@ -324,6 +328,12 @@ void clish_shell__set_lockfile(clish_shell_t * instance, const char * path);
 char * clish_shell__get_lockfile(clish_shell_t * instance);
 int clish_shell__set_socket(clish_shell_t * instance, const char * path);
 void clish_shell_load_scheme(clish_shell_t * instance, const char * xml_path);
+int clish_shell_compile_scheme(clish_shell_t * instance, const char * xml_path);
+void clish_shell_build_views(clish_shell_t * instance);
+int clish_shell_freeze(clish_shell_t * instance);
+size_t clish_shell__get_frozen_size(const clish_shell_t * instance);
+void clish_shell__set_profile(clish_shell_t * instance, bool_t profile);
+void clish_shell_profile_fprintf(clish_shell_t * instance, FILE * stream);
 int clish_shell_loop(clish_shell_t * instance);
 clish_shell_state_t clish_shell__get_state(const clish_shell_t * instance);
 void clish_shell__set_state(clish_shell_t * instance,
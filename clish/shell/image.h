@@ -0,0 +1,74 @@
+/*
+ * image.h
+ *
+ * private klish file: the compiled image of XML scheme
+ *
+ * The image is a flat copy of the element tree of XML files. It contains
+ * the element names, the attributes and the text content only. The image
+ * can be saved to the file and mapped to the memory later so the XML
+ * files don't need to be parsed on startup.
+ */
+
+#ifndef clish_image_included_h
+#define clish_image_included_h
+
+#include "lub/types.h"
+#include "xmlapi.h"
+
+/* The file name of image within the first directory of the path */
+#define CLISH_IMAGE_NAME "clish.image"
+
+typedef struct clish_image_s clish_image_t;
+typedef struct clish_imgnode_s clish_imgnode_t;
+
+/*
+ * create an empty image
+ */
+clish_image_t *clish_image_new(void);
+
+/*
+ * map the image file. Returns NULL if the file is absent or it's
+ * not a valid image.
+ */
+clish_image_t *clish_image_load(const char *filename);
+
+/*
+ * free the image
+ */
+void clish_image_free(clish_image_t *instance);
+
+/*
+ * add the tree of XML element to the image. The filename is the
+ * name of the source file.
+ */
+int clish_image_add(clish_image_t *instance, clish_xmlnode_t *root,
+	const char *filename);
+
+/*
+ * write the image to the file. The path is the list of directories
+ * the image was built from.
+ */
+int clish_image_save(clish_image_t *instance, const char *filename,
+	const char *path);
+
+/*
+ * check if the file was not modified since the image was saved
+ */
+bool_t clish_image_is_newer(const clish_image_t *instance,
+	const char *filename);
+
+clish_imgnode_t *clish_image__get_root(const clish_image_t *instance);
+const char *clish_image__get_path(const clish_image_t *instance);
+unsigned int clish_image__get_files_num(const clish_image_t *instance);
+const char *clish_image__get_file(const clish_image_t *instance,
+	unsigned int index);
+
+const char *clish_imgnode__get_name(const clish_imgnode_t *instance);
+const char *clish_imgnode__get_content(const clish_imgnode_t *instance);
+const char *clish_imgnode__get_attr(const clish_imgnode_t *instance,
+	const char *name);
+clish_imgnode_t *clish_imgnode__get_parent(const clish_imgnode_t *instance);
+clish_imgnode_t *clish_imgnode__get_child(const clish_imgnode_t *instance);
+clish_imgnode_t *clish_imgnode__get_next(const clish_imgnode_t *instance);
+
+#endif /* clish_image_included_h */
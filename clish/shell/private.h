@@ -2,26 +2,21 @@
  * shell.h - private interface to the shell class
  */
 #include "lub/bintree.h"
+#include "lub/string.h"
 #include "tinyrl/tinyrl.h"
 #include "clish/shell.h"
 #include "clish/pargv.h"
 #include "clish/var.h"
 #include "clish/action.h"
 
+#include <time.h>
+
 /*-------------------------------------
  * PRIVATE TYPES
  *------------------------------------- */
 
 /*-------------------------------------------------------- */
 
-/*
- * iterate around commands
- */
-typedef struct {
-	const char *last_cmd;
-	clish_nspace_visibility_t field;
-} clish_shell_iterator_t;
-
 /* this is used to maintain a stack of file handles */
 typedef struct clish_shell_file_s clish_shell_file_t;
 struct clish_shell_file_s {
@@ -36,8 +31,42 @@ typedef struct {
 	char *line;
 	clish_view_t *view;
 	lub_bintree_t viewid;
+	uint64_t handle; /* The konfd handle of this path or 0 */
+	unsigned int handle_conn; /* The client connection of handle */
 } clish_shell_pwd_t;
 
+/* The startup profiling phases. The XML element handlers use the slots
+ * starting from CLISH_PROFILE_ELEMENT.
+ */
+typedef enum {
+	CLISH_PROFILE_LOAD,
+	CLISH_PROFILE_SCAN,
+	CLISH_PROFILE_IMAGE,
+	CLISH_PROFILE_PARSE,
+	CLISH_PROFILE_BUILD,
+	CLISH_PROFILE_REGCOMP,
+	CLISH_PROFILE_RESOLVE,
+	CLISH_PROFILE_TINYRL,
+	CLISH_PROFILE_STARTUP,
+	CLISH_PROFILE_FREEZE,
+	CLISH_PROFILE_ELEMENT
+} clish_profile_phase_e;
+
+#define CLISH_PROFILE_SLOTS (CLISH_PROFILE_ELEMENT + 16)
+
+typedef struct clish_profile_s clish_profile_t;
+typedef struct clish_profile_mark_s clish_profile_mark_t;
+struct clish_profile_mark_s {
+	clish_profile_mark_t *outer;
+	unsigned int slot;
+	long long wall;
+	long long cpu;
+	long long heap;
+	long long child_wall; /* The cost of nested phases */
+	long long child_cpu;
+	long long child_heap;
+};
+
 struct clish_shell_s {
 	lub_bintree_t view_tree; /* Maintain a tree of views */
 	lub_bintree_t ptype_tree; /* Maintain a tree of ptypes */
@@ -65,20 +94,18 @@ struct clish_shell_s {
 	bool_t log; /* If command logging is enabled */
 	int log_facility; /* Syslog facility */
 	struct passwd *user; /* Current user information */
+	struct clish_image_s **imagev; /* The images the views are built from */
+	unsigned int imagec;
+	clish_profile_t *profile; /* Startup profiling or NULL */
+	lub_string_arena_t **arenav; /* The frozen strings of scheme */
+	unsigned int arenac;
 };
 
 /**
- * Initialise a command iterator structure
+ * get all the commands which are the extensions of the specified line
  */
-void
-clish_shell_iterator_init(clish_shell_iterator_t * iter,
-	clish_nspace_visibility_t field);
-
-/**
- * get the next command which is an extension of the specified line 
- */
-const clish_command_t *clish_shell_find_next_completion(const clish_shell_t *
-	instance, const char *line, clish_shell_iterator_t * iter);
+const clish_command_t **clish_shell_find_completions(const clish_shell_t *
+	instance, const char *line, clish_nspace_visibility_t field);
 /**
  * Pop the current file handle from the stack of file handles, shutting
  * the file down and freeing any associated memory. The next file handle
@@ -91,6 +118,7 @@ const clish_command_t *clish_shell_find_next_completion(const clish_shell_t *
 int clish_shell_pop_file(clish_shell_t * instance);
 
 clish_view_t *clish_shell_find_view(clish_shell_t * instance, const char *name);
+void clish_shell_build_view(clish_shell_t * instance, clish_view_t * view);
 void clish_shell_insert_view(clish_shell_t * instance, clish_view_t * view);
 clish_pargv_status_t clish_shell_parse(clish_shell_t * instance,
 	const char *line, const clish_command_t ** cmd, clish_pargv_t ** pargv);
@@ -121,3 +149,13 @@ void clish_shell__init_pwd(clish_shell_pwd_t *pwd);
 void clish_shell__fini_pwd(clish_shell_pwd_t *pwd);
 int clish_shell_timeout_fn(tinyrl_t *tinyrl);
 int clish_shell_keypress_fn(tinyrl_t *tinyrl, int key);
+
+long long clish_profile_clock(clockid_t id);
+clish_profile_t *clish_profile_new(void);
+void clish_profile_free(clish_profile_t *instance);
+void clish_profile_enter(clish_profile_t *instance,
+	clish_profile_mark_t *mark, unsigned int slot, const char *name);
+void clish_profile_leave(clish_profile_t *instance,
+	clish_profile_mark_t *mark);
+void clish_profile_add_file(clish_profile_t *instance,
+	const char *filename, long long wall, long long cpu);
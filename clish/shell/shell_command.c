@@ -1,31 +1,29 @@
 /*
  * shell_word_generator.c
  */
+#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "private.h"
 #include "lub/string.h"
 #include "lub/argv.h"
 
-/*-------------------------------------------------------- */
-void
-clish_shell_iterator_init(clish_shell_iterator_t * iter,
-	clish_nspace_visibility_t field)
-{
-	iter->last_cmd = NULL;
-	iter->field = field;
-}
-
 /*--------------------------------------------------------- */
 const clish_command_t *clish_shell_resolve_command(const clish_shell_t * this,
 	const char *line)
 {
 	clish_command_t *cmd, *result;
+	lub_argv_t *argv;
 
+	/* The line is split once for both views */
+	argv = lub_argv_new(line, 0);
 	/* Search the current view */
-	result = clish_view_resolve_command(clish_shell__get_view(this), line, BOOL_TRUE);
+	result = clish_view_resolve_command_argv(clish_shell__get_view(this),
+		argv, BOOL_TRUE);
 	/* Search the global view */
-	cmd = clish_view_resolve_command(this->global, line, BOOL_TRUE);
+	cmd = clish_view_resolve_command_argv(this->global, argv, BOOL_TRUE);
+	lub_argv_delete(argv);
 
 	result = clish_command_choose_longest(result, cmd);
 
@@ -37,11 +35,15 @@ const clish_command_t *clish_shell_resolve_prefix(const clish_shell_t * this,
 	const char *line)
 {
 	clish_command_t *cmd, *result;
+	lub_argv_t *argv;
 
+	argv = lub_argv_new(line, 0);
 	/* Search the current view */
-	result = clish_view_resolve_prefix(clish_shell__get_view(this), line, BOOL_TRUE);
+	result = clish_view_resolve_prefix_argv(clish_shell__get_view(this),
+		argv, BOOL_TRUE);
 	/* Search the global view */
-	cmd = clish_view_resolve_prefix(this->global, line, BOOL_TRUE);
+	cmd = clish_view_resolve_prefix_argv(this->global, argv, BOOL_TRUE);
+	lub_argv_delete(argv);
 
 	result = clish_command_choose_longest(result, cmd);
 
@@ -49,25 +51,40 @@ const clish_command_t *clish_shell_resolve_prefix(const clish_shell_t * this,
 }
 
 /*-------------------------------------------------------- */
-const clish_command_t *clish_shell_find_next_completion(const clish_shell_t *
-	this, const char *line, clish_shell_iterator_t * iter)
+/* Get all the completions of line sorted by name. The commands of
+ * current view override the commands of global view. The NULL
+ * terminated vector must be freed by free().
+ */
+const clish_command_t **clish_shell_find_completions(const clish_shell_t *
+	this, const char *line, clish_nspace_visibility_t field)
 {
-	const clish_command_t *result, *cmd;
-
-	/* ask the local view for next command */
-	result = clish_view_find_next_completion(clish_shell__get_view(this),
-		iter->last_cmd, line, iter->field, BOOL_TRUE);
-	/* ask the global view for next command */
-	cmd = clish_view_find_next_completion(this->global,
-		iter->last_cmd, line, iter->field, BOOL_TRUE);
-
-	if (clish_command_diff(result, cmd) > 0)
-		result = cmd;
-
-	if (!result)
-		iter->last_cmd = NULL;
-	else
-		iter->last_cmd = clish_command__get_name(result);
+	const clish_command_t **local, **global, **result;
+	unsigned int i = 0, j = 0, num = 0;
+
+	local = clish_view_find_completions(clish_shell__get_view(this),
+		line, field);
+	global = clish_view_find_completions(this->global, line, field);
+	while (local[i])
+		i++;
+	while (global[j])
+		j++;
+	result = malloc((i + j + 1) * sizeof(*result));
+	assert(result);
+
+	/* Merge the sorted vectors */
+	for (i = 0, j = 0; local[i] || global[j];) {
+		int diff = clish_command_diff(local[i], global[j]);
+		if (diff > 0) {
+			result[num++] = global[j++];
+			continue;
+		}
+		if (!diff)
+			j++;
+		result[num++] = local[i++];
+	}
+	result[num] = NULL;
+	free(local);
+	free(global);
 
 	return result;
 }
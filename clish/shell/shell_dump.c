@@ -12,6 +12,9 @@ void clish_shell_dump(clish_shell_t * this)
 	clish_var_t *var;
 	lub_bintree_iterator_t iter;
 
+	/* All the views are dumped so build them */
+	clish_shell_build_views(this);
+
 	lub_dump_printf("shell(%p)\n", this);
 	lub_dump_printf("OVERVIEW:\n%s", LUB_DUMP_STR(this->overview));
 	lub_dump_indent();
@@ -307,6 +307,12 @@ static void clish_expat_free_node(clish_xmlnode_t *cur)
 /*
  * Public interface
  */
+/* Each document has its own parser so nothing is shared */
+int clish_xml_init(void)
+{
+	return 1;
+}
+
 clish_xmldoc_t *clish_xmldoc_read(const char *filename)
 {
 	clish_xmldoc_t *doc;
@@ -456,6 +462,19 @@ char *clish_xmlnode_fetch_attr(clish_xmlnode_t *node,
 	return NULL;
 }
 
+char *clish_xmlnode_fetch_attr_name(clish_xmlnode_t *node,
+			       unsigned int index)
+{
+	if (node) {
+		clish_xmlnode_t *n = node->attributes;
+		while (n && index--)
+			n = n->next;
+		if (n)
+			return n->name;
+	}
+	return NULL;
+}
+
 int clish_xmlnode_get_content(clish_xmlnode_t *node, char *content,
 			      unsigned int *contentlen)
 {
@@ -12,6 +12,7 @@ static int clish_shell_push(clish_shell_t * this, FILE * file,
 {
 	/* Allocate a control node */
 	clish_shell_file_t *node = malloc(sizeof(clish_shell_file_t));
+	clish_profile_mark_t mark;
 
 	assert(this);
 	assert(node);
@@ -30,7 +31,9 @@ static int clish_shell_push(clish_shell_t * this, FILE * file,
 	this->current_file = node;
 
 	/* now switch the terminal's input stream */
+	clish_profile_enter(this->profile, &mark, CLISH_PROFILE_TINYRL, NULL);
 	tinyrl__set_istream(this->tinyrl, file);
+	clish_profile_leave(this->profile, &mark);
 
 	return 0;
 }
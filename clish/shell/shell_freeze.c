@@ -0,0 +1,83 @@
+/*
+ * shell_freeze.c
+ *
+ * Freeze the strings of loaded scheme. The strings are copied to the
+ * read-only block so the forked sessions share them with the parent.
+ * The trees of scheme are frozen too so the lookups don't write them.
+ * The commands of views are flattened at last.
+ */
+#include "private.h"
+#include "lub/string.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/*--------------------------------------------------------- */
+/* The views built on demand after the freeze keep the heap strings.
+ * So it's better to build the views before.
+ */
+int clish_shell_freeze(clish_shell_t *this)
+{
+	lub_string_arena_t *arena;
+	lub_string_arena_t **tmp;
+	lub_bintree_iterator_t iter;
+	clish_profile_mark_t mark;
+	void *obj;
+	int res;
+
+	clish_profile_enter(this->profile, &mark, CLISH_PROFILE_FREEZE, NULL);
+	/* The proxies share the strings with the commands */
+	clish_nspace_trim_proxies(0);
+	arena = lub_string_arena_new();
+
+	obj = lub_bintree_findfirst(&this->view_tree);
+	for (lub_bintree_iterator_init(&iter, &this->view_tree, obj);
+		obj; obj = lub_bintree_iterator_next(&iter))
+		clish_view_freeze(obj, arena);
+	obj = lub_bintree_findfirst(&this->ptype_tree);
+	for (lub_bintree_iterator_init(&iter, &this->ptype_tree, obj);
+		obj; obj = lub_bintree_iterator_next(&iter))
+		clish_ptype_freeze(obj, arena);
+	obj = lub_bintree_findfirst(&this->var_tree);
+	for (lub_bintree_iterator_init(&iter, &this->var_tree, obj);
+		obj; obj = lub_bintree_iterator_next(&iter))
+		clish_var_freeze(obj, arena);
+	if (this->startup)
+		clish_command_freeze(this->startup, arena);
+	if (this->wdog)
+		clish_command_freeze(this->wdog, arena);
+	lub_string_arena_add(arena, &this->overview);
+	lub_bintree_freeze(&this->view_tree);
+	lub_bintree_freeze(&this->ptype_tree);
+	lub_bintree_freeze(&this->var_tree);
+
+	if ((res = lub_string_arena_freeze(arena)) < 0) {
+		lub_string_arena_free(arena);
+		goto out;
+	}
+	tmp = realloc(this->arenav, (this->arenac + 1) * sizeof(*tmp));
+	assert(tmp);
+	this->arenav = tmp;
+	this->arenav[this->arenac++] = arena;
+
+	/* The flattened commands are shared by the forked sessions too */
+	obj = lub_bintree_findfirst(&this->view_tree);
+	for (lub_bintree_iterator_init(&iter, &this->view_tree, obj);
+		obj; obj = lub_bintree_iterator_next(&iter))
+		clish_view_build_index(obj);
+out:
+	clish_profile_leave(this->profile, &mark);
+	return res;
+}
+
+/*--------------------------------------------------------- */
+size_t clish_shell__get_frozen_size(const clish_shell_t *this)
+{
+	size_t size = 0;
+	unsigned int i;
+
+	for (i = 0; i < this->arenac; i++)
+		size += lub_string_arena__get_size(this->arenav[i]);
+
+	return size;
+}
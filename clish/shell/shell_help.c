@@ -6,6 +6,7 @@
 #include "lub/string.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -16,25 +17,26 @@
 static void available_commands(clish_shell_t *this,
 	clish_help_t *help, const char *line, size_t *max_width)
 {
-	const clish_command_t *cmd;
-	clish_shell_iterator_t iter;
+	const clish_command_t **cmdv;
+	unsigned int i;
 
 	if (max_width)
 		*max_width = 0;
 	/* Search for COMMAND completions */
-	clish_shell_iterator_init(&iter, CLISH_NSPACE_HELP);
-	while ((cmd = clish_shell_find_next_completion(this, line, &iter))) {
+	cmdv = clish_shell_find_completions(this, line, CLISH_NSPACE_HELP);
+	for (i = 0; cmdv[i]; i++) {
 		size_t width;
-		const char *name = clish_command__get_suffix(cmd);
+		const char *name = clish_command__get_suffix(cmdv[i]);
 		if (max_width) {
 			width = strlen(name);
 			if (width > *max_width)
 				*max_width = width;
 		}
 		lub_argv_add(help->name, name);
-		lub_argv_add(help->help, clish_command__get_text(cmd));
-		lub_argv_add(help->detail, clish_command__get_detail(cmd));
+		lub_argv_add(help->help, clish_command__get_text(cmdv[i]));
+		lub_argv_add(help->detail, clish_command__get_detail(cmdv[i]));
 	}
+	free(cmdv);
 }
 
 /*--------------------------------------------------------- */
@@ -0,0 +1,525 @@
+/*
+ * shell_image.c
+ *
+ * The compiled image of XML scheme. The image is built from the XML
+ * documents and it's used by the handlers of shell_xml.c instead of the
+ * documents. The saved image is mapped to the memory as is. All the
+ * references within image are the offsets so the image doesn't need
+ * any relocation.
+ */
+
+#include "image.h"
+#include "lub/string.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define CLISH_IMAGE_MAGIC "KLISHIMG"
+#define CLISH_IMAGE_VERSION 1
+#define CLISH_IMAGE_ORDER 0x01020304
+/* The limit of nesting of the loaded image. The check is recursive. */
+#define CLISH_IMAGE_DEPTH_MAX 256
+
+/* The header is at the beginning of image. The offsets are from the
+ * beginning of image. */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t order; /* Byte order mark */
+	uint32_t size; /* The size of whole image */
+	uint32_t root; /* The root element of the first file */
+	uint32_t path;
+	uint32_t files; /* The array of file name offsets */
+	uint32_t files_num;
+	uint32_t empty; /* The empty string */
+} clish_image_header_t;
+
+/* The offsets within the node are relative to the node itself.
+ * The zero offset means no node. */
+struct clish_imgnode_s {
+	int32_t name;
+	int32_t content;
+	int32_t parent;
+	int32_t child;
+	int32_t next;
+	uint32_t attrs_num;
+	int32_t attrs[]; /* The pairs of name and value */
+};
+
+struct clish_image_s {
+	char *data;
+	size_t len;
+	size_t size; /* The allocated size or 0 for mapped image */
+	uint32_t last_root;
+	uint32_t *files;
+	unsigned int files_num;
+	struct timespec mtime;
+};
+
+#define IMAGE_HEADER(image) ((clish_image_header_t *)(image)->data)
+#define IMAGE_NODE(image, pos) ((clish_imgnode_t *)((image)->data + (pos)))
+#define NODE_REF(node, off) ((off) ? \
+	(clish_imgnode_t *)((char *)(node) + (off)) : NULL)
+
+/*--------------------------------------------------------- */
+static uint32_t image_alloc(clish_image_t *this, size_t len)
+{
+	uint32_t pos;
+
+	/* The nodes are aligned to int32_t */
+	pos = (this->len + 3) & ~(size_t)3;
+	if (pos + len > this->size) {
+		size_t size = this->size ? this->size : 4096;
+		char *data;
+		while (pos + len > size)
+			size *= 2;
+		if (!(data = realloc(this->data, size)))
+			return 0;
+		this->data = data;
+		this->size = size;
+	}
+	memset(this->data + this->len, 0, pos + len - this->len);
+	this->len = pos + len;
+
+	return pos;
+}
+
+/*--------------------------------------------------------- */
+static uint32_t image_add_str(clish_image_t *this, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t pos;
+
+	if (!(pos = image_alloc(this, len)))
+		return 0;
+	memcpy(this->data + pos, str, len);
+
+	return pos;
+}
+
+/*--------------------------------------------------------- */
+static uint32_t image_add_node(clish_image_t *this,
+	clish_xmlnode_t *element, uint32_t parent)
+{
+	clish_xmlnode_t *child = NULL;
+	uint32_t pos;
+	uint32_t prev = 0;
+	uint32_t str;
+	unsigned int attrs_num = 0;
+	unsigned int i;
+	char *text;
+
+	while ((text = clish_xmlnode_fetch_attr_name(element, attrs_num))) {
+		clish_xml_release(text);
+		attrs_num++;
+	}
+	if (!(pos = image_alloc(this, sizeof(clish_imgnode_t) +
+		2 * attrs_num * sizeof(int32_t))))
+		return 0;
+	if (parent)
+		IMAGE_NODE(this, pos)->parent = parent - pos;
+
+	if (!(text = clish_xmlnode_get_all_name(element)))
+		return 0;
+	str = image_add_str(this, text);
+	free(text);
+	if (!str)
+		return 0;
+	IMAGE_NODE(this, pos)->name = str - pos;
+
+	/* The empty content is shared */
+	text = clish_xmlnode_get_all_content(element);
+	if (text && *text)
+		str = image_add_str(this, text);
+	else
+		str = IMAGE_HEADER(this)->empty;
+	free(text);
+	if (!str)
+		return 0;
+	IMAGE_NODE(this, pos)->content = str - pos;
+
+	/* The attributes without value are not stored */
+	for (i = 0; i < attrs_num; i++) {
+		char *name = clish_xmlnode_fetch_attr_name(element, i);
+		char *value = clish_xmlnode_fetch_attr(element, name);
+		uint32_t vstr = 0;
+		clish_imgnode_t *node;
+		if (value) {
+			str = image_add_str(this, name);
+			vstr = image_add_str(this, value);
+		}
+		clish_xml_release(name);
+		clish_xml_release(value);
+		if (!value)
+			continue;
+		if (!str || !vstr)
+			return 0;
+		node = IMAGE_NODE(this, pos);
+		node->attrs[2 * node->attrs_num] = str - pos;
+		node->attrs[2 * node->attrs_num + 1] = vstr - pos;
+		node->attrs_num++;
+	}
+
+	while ((child = clish_xmlnode_next_child(element, child)) != NULL) {
+		uint32_t cur;
+		if (clish_xmlnode_get_type(child) != CLISH_XMLNODE_ELM)
+			continue;
+		if (!(cur = image_add_node(this, child, pos)))
+			return 0;
+		if (prev)
+			IMAGE_NODE(this, prev)->next = cur - prev;
+		else
+			IMAGE_NODE(this, pos)->child = cur - pos;
+		prev = cur;
+	}
+
+	return pos;
+}
+
+/*--------------------------------------------------------- */
+/* The saved image is checked once on load so the accessors don't
+ * need any checks. The references go forward only (except parent)
+ * so the broken image can't make the loop. The nesting is limited so
+ * the broken image can't exhaust the stack.
+ */
+static bool_t image_check_str(const clish_image_t *this, uint32_t pos)
+{
+	return (pos >= sizeof(clish_image_header_t)) && (pos < this->len);
+}
+
+/*--------------------------------------------------------- */
+static bool_t image_check_node(const clish_image_t *this, uint32_t pos,
+	uint32_t parent, unsigned int depth)
+{
+	const clish_imgnode_t *node;
+	unsigned int i;
+
+	if (depth > CLISH_IMAGE_DEPTH_MAX)
+		return BOOL_FALSE;
+	while (pos) {
+		if ((pos & 3) || (pos < sizeof(clish_image_header_t)) ||
+			(pos + sizeof(*node) > this->len))
+			return BOOL_FALSE;
+		node = IMAGE_NODE(this, pos);
+		if ((node->attrs_num > (this->len - pos) / 8) ||
+			(pos + sizeof(*node) + 8 * node->attrs_num > this->len))
+			return BOOL_FALSE;
+		if ((parent ? parent - pos : 0) != (uint32_t)node->parent)
+			return BOOL_FALSE;
+		if (!image_check_str(this, pos + node->name) ||
+			!image_check_str(this, pos + node->content))
+			return BOOL_FALSE;
+		for (i = 0; i < 2 * node->attrs_num; i++)
+			if (!image_check_str(this, pos + node->attrs[i]))
+				return BOOL_FALSE;
+		if ((node->child < 0) || (node->next < 0))
+			return BOOL_FALSE;
+		if (node->child &&
+			!image_check_node(this, pos + node->child, pos,
+			depth + 1))
+			return BOOL_FALSE;
+		pos = node->next ? pos + node->next : 0;
+	}
+
+	return BOOL_TRUE;
+}
+
+/*--------------------------------------------------------- */
+static bool_t image_check(const clish_image_t *this)
+{
+	const clish_image_header_t *h = IMAGE_HEADER(this);
+	const uint32_t *files;
+	unsigned int i;
+
+	if ((this->len < sizeof(*h)) ||
+		memcmp(h->magic, CLISH_IMAGE_MAGIC, sizeof(h->magic)) ||
+		(h->version != CLISH_IMAGE_VERSION) ||
+		(h->order != CLISH_IMAGE_ORDER) ||
+		(h->size != this->len))
+		return BOOL_FALSE;
+	/* All the strings are terminated by the last byte */
+	if (this->data[this->len - 1] != '\0')
+		return BOOL_FALSE;
+	if (!image_check_str(this, h->path) ||
+		!image_check_str(this, h->empty))
+		return BOOL_FALSE;
+	if ((h->files & 3) || (h->files > this->len) ||
+		(h->files_num > (this->len - h->files) / sizeof(*files)))
+		return BOOL_FALSE;
+	files = (const uint32_t *)(this->data + h->files);
+	for (i = 0; i < h->files_num; i++)
+		if (!image_check_str(this, files[i]))
+			return BOOL_FALSE;
+
+	return image_check_node(this, h->root, 0, 0);
+}
+
+/*---------------------------------------------------------
+ * PUBLIC METHODS
+ *--------------------------------------------------------- */
+clish_image_t *clish_image_new(void)
+{
+	clish_image_t *this;
+	clish_image_header_t *h;
+
+	if (!(this = malloc(sizeof(*this))))
+		return NULL;
+	memset(this, 0, sizeof(*this));
+	/* The header is filled on save */
+	image_alloc(this, sizeof(*h) + 1);
+	if (!this->data) {
+		free(this);
+		return NULL;
+	}
+	h = IMAGE_HEADER(this);
+	h->empty = sizeof(*h);
+
+	return this;
+}
+
+/*--------------------------------------------------------- */
+clish_image_t *clish_image_load(const char *filename)
+{
+	clish_image_t *this;
+	struct stat st;
+	void *data;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return NULL;
+	if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) ||
+		(st.st_size < (off_t)sizeof(clish_image_header_t)) ||
+		(st.st_size > (off_t)INT32_MAX)) {
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == data)
+		return NULL;
+
+	if (!(this = malloc(sizeof(*this)))) {
+		munmap(data, st.st_size);
+		return NULL;
+	}
+	memset(this, 0, sizeof(*this));
+	this->data = data;
+	this->len = st.st_size;
+	this->mtime = st.st_mtim;
+	if (!image_check(this)) {
+		clish_image_free(this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*--------------------------------------------------------- */
+void clish_image_free(clish_image_t *this)
+{
+	if (!this)
+		return;
+	if (this->size)
+		free(this->data);
+	else
+		munmap(this->data, this->len);
+	free(this->files);
+	free(this);
+}
+
+/*--------------------------------------------------------- */
+int clish_image_add(clish_image_t *this, clish_xmlnode_t *root,
+	const char *filename)
+{
+	uint32_t *files;
+	uint32_t pos;
+
+	/* The mapped image is read-only */
+	if (!this->size)
+		return -1;
+
+	if (!(files = realloc(this->files,
+		(this->files_num + 1) * sizeof(*files))))
+		return -1;
+	this->files = files;
+	if (!(pos = image_add_str(this, filename)))
+		return -1;
+	this->files[this->files_num++] = pos;
+
+	/* The document may contain no elements */
+	if (!root || (clish_xmlnode_get_type(root) != CLISH_XMLNODE_ELM))
+		return 0;
+	if (!(pos = image_add_node(this, root, 0)))
+		return -1;
+	if (this->last_root)
+		IMAGE_NODE(this, this->last_root)->next = pos - this->last_root;
+	else
+		IMAGE_HEADER(this)->root = pos;
+	this->last_root = pos;
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+int clish_image_save(clish_image_t *this, const char *filename,
+	const char *path)
+{
+	clish_image_header_t *h;
+	char *tmpname = NULL;
+	uint32_t files;
+	uint32_t pos;
+	size_t done;
+	mode_t mask;
+	int fd;
+
+	if (!this->size)
+		return -1;
+
+	/* The path and the file list are at the end of image */
+	if (!(pos = image_add_str(this, path)))
+		return -1;
+	IMAGE_HEADER(this)->path = pos;
+	if (!(files = image_alloc(this,
+		this->files_num * sizeof(*this->files) + 1)))
+		return -1;
+	memcpy(this->data + files, this->files,
+		this->files_num * sizeof(*this->files));
+	h = IMAGE_HEADER(this);
+	memcpy(h->magic, CLISH_IMAGE_MAGIC, sizeof(h->magic));
+	h->version = CLISH_IMAGE_VERSION;
+	h->order = CLISH_IMAGE_ORDER;
+	h->size = this->len;
+	h->files = files;
+	h->files_num = this->files_num;
+
+	/* Replace the image atomically */
+	lub_string_cat(&tmpname, filename);
+	lub_string_cat(&tmpname, ".XXXXXX");
+	if ((fd = mkstemp(tmpname)) < 0) {
+		lub_string_free(tmpname);
+		return -1;
+	}
+	/* The mkstemp() creates file with 0600 mode */
+	mask = umask(0);
+	umask(mask);
+	if (fchmod(fd, 0666 & ~mask) < 0) {
+		close(fd);
+		unlink(tmpname);
+		lub_string_free(tmpname);
+		return -1;
+	}
+	for (done = 0; done < this->len; ) {
+		ssize_t ret = write(fd, this->data + done, this->len - done);
+		if (ret < 0)
+			break;
+		done += ret;
+	}
+	if ((done < this->len) || (fsync(fd) < 0) || (close(fd) < 0) ||
+		(rename(tmpname, filename) < 0)) {
+		unlink(tmpname);
+		lub_string_free(tmpname);
+		return -1;
+	}
+	lub_string_free(tmpname);
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* The file must be strictly older than image. So the file modified
+ * within the same second is considered as modified after image on the
+ * file systems with the coarse timestamps.
+ */
+bool_t clish_image_is_newer(const clish_image_t *this, const char *filename)
+{
+	struct stat st;
+
+	if (stat(filename, &st) < 0)
+		return BOOL_FALSE;
+	if (st.st_mtim.tv_sec != this->mtime.tv_sec)
+		return (st.st_mtim.tv_sec < this->mtime.tv_sec) ?
+			BOOL_TRUE : BOOL_FALSE;
+	return (st.st_mtim.tv_nsec < this->mtime.tv_nsec) ?
+		BOOL_TRUE : BOOL_FALSE;
+}
+
+/*--------------------------------------------------------- */
+clish_imgnode_t *clish_image__get_root(const clish_image_t *this)
+{
+	uint32_t root = IMAGE_HEADER(this)->root;
+
+	return root ? IMAGE_NODE(this, root) : NULL;
+}
+
+/*--------------------------------------------------------- */
+const char *clish_image__get_path(const clish_image_t *this)
+{
+	return this->data + IMAGE_HEADER(this)->path;
+}
+
+/*--------------------------------------------------------- */
+unsigned int clish_image__get_files_num(const clish_image_t *this)
+{
+	return IMAGE_HEADER(this)->files_num;
+}
+
+/*--------------------------------------------------------- */
+const char *clish_image__get_file(const clish_image_t *this,
+	unsigned int index)
+{
+	const uint32_t *files =
+		(const uint32_t *)(this->data + IMAGE_HEADER(this)->files);
+
+	if (index >= IMAGE_HEADER(this)->files_num)
+		return NULL;
+	return this->data + files[index];
+}
+
+/*--------------------------------------------------------- */
+const char *clish_imgnode__get_name(const clish_imgnode_t *this)
+{
+	return (const char *)this + this->name;
+}
+
+/*--------------------------------------------------------- */
+const char *clish_imgnode__get_content(const clish_imgnode_t *this)
+{
+	return (const char *)this + this->content;
+}
+
+/*--------------------------------------------------------- */
+const char *clish_imgnode__get_attr(const clish_imgnode_t *this,
+	const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < this->attrs_num; i++)
+		if (!strcmp((const char *)this + this->attrs[2 * i], name))
+			return (const char *)this + this->attrs[2 * i + 1];
+
+	return NULL;
+}
+
+/*--------------------------------------------------------- */
+clish_imgnode_t *clish_imgnode__get_parent(const clish_imgnode_t *this)
+{
+	return NODE_REF(this, this->parent);
+}
+
+/*--------------------------------------------------------- */
+clish_imgnode_t *clish_imgnode__get_child(const clish_imgnode_t *this)
+{
+	return NODE_REF(this, this->child);
+}
+
+/*--------------------------------------------------------- */
+clish_imgnode_t *clish_imgnode__get_next(const clish_imgnode_t *this)
+{
+	return NODE_REF(this, this->next);
+}
@@ -52,6 +52,22 @@ static inline clish_xmlnode_t *node_to_xmlnode(xmlNode *node)
 /*
  * public interface
  */
+/* The xmlCleanupParser() must not be called while other threads parse
+ * so the library is cleaned up at exit only.
+ */
+int clish_xml_init(void)
+{
+	static int initialized = 0;
+
+	if (!initialized) {
+		xmlInitParser();
+		atexit(xmlCleanupParser);
+		initialized = 1;
+	}
+
+	return 1;
+}
+
 clish_xmldoc_t *clish_xmldoc_read(const char *filename)
 {
 	xmlDoc *doc = xmlReadFile(filename, NULL, 0);
@@ -62,7 +78,6 @@ void clish_xmldoc_release(clish_xmldoc_t *doc)
 {
 	if (doc) {
 		xmlFreeDoc(xmldoc_to_doc(doc));
-		xmlCleanupParser();
 	}
 }
 
@@ -177,6 +192,27 @@ char *clish_xmlnode_fetch_attr(clish_xmlnode_t *node,
 	return NULL;
 }
 
+char *clish_xmlnode_fetch_attr_name(clish_xmlnode_t *node,
+					  unsigned int index)
+{
+	xmlNode *n;
+
+	if (!node)
+		return NULL;
+
+	n = xmlnode_to_node(node);
+
+	if (n->type == XML_ELEMENT_NODE) {
+		xmlAttr *a = n->properties;
+		while (a && index--)
+			a = a->next;
+		if (a)
+			return (char *)a->name;
+	}
+
+	return NULL;
+}
+
 int clish_xmlnode_get_content(clish_xmlnode_t *node, char *content, 
 			      unsigned int *contentlen)
 {
@@ -2,6 +2,7 @@
  * shell_new.c
  */
 #include "private.h"
+#include "image.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -62,6 +63,11 @@ static void clish_shell_init(clish_shell_t * this,
 	this->log = BOOL_FALSE; /* Disable logging by default */
 	this->log_facility = LOG_LOCAL0; /* LOCAL0 for compatibility */
 	this->user = lub_db_getpwuid(getuid()); /* Get user information */
+	this->imagev = NULL;
+	this->imagec = 0;
+	this->profile = NULL;
+	this->arenav = NULL;
+	this->arenac = 0;
 
 	/* Create internal ptypes and params */
 	/* Args */
@@ -133,6 +139,16 @@ static void clish_shell_fini(clish_shell_t * this)
 		unlink(this->fifo_name);
 		lub_string_free(this->fifo_name);
 	}
+
+	/* The images are freed after views because views refer to them */
+	for (i = 0; i < this->imagec; i++)
+		clish_image_free(this->imagev[i]);
+	free(this->imagev);
+	clish_profile_free(this->profile);
+	/* The frozen strings are freed after all the owners */
+	for (i = 0; i < this->arenac; i++)
+		lub_string_arena_free(this->arenav[i]);
+	free(this->arenav);
 }
 
 /*-------------------------------------------------------- */
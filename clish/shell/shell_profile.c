@@ -0,0 +1,297 @@
+/*
+ * shell_profile.c
+ *
+ * The startup profiling. The time and the heap growth are accumulated
+ * for the phases of scheme loading and for each XML element handler.
+ * The nested phases are subtracted so each slot reports its own cost.
+ * The report is JSON Lines like the konf tree export.
+ * The heap is taken from mallinfo() so it's glibc-specific and
+ * approximate.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "private.h"
+#include "lub/string.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(HAVE_MALLINFO2) || defined(HAVE_MALLINFO)
+#include <malloc.h>
+#endif
+
+typedef struct {
+	const char *name;
+	unsigned long count;
+	unsigned int active; /* The recursion depth */
+	long long wall; /* Own time, ns */
+	long long cpu;
+	long long total; /* The time including the nested phases, ns */
+	long long heap; /* Own heap growth, bytes */
+} clish_profile_slot_t;
+
+typedef struct {
+	char *name;
+	long long wall;
+	long long cpu;
+} clish_profile_file_t;
+
+struct clish_profile_s {
+	clish_profile_slot_t slots[CLISH_PROFILE_SLOTS];
+	clish_profile_mark_t *top; /* The innermost running phase */
+	clish_profile_file_t *filev;
+	unsigned int filec;
+	long long wall; /* The start of profiling */
+	long long cpu;
+	long long heap;
+};
+
+static const char *phase_names[CLISH_PROFILE_ELEMENT] = {
+	"load",
+	"scan",
+	"image",
+	"parse",
+	"build",
+	"regcomp",
+	"resolve",
+	"tinyrl",
+	"startup",
+	"freeze"
+};
+
+/*---------------------------------------------------------
+ * PRIVATE METHODS
+ *--------------------------------------------------------- */
+/* The heap in use including the mapped chunks. The loader threads
+ * allocate from their own arenas but mallinfo() can report the main
+ * arena only (see malloc(3) BUGS), so the "parse" bytes can be
+ * under-counted.
+ */
+static long long profile_heap(void)
+{
+#if defined(HAVE_MALLINFO2)
+	struct mallinfo2 mi = mallinfo2();
+	return (long long)mi.uordblks + (long long)mi.hblkhd;
+#elif defined(HAVE_MALLINFO)
+	struct mallinfo mi = mallinfo();
+	return (long long)(unsigned int)mi.uordblks +
+		(long long)(unsigned int)mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+/*--------------------------------------------------------- */
+static unsigned int profile_count_views(clish_shell_t *shell,
+	unsigned int *pending)
+{
+	lub_bintree_iterator_t iter;
+	clish_view_t *view;
+	unsigned int num = 0;
+
+	*pending = 0;
+	view = lub_bintree_findfirst(&shell->view_tree);
+	for (lub_bintree_iterator_init(&iter, &shell->view_tree, view);
+		view; view = lub_bintree_iterator_next(&iter)) {
+		num++;
+		if (clish_view__get_def_count(view))
+			(*pending)++;
+	}
+
+	return num;
+}
+
+/*--------------------------------------------------------- */
+static unsigned int profile_count(lub_bintree_t *tree)
+{
+	lub_bintree_iterator_t iter;
+	void *obj;
+	unsigned int num = 0;
+
+	obj = lub_bintree_findfirst(tree);
+	for (lub_bintree_iterator_init(&iter, tree, obj);
+		obj; obj = lub_bintree_iterator_next(&iter))
+		num++;
+
+	return num;
+}
+
+/*---------------------------------------------------------
+ * PUBLIC METHODS
+ *--------------------------------------------------------- */
+long long clish_profile_clock(clockid_t id)
+{
+	struct timespec ts;
+
+	if (clock_gettime(id, &ts) < 0)
+		return 0;
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*--------------------------------------------------------- */
+clish_profile_t *clish_profile_new(void)
+{
+	clish_profile_t *this;
+	unsigned int i;
+
+	if (!(this = calloc(1, sizeof(*this))))
+		return NULL;
+	for (i = 0; i < CLISH_PROFILE_ELEMENT; i++)
+		this->slots[i].name = phase_names[i];
+	this->wall = clish_profile_clock(CLOCK_MONOTONIC);
+	this->cpu = clish_profile_clock(CLOCK_PROCESS_CPUTIME_ID);
+	this->heap = profile_heap();
+
+	return this;
+}
+
+/*--------------------------------------------------------- */
+void clish_profile_free(clish_profile_t *this)
+{
+	unsigned int i;
+
+	if (!this)
+		return;
+	for (i = 0; i < this->filec; i++)
+		lub_string_free(this->filev[i].name);
+	free(this->filev);
+	free(this);
+}
+
+/*--------------------------------------------------------- */
+/* Start the phase. The mark lives on the caller's stack till the
+ * clish_profile_leave(). The name is needed for the element slots only.
+ */
+void clish_profile_enter(clish_profile_t *this, clish_profile_mark_t *mark,
+	unsigned int slot, const char *name)
+{
+	if (!this)
+		return;
+	assert(slot < CLISH_PROFILE_SLOTS);
+	if (name)
+		this->slots[slot].name = name;
+	this->slots[slot].active++;
+	mark->slot = slot;
+	mark->outer = this->top;
+	mark->child_wall = 0;
+	mark->child_cpu = 0;
+	mark->child_heap = 0;
+	this->top = mark;
+	mark->heap = profile_heap();
+	mark->cpu = clish_profile_clock(CLOCK_PROCESS_CPUTIME_ID);
+	mark->wall = clish_profile_clock(CLOCK_MONOTONIC);
+}
+
+/*--------------------------------------------------------- */
+void clish_profile_leave(clish_profile_t *this, clish_profile_mark_t *mark)
+{
+	clish_profile_slot_t *slot;
+	long long wall, cpu, heap;
+
+	if (!this)
+		return;
+	wall = clish_profile_clock(CLOCK_MONOTONIC) - mark->wall;
+	cpu = clish_profile_clock(CLOCK_PROCESS_CPUTIME_ID) - mark->cpu;
+	heap = profile_heap() - mark->heap;
+	assert(this->top == mark);
+	this->top = mark->outer;
+
+	slot = &this->slots[mark->slot];
+	slot->count++;
+	slot->wall += wall - mark->child_wall;
+	slot->cpu += cpu - mark->child_cpu;
+	slot->heap += heap - mark->child_heap;
+	/* The recursive phase is counted once within the total */
+	if (!--slot->active)
+		slot->total += wall;
+	if (mark->outer) {
+		mark->outer->child_wall += wall;
+		mark->outer->child_cpu += cpu;
+		mark->outer->child_heap += heap;
+	}
+}
+
+/*--------------------------------------------------------- */
+/* The files are parsed by the loader threads so the time is measured
+ * by the caller.
+ */
+void clish_profile_add_file(clish_profile_t *this, const char *filename,
+	long long wall, long long cpu)
+{
+	clish_profile_file_t *tmp;
+
+	if (!this)
+		return;
+	tmp = realloc(this->filev, (this->filec + 1) * sizeof(*tmp));
+	assert(tmp);
+	this->filev = tmp;
+	tmp = &this->filev[this->filec++];
+	tmp->name = lub_string_dup(filename);
+	tmp->wall = wall;
+	tmp->cpu = cpu;
+}
+
+/*--------------------------------------------------------- */
+void clish_shell__set_profile(clish_shell_t *this, bool_t profile)
+{
+	if (profile && !this->profile) {
+		this->profile = clish_profile_new();
+	} else if (!profile) {
+		clish_profile_free(this->profile);
+		this->profile = NULL;
+	}
+}
+
+/*--------------------------------------------------------- */
+/* Print the profile as JSON Lines. The times are in microseconds. */
+void clish_shell_profile_fprintf(clish_shell_t *this, FILE *stream)
+{
+	clish_profile_t *prof = this->profile;
+	unsigned int i;
+	unsigned int num;
+	unsigned int pending;
+
+	if (!prof)
+		return;
+
+	fprintf(stream, "{\"type\":\"total\",\"wall_us\":%lld,"
+		"\"cpu_us\":%lld,\"bytes\":%lld}\n",
+		(clish_profile_clock(CLOCK_MONOTONIC) - prof->wall) / 1000,
+		(clish_profile_clock(CLOCK_PROCESS_CPUTIME_ID) - prof->cpu) /
+		1000, profile_heap() - prof->heap);
+
+	for (i = 0; i < CLISH_PROFILE_SLOTS; i++) {
+		clish_profile_slot_t *slot = &prof->slots[i];
+		if (!slot->count)
+			continue;
+		fprintf(stream, "{\"type\":\"%s\",\"name\":",
+			(i < CLISH_PROFILE_ELEMENT) ? "phase" : "element");
+		lub_string_fprint_json(stream, slot->name);
+		fprintf(stream, ",\"count\":%lu,\"wall_us\":%lld,"
+			"\"cpu_us\":%lld,\"total_us\":%lld,\"bytes\":%lld}\n",
+			slot->count, slot->wall / 1000, slot->cpu / 1000,
+			slot->total / 1000, slot->heap);
+	}
+
+	for (i = 0; i < prof->filec; i++) {
+		fputs("{\"type\":\"file\",\"name\":", stream);
+		lub_string_fprint_json(stream, prof->filev[i].name);
+		fprintf(stream, ",\"wall_us\":%lld,\"cpu_us\":%lld}\n",
+			prof->filev[i].wall / 1000, prof->filev[i].cpu / 1000);
+	}
+
+	/* The views are built on demand so some of them are pending */
+	num = profile_count_views(this, &pending);
+	fprintf(stream, "{\"type\":\"objects\",\"name\":\"views\","
+		"\"count\":%u,\"pending\":%u}\n", num, pending);
+	fprintf(stream, "{\"type\":\"objects\",\"name\":\"ptypes\","
+		"\"count\":%u}\n", profile_count(&this->ptype_tree));
+	fprintf(stream, "{\"type\":\"objects\",\"name\":\"vars\","
+		"\"count\":%u}\n", profile_count(&this->var_tree));
+	fprintf(stream, "{\"type\":\"objects\",\"name\":\"strings\","
+		"\"bytes\":%zu}\n", clish_shell__get_frozen_size(this));
+}
@@ -13,6 +13,8 @@ void clish_shell__init_pwd(clish_shell_pwd_t *pwd)
 {
 	pwd->line = NULL;
 	pwd->view = NULL;
+	pwd->handle = 0;
+	pwd->handle_conn = 0;
 	/* initialise the tree of vars */
 	lub_bintree_init(&pwd->viewid,
 		clish_var_bt_offset(),
@@ -72,6 +74,9 @@ void clish_shell__set_pwd(clish_shell_t *this,
 	free(this->pwdv[index]);
 	this->pwdv[index] = newpwd;
 	this->depth = index;
+	/* The deeper paths are changed so their handles are stale */
+	for (i = index + 1; i < this->pwdc; i++)
+		this->pwdv[i]->handle = 0;
 }
 
 /*--------------------------------------------------------- */
@@ -116,6 +121,34 @@ clish_view_t *clish_shell__get_pwd_view(const clish_shell_t * this, unsigned int
 	return this->pwdv[index]->view;
 }
 
+/*--------------------------------------------------------- */
+/* The handle given on the previous connection is dropped. The daemon
+ * can be restarted or replaced in between.
+ */
+uint64_t clish_shell__get_pwd_handle(const clish_shell_t * this,
+	unsigned int index)
+{
+	if ((index >= this->pwdc) || !this->client)
+		return 0;
+	if (this->pwdv[index]->handle_conn !=
+		konf_client__get_connects(this->client))
+		return 0;
+
+	return this->pwdv[index]->handle;
+}
+
+/*--------------------------------------------------------- */
+void clish_shell__set_pwd_handle(clish_shell_t * this,
+	unsigned int index, uint64_t handle)
+{
+	if ((index >= this->pwdc) || !this->client)
+		return;
+
+	this->pwdv[index]->handle = handle;
+	this->pwdv[index]->handle_conn =
+		konf_client__get_connects(this->client);
+}
+
 /*--------------------------------------------------------- */
 konf_client_t *clish_shell__get_client(const clish_shell_t * this)
 {
@@ -151,6 +184,9 @@ int clish_shell__set_socket(clish_shell_t * this, const char * path)
 
 	konf_client_free(this->client);
 	this->client = konf_client_new(path);
+	/* Use shm transport if konfd supports it */
+	if (this->client)
+		konf_client__set_shm(this->client, BOOL_TRUE);
 
 	return 0;
 }
@@ -50,6 +50,14 @@ static inline clish_xmlnode_t *node_to_xmlnode(node_t *node)
 /*
  * public interface
  */
+/* The roxml_release(RELEASE_ALL) frees the data of all documents so
+ * the documents are read one by one.
+ */
+int clish_xml_init(void)
+{
+	return 0;
+}
+
 clish_xmldoc_t *clish_xmldoc_read(const char *filename)
 {
 	node_t *doc = roxml_load_doc((char*)filename);
@@ -227,6 +235,23 @@ char *clish_xmlnode_fetch_attr(clish_xmlnode_t *node,
 	return content;
 }
 
+char *clish_xmlnode_fetch_attr_name(clish_xmlnode_t *node,
+			       unsigned int index)
+{
+	node_t *roxn;
+	node_t *attr;
+
+	if (!node)
+		return NULL;
+
+	roxn = xmlnode_to_node(node);
+	attr = roxml_get_attr(roxn, NULL, index);
+	if (!attr)
+		return NULL;
+
+	return roxml_get_name(attr, NULL, 0);
+}
+
 static int i_get_content(node_t *n, char *v, unsigned int *vl)
 {
 	char *c;
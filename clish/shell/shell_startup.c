@@ -12,8 +12,10 @@ int clish_shell_startup(clish_shell_t *this)
 	const char *banner;
 	clish_context_t context;
 	int res = 0;
+	clish_profile_mark_t mark;
 
 	assert(this->startup);
+	clish_profile_enter(this->profile, &mark, CLISH_PROFILE_STARTUP, NULL);
 	banner = clish_command__get_detail(this->startup);
 	if (banner)
 		tinyrl_printf(this->tinyrl, "%s\n", banner);
@@ -26,6 +28,7 @@ int clish_shell_startup(clish_shell_t *this)
 		this->client_hooks->log_fn(&context, NULL, 0);
 	/* Call startup script */
 	res = clish_shell_execute(&context, NULL);
+	clish_profile_leave(this->profile, &mark);
 
 	return res;
 }
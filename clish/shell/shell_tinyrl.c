@@ -55,6 +55,7 @@ static bool_t clish_shell_tinyrl_key_help(tinyrl_t * this, int key)
 		/* get the context */
 		clish_context_t *context = tinyrl__get_context(this);
 
+		clish_nspace_proxies_idle();
 		tinyrl_crlf(this);
 		clish_shell_help(context->shell, tinyrl__get_line(this));
 		tinyrl_crlf(this);
@@ -158,6 +159,8 @@ static bool_t clish_shell_tinyrl_key_space(tinyrl_t * this, int key)
 	const clish_command_t *cmd = NULL;
 	clish_pargv_t *pargv = NULL;
 
+	/* No proxy command is referenced between the keys */
+	clish_nspace_proxies_idle();
 	if(tinyrl_is_empty(this)) {
 		/* ignore space at the begining of the line, don't display commands */
 		return BOOL_TRUE;
@@ -225,6 +228,7 @@ static bool_t clish_shell_tinyrl_key_enter(tinyrl_t *this, int key)
 	bool_t result = BOOL_FALSE;
 	char *errmsg = NULL;
 
+	clish_nspace_proxies_idle();
 	/* Inc line counter */
 	if (context->shell->current_file)
 		context->shell->current_file->line++;
@@ -362,11 +366,14 @@ char **clish_shell_tinyrl_completion(tinyrl_t * tinyrl,
 	lub_argv_t *matches;
 	clish_context_t *context = tinyrl__get_context(tinyrl);
 	clish_shell_t *this = context->shell;
-	clish_shell_iterator_t iter;
+	const clish_command_t **cmdv;
 	const clish_command_t *cmd = NULL;
 	char *text;
 	char **result = NULL;
+	unsigned int i;
 
+	/* The callers hold no proxy command here */
+	clish_nspace_proxies_idle();
 	if (tinyrl_is_quoting(tinyrl))
 		return result;
 
@@ -377,9 +384,10 @@ char **clish_shell_tinyrl_completion(tinyrl_t * tinyrl,
 	tinyrl_completion_over(tinyrl);
 
 	/* Search for COMMAND completions */
-	clish_shell_iterator_init(&iter, CLISH_NSPACE_COMPLETION);
-	while ((cmd = clish_shell_find_next_completion(this, text, &iter)))
-		lub_argv_add(matches, clish_command__get_suffix(cmd));
+	cmdv = clish_shell_find_completions(this, text, CLISH_NSPACE_COMPLETION);
+	for (i = 0; cmdv[i]; i++)
+		lub_argv_add(matches, clish_command__get_suffix(cmdv[i]));
+	free(cmdv);
 
 	/* Try and resolve a command */
 	cmd = clish_shell_resolve_command(this, text);
@@ -391,7 +399,6 @@ char **clish_shell_tinyrl_completion(tinyrl_t * tinyrl,
 
 	/* Matches were found */
 	if (lub_argv__get_count(matches) > 0) {
-		unsigned i;
 		char *subst = lub_string_dup(lub_argv__get_arg(matches, 0));
 		/* Find out substitution */
 		for (i = 1; i < lub_argv__get_count(matches); i++) {
@@ -488,6 +495,9 @@ static int clish_shell_execline(clish_shell_t *this, const char *line, char **ou
 		return -1;
 	}
 
+	/* No proxy command is referenced between the lines */
+	clish_nspace_trim_proxies(CLISH_NSPACE_PROXY_MAX);
+
 	/* Renew prompt */
 	clish_shell_renew_prompt(this);
 
@@ -618,13 +628,24 @@ int clish_shell__save_history(const clish_shell_t *this, const char *fname)
 /*----------------------------------------------------------*/
 int clish_shell__restore_history(clish_shell_t *this, const char *fname)
 {
-	return tinyrl__restore_history(this->tinyrl, fname);
+	clish_profile_mark_t mark;
+	int res;
+
+	clish_profile_enter(this->profile, &mark, CLISH_PROFILE_TINYRL, NULL);
+	res = tinyrl__restore_history(this->tinyrl, fname);
+	clish_profile_leave(this->profile, &mark);
+
+	return res;
 }
 
 /*----------------------------------------------------------*/
 void clish_shell__stifle_history(clish_shell_t *this, unsigned int stifle)
 {
+	clish_profile_mark_t mark;
+
+	clish_profile_enter(this->profile, &mark, CLISH_PROFILE_TINYRL, NULL);
 	tinyrl__stifle_history(this->tinyrl, stifle);
+	clish_profile_leave(this->profile, &mark);
 }
 
 /*-------------------------------------------------------- */
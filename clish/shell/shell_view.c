@@ -28,7 +28,12 @@ clish_view_t *clish_shell_find_create_view(clish_shell_t * this,
 /*--------------------------------------------------------- */
 clish_view_t *clish_shell_find_view(clish_shell_t * this, const char *name)
 {
-	return lub_bintree_find(&this->view_tree, name);
+	clish_view_t *view = lub_bintree_find(&this->view_tree, name);
+
+	/* The view content is built on first use */
+	if (view)
+		clish_shell_build_view(this, view);
+	return view;
 }
 
 /*--------------------------------------------------------- */
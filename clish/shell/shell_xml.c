@@ -6,8 +6,13 @@
  * CLI tree based on the contents.
  * ------------------------------------------------------
  */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "private.h"
 #include "xmlapi.h"
+#include "image.h"
 #include "lub/string.h"
 #include "lub/ctype.h"
 #include "lub/system.h"
@@ -17,9 +22,16 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* The max number of threads to parse XML files */
+#define CLISH_LOAD_THREADS_MAX 8
 
 typedef void (PROCESS_FN) (clish_shell_t * instance,
-	clish_xmlnode_t * element, void *parent);
+	clish_imgnode_t * element, void *parent);
 
 /* Define a control block for handling the decode of an XML file */
 typedef struct clish_xml_cb_s clish_xml_cb_t;
@@ -68,115 +80,41 @@ static clish_xml_cb_t xml_elements[] = {
  */
 const char *default_path = "/etc/clish;~/.clish";
 
-/*-------------------------------------------------------- */
-void clish_shell_load_scheme(clish_shell_t *this, const char *xml_path)
-{
-	const char *path = xml_path;
-	char *buffer;
-	char *dirname;
-	char *saveptr = NULL;
-
-	/* use the default path */
-	if (!path)
-		path = default_path;
-	/* take a copy of the path */
-	buffer = lub_system_tilde_expand(path);
-
-	/* now loop though each directory */
-	for (dirname = strtok_r(buffer, ";", &saveptr);
-		dirname; dirname = strtok_r(NULL, ";", &saveptr)) {
-		DIR *dir;
-		struct dirent *entry;
-
-		/* search this directory for any XML files */
-		dir = opendir(dirname);
-		if (NULL == dir) {
-#ifdef DEBUG
-			tinyrl_printf(this->tinyrl,
-				"*** Failed to open '%s' directory\n",
-				dirname);
-#endif
-			continue;
-		}
-		for (entry = readdir(dir); entry; entry = readdir(dir)) {
-			const char *extension = strrchr(entry->d_name, '.');
-			/* check the filename */
-			if ((NULL != extension) &&
-				(0 == strcmp(".xml", extension))) {
-				char *filename = NULL;
-
-				/* build the filename */
-				lub_string_cat(&filename, dirname);
-				lub_string_cat(&filename, "/");
-				lub_string_cat(&filename, entry->d_name);
-
-#ifdef DEBUG
-				fprintf(stderr, "Parse XML-file: %s\n", filename);
-#endif
-				/* load this file */
-				(void)clish_shell_xml_read(this, filename);
-
-				/* release the resource */
-				lub_string_free(filename);
-			}
-		}
-		/* all done for this directory */
-		closedir(dir);
-	}
-	/* tidy up */
-	lub_string_free(buffer);
-#ifdef DEBUG
-	clish_shell_dump(this);
-#endif
-}
-
 /*
  * ------------------------------------------------------
  * This function reads an element from the XML stream and processes it.
  * ------------------------------------------------------
  */
-static void process_node(clish_shell_t * shell, clish_xmlnode_t * node, void *parent)
-{
-	switch (clish_xmlnode_get_type(node)) {
-	case CLISH_XMLNODE_ELM: {
-			clish_xml_cb_t * cb;
-			char name[128];
-			unsigned int namelen = sizeof(name);
-			if (clish_xmlnode_get_name(node, name, &namelen) == 0) {
-				for (cb = &xml_elements[0]; cb->element; cb++) {
-					if (0 == strcmp(name, cb->element)) {
+static void process_node(clish_shell_t * shell, clish_imgnode_t * node, void *parent)
+{
+	clish_xml_cb_t * cb;
+	const char *name = clish_imgnode__get_name(node);
+	clish_profile_mark_t mark;
+
+	for (cb = &xml_elements[0]; cb->element; cb++) {
+		if (0 == strcmp(name, cb->element)) {
 #ifdef DEBUG
-						fprintf(stderr, "NODE:");
-						clish_xmlnode_print(node, stderr);
-						fprintf(stderr, "\n");
+			fprintf(stderr, "NODE: <%s>\n", name);
 #endif
-						/* process the elements at this level */
-						cb->handler(shell, node, parent);
-						break;
-					}
-				}
-			}
+			/* process the elements at this level */
+			clish_profile_enter(shell->profile, &mark,
+				CLISH_PROFILE_ELEMENT + (cb - xml_elements),
+				cb->element);
+			cb->handler(shell, node, parent);
+			clish_profile_leave(shell->profile, &mark);
 			break;
 		}
-	case CLISH_XMLNODE_DOC:
-	case CLISH_XMLNODE_TEXT:
-	case CLISH_XMLNODE_ATTR:
-	case CLISH_XMLNODE_PI:
-	case CLISH_XMLNODE_COMMENT:
-	case CLISH_XMLNODE_DECL:
-	case CLISH_XMLNODE_UNKNOWN:
-	default:
-		break;
 	}
 }
 
 /* ------------------------------------------------------ */
 static void process_children(clish_shell_t * shell,
-	clish_xmlnode_t * element, void *parent)
+	clish_imgnode_t * element, void *parent)
 {
-	clish_xmlnode_t *node = NULL;
+	clish_imgnode_t *node;
 
-	while ((node = clish_xmlnode_next_child(element, node)) != NULL) {
+	for (node = clish_imgnode__get_child(element); node;
+		node = clish_imgnode__get_next(node)) {
 		/* Now deal with all the contained elements */
 		process_node(shell, node, parent);
 	}
@@ -184,7 +122,7 @@ static void process_children(clish_shell_t * shell,
 
 /* ------------------------------------------------------ */
 static void
-process_clish_module(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
+process_clish_module(clish_shell_t * shell, clish_imgnode_t * element, void *parent)
 {
 	// create the global view
 	if (!shell->global)
@@ -196,16 +134,16 @@ process_clish_module(clish_shell_t * shell, clish_xmlnode_t * element, void *par
 }
 
 /* ------------------------------------------------------ */
-static void process_view(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
+static void process_view(clish_shell_t * shell, clish_imgnode_t * element, void *parent)
 {
 	clish_view_t *view;
 	int allowed = 1;
 
-	char *name = clish_xmlnode_fetch_attr(element, "name");
-	char *prompt = clish_xmlnode_fetch_attr(element, "prompt");
-	char *depth = clish_xmlnode_fetch_attr(element, "depth");
-	char *restore = clish_xmlnode_fetch_attr(element, "restore");
-	char *access = clish_xmlnode_fetch_attr(element, "access");
+	const char *name = clish_imgnode__get_attr(element, "name");
+	const char *prompt = clish_imgnode__get_attr(element, "prompt");
+	const char *depth = clish_imgnode__get_attr(element, "depth");
+	const char *restore = clish_imgnode__get_attr(element, "restore");
+	const char *access = clish_imgnode__get_attr(element, "access");
 
 	/* Check permissions */
 	if (access) {
@@ -235,30 +173,27 @@ static void process_view(clish_shell_t * shell, clish_xmlnode_t * element, void
 			clish_view__set_restore(view, CLISH_RESTORE_NONE);
 	}
 
-	process_children(shell, element, view);
+	/* The commands are built on first use of view */
+	clish_view_insert_def(view, element);
 
 process_view_end:
-	clish_xml_release(name);
-	clish_xml_release(prompt);
-	clish_xml_release(depth);
-	clish_xml_release(restore);
-	clish_xml_release(access);
 
 	parent = parent; /* Happy compiler */
 }
 
 /* ------------------------------------------------------ */
-static void process_ptype(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
+static void process_ptype(clish_shell_t * shell, clish_imgnode_t * element, void *parent)
 {
 	clish_ptype_method_e method;
 	clish_ptype_preprocess_e preprocess;
 	clish_ptype_t *ptype;
+	clish_profile_mark_t mark;
 
-	char *name = clish_xmlnode_fetch_attr(element, "name");
-	char *help = clish_xmlnode_fetch_attr(element, "help");
-	char *pattern = clish_xmlnode_fetch_attr(element, "pattern");
-	char *method_name = clish_xmlnode_fetch_attr(element, "method");
-	char *preprocess_name =	clish_xmlnode_fetch_attr(element, "preprocess");
+	const char *name = clish_imgnode__get_attr(element, "name");
+	const char *help = clish_imgnode__get_attr(element, "help");
+	const char *pattern = clish_imgnode__get_attr(element, "pattern");
+	const char *method_name = clish_imgnode__get_attr(element, "method");
+	const char *preprocess_name =	clish_imgnode__get_attr(element, "preprocess");
 
 	assert(name);
 	assert(pattern);
@@ -266,63 +201,36 @@ static void process_ptype(clish_shell_t * shell, clish_xmlnode_t * element, void
 	method = clish_ptype_method_resolve(method_name);
 
 	preprocess = clish_ptype_preprocess_resolve(preprocess_name);
+	/* The regexp is compiled while the ptype is created */
+	if (CLISH_PTYPE_REGEXP == method)
+		clish_profile_enter(shell->profile, &mark,
+			CLISH_PROFILE_REGCOMP, NULL);
 	ptype = clish_shell_find_create_ptype(shell,
 		name, help, pattern, method, preprocess);
+	if (CLISH_PTYPE_REGEXP == method)
+		clish_profile_leave(shell->profile, &mark);
 
 	assert(ptype);
 
-	clish_xml_release(name);
-	clish_xml_release(help);
-	clish_xml_release(pattern);
-	clish_xml_release(method_name);
-	clish_xml_release(preprocess_name);
 
 	parent = parent; /* Happy compiler */
 }
 
 /* ------------------------------------------------------ */
-static void process_overview(clish_shell_t *shell, clish_xmlnode_t *element,
+static void process_overview(clish_shell_t *shell, clish_imgnode_t *element,
 	void *parent)
 {
-	char *content = NULL;
-	unsigned int content_len = 2048;
-	int result;
-
-	/*
-	 * the code below faithfully assume that we'll be able fully store
-	 * the content of the node. If it's really, really big, we may have
-	 * an issue (but then, if it's that big, how the hell does it
-	 * already fits in allocated memory?)
-	 * Ergo, it -should- be safe.
-	 */
-	do {
-		char *new = (char*)realloc(content, content_len);
-		if (!new) {
-			if (content)
-				free(content);
-			return;
-		}
-		content = new;
-		result = clish_xmlnode_get_content(element, content,
-			&content_len);
-	} while (result == -E2BIG);
-
-	if (result == 0 && content) {
-		/* set the overview text for this view */
-		assert(NULL == shell->overview);
-		/* store the overview */
-		shell->overview = lub_string_dup(content);
-	}
-
-	if (content)
-		free(content);
+	/* set the overview text for this view */
+	assert(NULL == shell->overview);
+	/* store the overview */
+	shell->overview = lub_string_dup(clish_imgnode__get_content(element));
 
 	parent = parent; /* Happy compiler */
 }
 
 /* ------------------------------------------------------ */
 static void
-process_command(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
+process_command(clish_shell_t * shell, clish_imgnode_t * element, void *parent)
 {
 	clish_view_t *v = (clish_view_t *) parent;
 	clish_command_t *cmd = NULL;
@@ -330,18 +238,19 @@ process_command(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
 	char *alias_name = NULL;
 	clish_view_t *alias_view = NULL;
 	int allowed = 1;
-
-	char *access = clish_xmlnode_fetch_attr(element, "access");
-	char *name = clish_xmlnode_fetch_attr(element, "name");
-	char *help = clish_xmlnode_fetch_attr(element, "help");
-	char *view = clish_xmlnode_fetch_attr(element, "view");
-	char *viewid = clish_xmlnode_fetch_attr(element, "viewid");
-	char *escape_chars = clish_xmlnode_fetch_attr(element, "escape_chars");
-	char *args_name = clish_xmlnode_fetch_attr(element, "args");
-	char *args_help = clish_xmlnode_fetch_attr(element, "args_help");
-	char *lock = clish_xmlnode_fetch_attr(element, "lock");
-	char *interrupt = clish_xmlnode_fetch_attr(element, "interrupt");
-	char *ref = clish_xmlnode_fetch_attr(element, "ref");
+	clish_profile_mark_t mark;
+
+	const char *access = clish_imgnode__get_attr(element, "access");
+	const char *name = clish_imgnode__get_attr(element, "name");
+	const char *help = clish_imgnode__get_attr(element, "help");
+	const char *view = clish_imgnode__get_attr(element, "view");
+	const char *viewid = clish_imgnode__get_attr(element, "viewid");
+	const char *escape_chars = clish_imgnode__get_attr(element, "escape_chars");
+	const char *args_name = clish_imgnode__get_attr(element, "args");
+	const char *args_help = clish_imgnode__get_attr(element, "args_help");
+	const char *lock = clish_imgnode__get_attr(element, "lock");
+	const char *interrupt = clish_imgnode__get_attr(element, "interrupt");
+	const char *ref = clish_imgnode__get_attr(element, "ref");
 
 	/* Check permissions */
 	if (access) {
@@ -381,11 +290,16 @@ process_command(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
 		}
 		alias_name = lub_string_dup(cmdn);
 		view_name = strtok_r(NULL, delim, &saveptr);
+		clish_profile_enter(shell->profile, &mark,
+			CLISH_PROFILE_RESOLVE, NULL);
 		if (!view_name)
 			alias_view = v;
 		else
 			alias_view = clish_shell_find_create_view(shell,
 				view_name, NULL);
+		/* The alias is resolved within the built view */
+		clish_shell_build_view(shell, alias_view);
+		clish_profile_leave(shell->profile, &mark);
 		lub_string_free(str);
 	}
 
@@ -442,33 +356,22 @@ process_command(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
 	process_children(shell, element, cmd);
 
 process_command_end:
-	clish_xml_release(access);
-	clish_xml_release(name);
-	clish_xml_release(help);
-	clish_xml_release(view);
-	clish_xml_release(viewid);
-	clish_xml_release(escape_chars);
-	clish_xml_release(args_name);
-	clish_xml_release(args_help);
-	clish_xml_release(lock);
-	clish_xml_release(interrupt);
-	clish_xml_release(ref);
 }
 
 /* ------------------------------------------------------ */
 static void
-process_startup(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
+process_startup(clish_shell_t * shell, clish_imgnode_t * element, void *parent)
 {
 	clish_view_t *v = (clish_view_t *) parent;
 	clish_command_t *cmd = NULL;
 
-	char *view = clish_xmlnode_fetch_attr(element, "view");
-	char *viewid = clish_xmlnode_fetch_attr(element, "viewid");
-	char *default_shebang =
-		clish_xmlnode_fetch_attr(element, "default_shebang");
-	char *timeout = clish_xmlnode_fetch_attr(element, "timeout");
-	char *lock = clish_xmlnode_fetch_attr(element, "lock");
-	char *interrupt = clish_xmlnode_fetch_attr(element, "interrupt");
+	const char *view = clish_imgnode__get_attr(element, "view");
+	const char *viewid = clish_imgnode__get_attr(element, "viewid");
+	const char *default_shebang =
+		clish_imgnode__get_attr(element, "default_shebang");
+	const char *timeout = clish_imgnode__get_attr(element, "timeout");
+	const char *lock = clish_imgnode__get_attr(element, "lock");
+	const char *interrupt = clish_imgnode__get_attr(element, "interrupt");
 
 	assert(!shell->startup);
 
@@ -506,49 +409,37 @@ process_startup(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
 	/* remember this command */
 	shell->startup = cmd;
 
-	clish_xml_release(view);
-	clish_xml_release(viewid);
-	clish_xml_release(default_shebang);
-	clish_xml_release(timeout);
-	clish_xml_release(lock);
-	clish_xml_release(interrupt);
 
 	process_children(shell, element, cmd);
 }
 
 /* ------------------------------------------------------ */
 static void
-process_param(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
+process_param(clish_shell_t * shell, clish_imgnode_t * element, void *parent)
 {
 	clish_command_t *cmd = NULL;
 	clish_param_t *p_param = NULL;
-	clish_xmlnode_t *pelement;
-	char *pname;
+	clish_imgnode_t *pelement = clish_imgnode__get_parent(element);
 
-	pelement = clish_xmlnode_parent(element);
-	pname = clish_xmlnode_get_all_name(pelement);
-
-	if (pname && lub_string_nocasecmp(pname, "PARAM") == 0)
+	if (pelement && lub_string_nocasecmp(
+		clish_imgnode__get_name(pelement), "PARAM") == 0)
 		p_param = (clish_param_t *)parent;
 	else
 		cmd = (clish_command_t *)parent;
 
-	if (pname)
-		free(pname);
-
 	if (cmd || p_param) {
-		char *name = clish_xmlnode_fetch_attr(element, "name");
-		char *help = clish_xmlnode_fetch_attr(element, "help");
-		char *ptype = clish_xmlnode_fetch_attr(element, "ptype");
-		char *prefix = clish_xmlnode_fetch_attr(element, "prefix");
-		char *defval = clish_xmlnode_fetch_attr(element, "default");
-		char *mode = clish_xmlnode_fetch_attr(element, "mode");
-		char *optional = clish_xmlnode_fetch_attr(element, "optional");
-		char *order = clish_xmlnode_fetch_attr(element, "order");
-		char *value = clish_xmlnode_fetch_attr(element, "value");
-		char *hidden = clish_xmlnode_fetch_attr(element, "hidden");
-		char *test = clish_xmlnode_fetch_attr(element, "test");
-		char *completion = clish_xmlnode_fetch_attr(element, "completion");
+		const char *name = clish_imgnode__get_attr(element, "name");
+		const char *help = clish_imgnode__get_attr(element, "help");
+		const char *ptype = clish_imgnode__get_attr(element, "ptype");
+		const char *prefix = clish_imgnode__get_attr(element, "prefix");
+		const char *defval = clish_imgnode__get_attr(element, "default");
+		const char *mode = clish_imgnode__get_attr(element, "mode");
+		const char *optional = clish_imgnode__get_attr(element, "optional");
+		const char *order = clish_imgnode__get_attr(element, "order");
+		const char *value = clish_imgnode__get_attr(element, "value");
+		const char *hidden = clish_imgnode__get_attr(element, "hidden");
+		const char *test = clish_imgnode__get_attr(element, "test");
+		const char *completion = clish_imgnode__get_attr(element, "completion");
 		clish_param_t *param;
 		clish_ptype_t *tmp = NULL;
 
@@ -665,100 +556,77 @@ process_param(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
 		if (p_param)
 			clish_param_insert_param(p_param, param);
 
-		clish_xml_release(name);
-		clish_xml_release(help);
-		clish_xml_release(ptype);
-		clish_xml_release(prefix);
-		clish_xml_release(defval);
-		clish_xml_release(mode);
-		clish_xml_release(optional);
-		clish_xml_release(order);
-		clish_xml_release(value);
-		clish_xml_release(hidden);
-		clish_xml_release(test);
-		clish_xml_release(completion);
 
 		process_children(shell, element, param);
 	}
 }
 
 /* ------------------------------------------------------ */
-static void process_action(clish_shell_t *shell, clish_xmlnode_t *element,
+static void process_action(clish_shell_t *shell, clish_imgnode_t *element,
 	void *parent)
 {
 	clish_action_t *action = NULL;
-	char *builtin = clish_xmlnode_fetch_attr(element, "builtin");
-	char *shebang = clish_xmlnode_fetch_attr(element, "shebang");
-	clish_xmlnode_t *pelement = clish_xmlnode_parent(element);
-	char *pname = clish_xmlnode_get_all_name(pelement);
-	char *text;
+	const char *builtin = clish_imgnode__get_attr(element, "builtin");
+	const char *shebang = clish_imgnode__get_attr(element, "shebang");
+	clish_imgnode_t *pelement = clish_imgnode__get_parent(element);
+	const char *text = clish_imgnode__get_content(element);
 
-	if (pname && lub_string_nocasecmp(pname, "VAR") == 0)
+	if (pelement && lub_string_nocasecmp(
+		clish_imgnode__get_name(pelement), "VAR") == 0)
 		action = clish_var__get_action((clish_var_t *)parent);
 	else
 		action = clish_command__get_action((clish_command_t *)parent);
 	assert(action);
 
-	if (pname)
-		free(pname);
-
-	text = clish_xmlnode_get_all_content(element);
-
-	if (text && *text) {
+	if (*text) {
 		/* store the action */
 		clish_action__set_script(action, text);
 	}
-	if (text)
-		free(text);
 
 	if (builtin)
 		clish_action__set_builtin(action, builtin);
 	if (shebang)
 		clish_action__set_shebang(action, shebang);
 
-	clish_xml_release(builtin);
-	clish_xml_release(shebang);
 
 	shell = shell; /* Happy compiler */
 }
 
 /* ------------------------------------------------------ */
-static void process_detail(clish_shell_t *shell, clish_xmlnode_t *element,
+static void process_detail(clish_shell_t *shell, clish_imgnode_t *element,
 	void *parent)
 {
 	clish_command_t *cmd = (clish_command_t *) parent;
 
 	/* read the following text element */
-	char *text = clish_xmlnode_get_all_content(element);
+	const char *text = clish_imgnode__get_content(element);
 
-	if (text && *text) {
+	if (*text) {
 		/* store the action */
 		clish_command__set_detail(cmd, text);
 	}
 
-	if (text)
-		free(text);
-
 	shell = shell; /* Happy compiler */
 }
 
 /* ------------------------------------------------------ */
 static void
-process_namespace(clish_shell_t * shell, clish_xmlnode_t * element, void *parent)
+process_namespace(clish_shell_t * shell, clish_imgnode_t * element, void *parent)
 {
 	clish_view_t *v = (clish_view_t *) parent;
 	clish_nspace_t *nspace = NULL;
 
-	char *view = clish_xmlnode_fetch_attr(element, "ref");
-	char *prefix = clish_xmlnode_fetch_attr(element, "prefix");
-	char *prefix_help = clish_xmlnode_fetch_attr(element, "prefix_help");
-	char *help = clish_xmlnode_fetch_attr(element, "help");
-	char *completion = clish_xmlnode_fetch_attr(element, "completion");
-	char *context_help = clish_xmlnode_fetch_attr(element, "context_help");
-	char *inherit = clish_xmlnode_fetch_attr(element, "inherit");
-	char *access = clish_xmlnode_fetch_attr(element, "access");
+	const char *view = clish_imgnode__get_attr(element, "ref");
+	const char *prefix = clish_imgnode__get_attr(element, "prefix");
+	const char *prefix_help = clish_imgnode__get_attr(element, "prefix_help");
+	const char *help = clish_imgnode__get_attr(element, "help");
+	const char *completion = clish_imgnode__get_attr(element, "completion");
+	const char *context_help = clish_imgnode__get_attr(element, "context_help");
+	const char *inherit = clish_imgnode__get_attr(element, "inherit");
+	const char *access = clish_imgnode__get_attr(element, "access");
 
 	int allowed = 1;
+	clish_profile_mark_t mark;
 
 	if (access) {
 		allowed = 0;
@@ -769,13 +637,19 @@ process_namespace(clish_shell_t * shell, clish_xmlnode_t * element, void *parent
 		goto process_namespace_end;
 
 	assert(view);
+	clish_profile_enter(shell->profile, &mark, CLISH_PROFILE_RESOLVE, NULL);
 	clish_view_t *ref_view = clish_shell_find_create_view(shell,
 		view, NULL);
 	assert(ref_view);
 
 	/* Don't include itself without prefix */
-	if ((ref_view == v) && !prefix)
+	if ((ref_view == v) && !prefix) {
+		clish_profile_leave(shell->profile, &mark);
 		goto process_namespace_end;
+	}
+
+	/* The imported commands are needed when the view is used */
+	clish_shell_build_view(shell, ref_view);
 
 	nspace = clish_nspace_new(ref_view);
 	assert(nspace);
@@ -792,6 +666,7 @@ process_namespace(clish_shell_t * shell, clish_xmlnode_t * element, void *parent
 				"prefix",
 				"Prefix for the imported commands.");
 	}
+	clish_profile_leave(shell->profile, &mark);
 
 	if (help && lub_string_nocasecmp(help, "true") == 0)
 		clish_nspace__set_help(nspace, BOOL_TRUE);
@@ -814,18 +689,10 @@ process_namespace(clish_shell_t * shell, clish_xmlnode_t * element, void *parent
 		clish_nspace__set_inherit(nspace, BOOL_TRUE);
 
 process_namespace_end:
-	clish_xml_release(view);
-	clish_xml_release(prefix);
-	clish_xml_release(prefix_help);
-	clish_xml_release(help);
-	clish_xml_release(completion);
-	clish_xml_release(context_help);
-	clish_xml_release(inherit);
-	clish_xml_release(access);
 }
 
 /* ------------------------------------------------------ */
-static void process_config(clish_shell_t *shell, clish_xmlnode_t *element,
+static void process_config(clish_shell_t *shell, clish_imgnode_t *element,
 	void *parent)
 {
 	clish_command_t *cmd = (clish_command_t *)parent;
@@ -836,14 +703,14 @@ static void process_config(clish_shell_t *shell, clish_xmlnode_t *element,
 	config = clish_command__get_config(cmd);
 
 	/* read the following text element */
-	char *operation = clish_xmlnode_fetch_attr(element, "operation");
-	char *priority = clish_xmlnode_fetch_attr(element, "priority");
-	char *pattern = clish_xmlnode_fetch_attr(element, "pattern");
-	char *file = clish_xmlnode_fetch_attr(element, "file");
-	char *splitter = clish_xmlnode_fetch_attr(element, "splitter");
-	char *seq = clish_xmlnode_fetch_attr(element, "sequence");
-	char *unique = clish_xmlnode_fetch_attr(element, "unique");
-	char *depth = clish_xmlnode_fetch_attr(element, "depth");
+	const char *operation = clish_imgnode__get_attr(element, "operation");
+	const char *priority = clish_imgnode__get_attr(element, "priority");
+	const char *pattern = clish_imgnode__get_attr(element, "pattern");
+	const char *file = clish_imgnode__get_attr(element, "file");
+	const char *splitter = clish_imgnode__get_attr(element, "splitter");
+	const char *seq = clish_imgnode__get_attr(element, "sequence");
+	const char *unique = clish_imgnode__get_attr(element, "unique");
+	const char *depth = clish_imgnode__get_attr(element, "depth");
 
 	if (operation && !lub_string_nocasecmp(operation, "unset"))
 		clish_config__set_op(config, CLISH_CONFIG_UNSET);
@@ -901,26 +768,18 @@ static void process_config(clish_shell_t *shell, clish_xmlnode_t *element,
 	if (depth)
 		clish_config__set_depth(config, depth);
 
-	clish_xml_release(operation);
-	clish_xml_release(priority);
-	clish_xml_release(pattern);
-	clish_xml_release(file);
-	clish_xml_release(splitter);
-	clish_xml_release(seq);
-	clish_xml_release(unique);
-	clish_xml_release(depth);
 
 	shell = shell; /* Happy compiler */
 }
 
 /* ------------------------------------------------------ */
-static void process_var(clish_shell_t *shell, clish_xmlnode_t *element,
+static void process_var(clish_shell_t *shell, clish_imgnode_t *element,
 	void *parent)
 {
 	clish_var_t *var = NULL;
-	char *name = clish_xmlnode_fetch_attr(element, "name");
-	char *dynamic = clish_xmlnode_fetch_attr(element, "dynamic");
-	char *value = clish_xmlnode_fetch_attr(element, "value");
+	const char *name = clish_imgnode__get_attr(element, "name");
+	const char *dynamic = clish_imgnode__get_attr(element, "dynamic");
+	const char *value = clish_imgnode__get_attr(element, "value");
 
 	assert(name);
 
@@ -941,9 +800,6 @@ static void process_var(clish_shell_t *shell, clish_xmlnode_t *element,
 	if (value)
 		clish_var__set_value(var, value);
 
-	clish_xml_release(name);
-	clish_xml_release(dynamic);
-	clish_xml_release(value);
 
 	process_children(shell, element, var);
 
@@ -952,7 +808,7 @@ static void process_var(clish_shell_t *shell, clish_xmlnode_t *element,
 
 /* ------------------------------------------------------ */
 static void process_wdog(clish_shell_t *shell,
-	clish_xmlnode_t *element, void *parent)
+	clish_imgnode_t *element, void *parent)
 {
 	clish_view_t *v = (clish_view_t *)parent;
 	clish_command_t *cmd = NULL;
@@ -971,26 +827,29 @@ static void process_wdog(clish_shell_t *shell,
 
 /* ------------------------------------------------------ */
 static void
-process_hotkey(clish_shell_t *shell, clish_xmlnode_t* element, void *parent)
+process_hotkey(clish_shell_t *shell, clish_imgnode_t* element, void *parent)
 {
 	clish_view_t *v = (clish_view_t *)parent;
 
-	char *key = clish_xmlnode_fetch_attr(element, "key");
-	char *cmd = clish_xmlnode_fetch_attr(element, "cmd");
+	const char *key = clish_imgnode__get_attr(element, "key");
+	const char *cmd = clish_imgnode__get_attr(element, "cmd");
 
 	assert(key);
 	assert(cmd);
 
 	assert (!clish_view_insert_hotkey(v, key, cmd));
 
-	clish_xml_release(key);
-	clish_xml_release(cmd);
 
 	shell = shell; /* Happy compiler */
 }
 
 /* ------------------------------------------------------ */
-int clish_shell_xml_read(clish_shell_t * shell, const char *filename)
+/* Parse the XML file and add it to the image. The error message is
+ * returned instead of printing because the files can be parsed by
+ * the loader threads.
+ */
+static int xml_read_image(clish_image_t *image, const char *filename,
+	char **error)
 {
 	int ret = -1;
 	clish_xmldoc_t *doc;
@@ -999,18 +858,29 @@ int clish_shell_xml_read(clish_shell_t * shell, const char *filename)
 
 	if (clish_xmldoc_is_valid(doc)) {
 		clish_xmlnode_t *root = clish_xmldoc_get_root(doc);
-		process_node(shell, root, NULL);
-		ret = 0;
+		ret = clish_image_add(image, root, filename);
 	} else {
 		int errcaps = clish_xmldoc_error_caps(doc);
-		printf("Unable to open file '%s'", filename);
-		if ((errcaps & CLISH_XMLERR_LINE) == CLISH_XMLERR_LINE)
-			printf(", at line %d", clish_xmldoc_get_err_line(doc));
-		if ((errcaps & CLISH_XMLERR_COL) == CLISH_XMLERR_COL)
-			printf(", at column %d", clish_xmldoc_get_err_col(doc));
-		if ((errcaps & CLISH_XMLERR_DESC) == CLISH_XMLERR_DESC)
-			printf(", message is %s", clish_xmldoc_get_err_msg(doc));
-		printf("\n");
+		char num[24];
+		lub_string_cat(error, "Unable to open file '");
+		lub_string_cat(error, filename);
+		lub_string_cat(error, "'");
+		if ((errcaps & CLISH_XMLERR_LINE) == CLISH_XMLERR_LINE) {
+			snprintf(num, sizeof(num), "%d",
+				clish_xmldoc_get_err_line(doc));
+			lub_string_cat(error, ", at line ");
+			lub_string_cat(error, num);
+		}
+		if ((errcaps & CLISH_XMLERR_COL) == CLISH_XMLERR_COL) {
+			snprintf(num, sizeof(num), "%d",
+				clish_xmldoc_get_err_col(doc));
+			lub_string_cat(error, ", at column ");
+			lub_string_cat(error, num);
+		}
+		if ((errcaps & CLISH_XMLERR_DESC) == CLISH_XMLERR_DESC) {
+			lub_string_cat(error, ", message is ");
+			lub_string_cat(error, clish_xmldoc_get_err_msg(doc));
+		}
 	}
 
 	clish_xmldoc_release(doc);
@@ -1019,3 +889,431 @@ int clish_shell_xml_read(clish_shell_t * shell, const char *filename)
 }
 
 /* ------------------------------------------------------ */
+/* The shell owns the image after processing because the views which
+ * are not built yet refer to it.
+ */
+static void process_image(clish_shell_t *shell, clish_image_t *image)
+{
+	clish_imgnode_t *root;
+	clish_image_t **tmp;
+
+	/* The root elements of all files are chained */
+	for (root = clish_image__get_root(image); root;
+		root = clish_imgnode__get_next(root))
+		process_node(shell, root, NULL);
+
+	tmp = realloc(shell->imagev, (shell->imagec + 1) * sizeof(*tmp));
+	assert(tmp);
+	shell->imagev = tmp;
+	shell->imagev[shell->imagec++] = image;
+}
+
+/* ------------------------------------------------------ */
+void clish_shell_build_view(clish_shell_t *shell, clish_view_t *view)
+{
+	unsigned int defc = clish_view__get_def_count(view);
+	const void **defv;
+	unsigned int i;
+	clish_profile_mark_t mark;
+
+	if (!defc)
+		return;
+	clish_profile_enter(shell->profile, &mark, CLISH_PROFILE_BUILD, NULL);
+	/* The definitions are dropped before the build because the view
+	 * can be imported by the views it imports itself.
+	 */
+	defv = malloc(defc * sizeof(*defv));
+	assert(defv);
+	for (i = 0; i < defc; i++)
+		defv[i] = clish_view__get_def(view, i);
+	clish_view_clean_defs(view);
+
+	for (i = 0; i < defc; i++)
+		process_children(shell, (clish_imgnode_t *)defv[i], view);
+	free(defv);
+	clish_profile_leave(shell->profile, &mark);
+}
+
+/* ------------------------------------------------------ */
+void clish_shell_build_views(clish_shell_t *shell)
+{
+	lub_bintree_iterator_t iter;
+	clish_view_t *view;
+
+	/* The iterator uses the key so the build can insert new views */
+	view = lub_bintree_findfirst(&shell->view_tree);
+	for (lub_bintree_iterator_init(&iter, &shell->view_tree, view);
+		view; view = lub_bintree_iterator_next(&iter))
+		clish_shell_build_view(shell, view);
+}
+
+/* ------------------------------------------------------ */
+int clish_shell_xml_read(clish_shell_t * shell, const char *filename)
+{
+	int ret = -1;
+	clish_image_t *image;
+	char *error = NULL;
+
+	/* The single file is processed through the in-memory image */
+	if (!(image = clish_image_new()))
+		return -1;
+	if (!xml_read_image(image, filename, &error)) {
+		process_image(shell, image);
+		ret = 0;
+	} else {
+		if (error)
+			printf("%s\n", error);
+		clish_image_free(image);
+	}
+	lub_string_free(error);
+
+	return ret;
+}
+
+/* ------------------------------------------------------ */
+/* Call the function for each XML file within the path. The path is
+ * tilde expanded already. Stop if the function fails.
+ */
+static int scheme_foreach(const char *path,
+	int (*fn)(const char *filename, void *arg), void *arg)
+{
+	char *buffer = lub_string_dup(path);
+	char *dirname;
+	char *saveptr = NULL;
+	int ret = 0;
+
+	/* now loop though each directory */
+	for (dirname = strtok_r(buffer, ";", &saveptr);
+		dirname && !ret; dirname = strtok_r(NULL, ";", &saveptr)) {
+		DIR *dir;
+		struct dirent *entry;
+
+		/* search this directory for any XML files */
+		dir = opendir(dirname);
+		if (NULL == dir) {
+#ifdef DEBUG
+			fprintf(stderr, "*** Failed to open '%s' directory\n",
+				dirname);
+#endif
+			continue;
+		}
+		for (entry = readdir(dir); entry && !ret; entry = readdir(dir)) {
+			const char *extension = strrchr(entry->d_name, '.');
+			/* check the filename */
+			if ((NULL != extension) &&
+				(0 == strcmp(".xml", extension))) {
+				char *filename = NULL;
+
+				/* build the filename */
+				lub_string_cat(&filename, dirname);
+				lub_string_cat(&filename, "/");
+				lub_string_cat(&filename, entry->d_name);
+
+				ret = fn(filename, arg);
+
+				/* release the resource */
+				lub_string_free(filename);
+			}
+		}
+		/* all done for this directory */
+		closedir(dir);
+	}
+	/* tidy up */
+	lub_string_free(buffer);
+
+	return ret;
+}
+
+/* ------------------------------------------------------ */
+/* The image is placed within the first directory of the path */
+static char *scheme_image_name(const char *path)
+{
+	char *filename = NULL;
+	size_t len = strcspn(path, ";");
+
+	lub_string_catn(&filename, path, len);
+	lub_string_cat(&filename, "/");
+	lub_string_cat(&filename, CLISH_IMAGE_NAME);
+
+	return filename;
+}
+
+/* ------------------------------------------------------ */
+/* The files are parsed to the separate images concurrently. Then the
+ * images are processed one by one in the order of files so the result
+ * is the same as for serial loading.
+ */
+typedef struct {
+	char **files;
+	clish_image_t **images;
+	char **errors;
+	long long *times; /* The wall and CPU time of each file if profiled */
+	unsigned int files_num;
+	unsigned int next; /* The next file to parse */
+} scheme_load_t;
+
+/* ------------------------------------------------------ */
+static int scheme_load_file(const char *filename, void *arg)
+{
+	scheme_load_t *load = (scheme_load_t *)arg;
+	char **files;
+
+	files = realloc(load->files, (load->files_num + 1) * sizeof(*files));
+	if (!files)
+		return -1;
+	load->files = files;
+	load->files[load->files_num++] = lub_string_dup(filename);
+
+	return 0;
+}
+
+/* ------------------------------------------------------ */
+static void scheme_parse_file(scheme_load_t *load, unsigned int i)
+{
+	clish_image_t *image;
+	long long wall = 0, cpu = 0;
+
+#ifdef DEBUG
+	fprintf(stderr, "Parse XML-file: %s\n", load->files[i]);
+#endif
+	if (load->times) {
+		wall = clish_profile_clock(CLOCK_MONOTONIC);
+		cpu = clish_profile_clock(CLOCK_THREAD_CPUTIME_ID);
+	}
+	if ((image = clish_image_new())) {
+		if (xml_read_image(image, load->files[i], &load->errors[i]))
+			clish_image_free(image);
+		else
+			load->images[i] = image;
+	}
+	if (load->times) {
+		load->times[2 * i] = clish_profile_clock(CLOCK_MONOTONIC) -
+			wall;
+		load->times[2 * i + 1] =
+			clish_profile_clock(CLOCK_THREAD_CPUTIME_ID) - cpu;
+	}
+}
+
+/* ------------------------------------------------------ */
+static void *scheme_parse_thread(void *arg)
+{
+	scheme_load_t *load = (scheme_load_t *)arg;
+	unsigned int i;
+
+	while ((i = __atomic_fetch_add(&load->next, 1, __ATOMIC_RELAXED)) <
+		load->files_num)
+		scheme_parse_file(load, i);
+
+	return NULL;
+}
+
+/* ------------------------------------------------------ */
+static void scheme_parse(scheme_load_t *load)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_t tids[CLISH_LOAD_THREADS_MAX];
+	unsigned int tids_num = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* The XML library is initialized before the threads start. The
+	 * files are parsed serially if the library can't parse them
+	 * concurrently.
+	 */
+	if (!clish_xml_init() || (load->files_num < 2)) {
+		scheme_parse_thread(load);
+		return;
+	}
+	if (cpus < 1)
+		cpus = 1;
+	while ((tids_num + 1 < (unsigned long)cpus) &&
+		(tids_num < CLISH_LOAD_THREADS_MAX) &&
+		(tids_num + 1 < load->files_num)) {
+		if (pthread_create(&tids[tids_num], NULL,
+			scheme_parse_thread, load))
+			break;
+		tids_num++;
+	}
+	scheme_parse_thread(load);
+	while (tids_num)
+		pthread_join(tids[--tids_num], NULL);
+#else
+	scheme_parse_thread(load);
+#endif
+}
+
+/* ------------------------------------------------------ */
+static void scheme_load(clish_shell_t *shell, const char *path)
+{
+	scheme_load_t load;
+	unsigned int i;
+	clish_profile_mark_t mark;
+
+	memset(&load, 0, sizeof(load));
+	clish_profile_enter(shell->profile, &mark, CLISH_PROFILE_SCAN, NULL);
+	scheme_foreach(path, scheme_load_file, &load);
+	clish_profile_leave(shell->profile, &mark);
+	if (!load.files_num)
+		return;
+	load.images = calloc(load.files_num, sizeof(*load.images));
+	load.errors = calloc(load.files_num, sizeof(*load.errors));
+	assert(load.images && load.errors);
+	if (shell->profile) {
+		load.times = calloc(2 * load.files_num, sizeof(*load.times));
+		assert(load.times);
+	}
+
+	clish_profile_enter(shell->profile, &mark, CLISH_PROFILE_PARSE, NULL);
+	scheme_parse(&load);
+	clish_profile_leave(shell->profile, &mark);
+
+	for (i = 0; i < load.files_num; i++) {
+		if (load.times)
+			clish_profile_add_file(shell->profile, load.files[i],
+				load.times[2 * i], load.times[2 * i + 1]);
+		if (load.images[i]) {
+			process_image(shell, load.images[i]);
+		} else if (load.errors[i]) {
+			printf("%s\n", load.errors[i]);
+		}
+		lub_string_free(load.errors[i]);
+		lub_string_free(load.files[i]);
+	}
+	free(load.images);
+	free(load.errors);
+	free(load.files);
+	free(load.times);
+}
+
+/* ------------------------------------------------------ */
+typedef struct {
+	clish_image_t *image;
+	unsigned int index;
+} scheme_check_t;
+
+/* ------------------------------------------------------ */
+/* The image is valid while the set of files and its order are the same
+ * and the files were not modified after image creation.
+ */
+static int scheme_check_file(const char *filename, void *arg)
+{
+	scheme_check_t *check = (scheme_check_t *)arg;
+	const char *name;
+
+	name = clish_image__get_file(check->image, check->index++);
+	if (!name || strcmp(name, filename) ||
+		!clish_image_is_newer(check->image, filename))
+		return -1;
+
+	return 0;
+}
+
+/* ------------------------------------------------------ */
+static clish_image_t *scheme_image_load(clish_shell_t *shell,
+	const char *path)
+{
+	clish_image_t *image;
+	scheme_check_t check;
+	char *filename = scheme_image_name(path);
+	clish_profile_mark_t mark;
+	int ret;
+
+	clish_profile_enter(shell->profile, &mark, CLISH_PROFILE_IMAGE, NULL);
+	image = clish_image_load(filename);
+	clish_profile_leave(shell->profile, &mark);
+	lub_string_free(filename);
+	if (!image)
+		return NULL;
+	check.image = image;
+	check.index = 0;
+	ret = strcmp(clish_image__get_path(image), path);
+	if (!ret) {
+		clish_profile_enter(shell->profile, &mark,
+			CLISH_PROFILE_SCAN, NULL);
+		ret = scheme_foreach(path, scheme_check_file, &check);
+		clish_profile_leave(shell->profile, &mark);
+	}
+	if (ret || (check.index != clish_image__get_files_num(image))) {
+#ifdef DEBUG
+		fprintf(stderr, "The image of '%s' is stale\n", path);
+#endif
+		clish_image_free(image);
+		return NULL;
+	}
+
+	return image;
+}
+
+/* ------------------------------------------------------ */
+static int scheme_compile_file(const char *filename, void *arg)
+{
+	char *error = NULL;
+	int ret;
+
+	if ((ret = xml_read_image((clish_image_t *)arg, filename, &error)) &&
+		error)
+		printf("%s\n", error);
+	lub_string_free(error);
+
+	return ret;
+}
+
+/*-------------------------------------------------------- */
+void clish_shell_load_scheme(clish_shell_t *this, const char *xml_path)
+{
+	const char *path = xml_path;
+	char *buffer;
+	clish_image_t *image;
+	clish_profile_mark_t mark;
+
+	clish_profile_enter(this->profile, &mark, CLISH_PROFILE_LOAD, NULL);
+	/* use the default path */
+	if (!path)
+		path = default_path;
+	/* take a copy of the path */
+	buffer = lub_system_tilde_expand(path);
+
+	/* The compiled image is used if it's up to date */
+	if ((image = scheme_image_load(this, buffer))) {
+		process_image(this, image);
+	} else {
+		scheme_load(this, buffer);
+	}
+	clish_profile_leave(this->profile, &mark);
+
+	/* tidy up */
+	lub_string_free(buffer);
+#ifdef DEBUG
+	clish_shell_dump(this);
+#endif
+}
+
+/*-------------------------------------------------------- */
+int clish_shell_compile_scheme(clish_shell_t *this, const char *xml_path)
+{
+	const char *path = xml_path;
+	char *buffer;
+	char *filename;
+	clish_image_t *image;
+	int ret = -1;
+
+	/* use the default path */
+	if (!path)
+		path = default_path;
+	/* take a copy of the path */
+	buffer = lub_system_tilde_expand(path);
+	filename = scheme_image_name(buffer);
+
+	/* The image is not written if any file is broken */
+	if ((image = clish_image_new())) {
+		if (!scheme_foreach(buffer, scheme_compile_file, image))
+			ret = clish_image_save(image, filename, buffer);
+		clish_image_free(image);
+	}
+
+	lub_string_free(filename);
+	lub_string_free(buffer);
+
+	this = this; /* Happy compiler */
+
+	return ret;
+}
@@ -23,6 +23,13 @@ typedef struct clish_xmldoc_s clish_xmldoc_t;
  */
 typedef struct clish_xmlnode_s clish_xmlnode_t;
 
+/*
+ * initialize the XML library once before the documents are read.
+ * Returns non-zero if the documents can be read by several threads
+ * at once.
+ */
+int clish_xml_init(void);
+
 /*
  * read an XML document
  */
@@ -183,6 +190,17 @@ char *clish_xmlnode_fetch_attr(
 	clish_xmlnode_t *node,
 	const char *attrname);
 
+/*
+ * get the name of attribute by its index. Returns NULL if the
+ * node has no so many attributes.
+ * Special: the expat and libxml2 backends return the pointer to
+ * their own data that is valid while the node exists. The roxml
+ * backend allocates memory. Pass it to clish_xml_release() anyway.
+ */
+char *clish_xmlnode_fetch_attr_name(
+	clish_xmlnode_t *node,
+	unsigned int index);
+
 /*
  * Free a pointer allocated by the XML backend
  */
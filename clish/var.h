@@ -21,6 +21,7 @@ clish_var_t *clish_var_new(const char *name);
  * methods
  *----------------- */
 void clish_var_delete(clish_var_t *instance);
+void clish_var_freeze(clish_var_t *instance, lub_string_arena_t *arena);
 void clish_var_dump(const clish_var_t *instance);
 /*-----------------
  * attributes
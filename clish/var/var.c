@@ -79,6 +79,14 @@ void clish_var_delete(clish_var_t *this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+void clish_var_freeze(clish_var_t *this, lub_string_arena_t *arena)
+{
+	lub_string_arena_add(arena, &this->name);
+	lub_string_arena_add(arena, &this->value);
+	clish_action_freeze(this->action, arena);
+}
+
 /*---------------------------------------------------------
  * PUBLIC ATTRIBUTES
  *--------------------------------------------------------- */
@@ -27,6 +27,7 @@ typedef enum {
 #include "clish/command.h"
 #include "clish/nspace.h"
 #include "clish/var.h"
+#include "lub/argv.h"
 
 /*=====================================
  * VIEW INTERFACE
@@ -43,6 +44,7 @@ size_t clish_view_bt_offset(void);
  * methods
  *----------------- */
 void clish_view_delete(clish_view_t * instance);
+void clish_view_freeze(clish_view_t * instance, lub_string_arena_t * arena);
 clish_command_t *clish_view_new_command(clish_view_t * instance,
 	const char *name, const char *text);
 clish_command_t *clish_view_find_command(clish_view_t * instance,
@@ -50,13 +52,22 @@ clish_command_t *clish_view_find_command(clish_view_t * instance,
 const clish_command_t *clish_view_find_next_completion(clish_view_t * instance,
 	const char *iter_cmd, const char *line,
 	clish_nspace_visibility_t field, bool_t inherit);
+const clish_command_t **clish_view_find_completions(clish_view_t * instance,
+	const char *line, clish_nspace_visibility_t field);
 clish_command_t *clish_view_resolve_command(clish_view_t * instance,
 	const char *line, bool_t inherit);
 clish_command_t *clish_view_resolve_prefix(clish_view_t * instance,
 	const char *line, bool_t inherit);
+clish_command_t *clish_view_resolve_command_argv(clish_view_t * instance,
+	const lub_argv_t * argv, bool_t inherit);
+clish_command_t *clish_view_resolve_prefix_argv(clish_view_t * instance,
+	const lub_argv_t * argv, bool_t inherit);
 void clish_view_dump(clish_view_t * instance);
 void clish_view_insert_nspace(clish_view_t * instance, clish_nspace_t * nspace);
 void clish_view_clean_proxy(clish_view_t * instance);
+void clish_view_insert_def(clish_view_t * instance, const void *def);
+void clish_view_clean_defs(clish_view_t * instance);
+void clish_view_build_index(clish_view_t * instance);
 
 /*-----------------
  * attributes
@@ -67,6 +78,9 @@ char *clish_view__get_prompt(const clish_view_t *instance);
 unsigned int clish_view__get_nspace_count(const clish_view_t * instance);
 clish_nspace_t *clish_view__get_nspace(const clish_view_t * instance,
 				       unsigned index);
+unsigned int clish_view__get_def_count(const clish_view_t * instance);
+const void *clish_view__get_def(const clish_view_t * instance,
+	unsigned index);
 void clish_view__set_depth(clish_view_t * instance, unsigned depth);
 unsigned clish_view__get_depth(const clish_view_t * instance);
 void clish_view__set_restore(clish_view_t * instance,
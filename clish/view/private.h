@@ -4,10 +4,53 @@
 #include "clish/view.h"
 #include "lub/bintree.h"
 #include "clish/hotkey.h"
+#include "lub/argv.h"
 
 /*---------------------------------------------------------
  * PRIVATE TYPES
  *--------------------------------------------------------- */
+/* The node of word trie. The words are compared case insensitive. */
+typedef struct clish_view_word_s clish_view_word_t;
+struct clish_view_word_s {
+	size_t key; /* The offset of word within the keys of trie */
+	size_t len;
+	clish_command_t *cmd; /* The command of the words up to the node */
+	clish_command_t *local; /* The same without the imported commands */
+	unsigned int rank; /* The rank of cmd */
+	clish_view_word_t *childv; /* The sorted next words */
+	unsigned int childc;
+};
+
+typedef struct {
+	clish_view_word_t root;
+	char *keys;
+	size_t keys_len;
+	unsigned int gen; /* The trie is valid for this generation only */
+} clish_view_trie_t;
+
+/* The command visible within the view. The local commands have rank 0. */
+typedef struct {
+	clish_command_t *cmd;
+	unsigned int rank;
+	unsigned int words; /* The number of words within the name */
+} clish_view_entry_t;
+
+typedef struct {
+	clish_nspace_t *nspace;
+	unsigned int rank;
+} clish_view_prefix_t;
+
+/* The flattened commands of view for one field of visibility */
+typedef struct {
+	clish_view_entry_t *entryv; /* Sorted by name case insensitive */
+	unsigned int entryc;
+	clish_view_prefix_t *prefixv; /* The namespaces with prefix */
+	unsigned int prefixc;
+	unsigned int gen;
+} clish_view_index_t;
+
+#define CLISH_VIEW_INDEX_NUM (CLISH_NSPACE_CHELP + 1)
+
 struct clish_view_s {
 	lub_bintree_t tree;
 	lub_bintree_node_t bt_node;
@@ -18,4 +61,28 @@ struct clish_view_s {
 	clish_hotkeyv_t *hotkeys;
 	unsigned int depth;
 	clish_view_restore_t restore;
+	unsigned int defc;
+	const void **defv; /* The definitions to build the view from */
+	clish_view_trie_t *trie; /* Built on the first resolve */
+	clish_view_index_t *indexv[CLISH_VIEW_INDEX_NUM]; /* By field */
 };
+
+/*---------------------------------------------------------
+ * PRIVATE METHODS
+ *--------------------------------------------------------- */
+void clish_view_trie_free(clish_view_trie_t *trie);
+clish_view_trie_t *clish_view_trie(clish_view_t *instance);
+void clish_view_changed(void);
+void clish_view_index_free(clish_view_index_t *index);
+clish_view_index_t *clish_view_index(clish_view_t *instance,
+	clish_nspace_visibility_t field);
+unsigned int clish_view_index_lower(const clish_view_index_t *index,
+	const char *name);
+unsigned int clish_view_index_upper(const clish_view_index_t *index,
+	const char *name);
+unsigned int clish_view_index_range(const clish_view_index_t *index,
+	const char *prefix, unsigned int *end);
+const clish_view_entry_t *clish_view_index_find(
+	const clish_view_index_t *index, const char *name);
+clish_command_t *clish_view_trie_resolve(clish_view_t *instance,
+	const lub_argv_t *argv, bool_t inherit);
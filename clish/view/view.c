@@ -45,6 +45,10 @@ static void clish_view_init(clish_view_t * this, const char *name, const char *p
 	this->nspacev = NULL;
 	this->depth = 0;
 	this->restore = CLISH_RESTORE_NONE;
+	this->defc = 0;
+	this->defv = NULL;
+	this->trie = NULL;
+	memset(this->indexv, 0, sizeof(this->indexv));
 
 	/* Be a good binary tree citizen */
 	lub_bintree_node_init(&this->bt_node);
@@ -93,6 +97,14 @@ static void clish_view_fini(clish_view_t * this)
 	free(this->nspacev);
 	this->nspacec = 0;
 	this->nspacev = NULL;
+
+	clish_view_clean_defs(this);
+	clish_view_trie_free(this->trie);
+	this->trie = NULL;
+	for (i = 0; i < CLISH_VIEW_INDEX_NUM; i++) {
+		clish_view_index_free(this->indexv[i]);
+		this->indexv[i] = NULL;
+	}
 }
 
 /*---------------------------------------------------------
@@ -122,6 +134,31 @@ void clish_view_delete(clish_view_t * this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+/* The command links of namespaces share the strings with the original
+ * commands so they must be dropped before. They are created again on
+ * demand.
+ */
+void clish_view_freeze(clish_view_t * this, lub_string_arena_t * arena)
+{
+	clish_command_t *cmd;
+	lub_bintree_iterator_t iter;
+	unsigned int i;
+
+	lub_string_arena_add(arena, &this->name);
+	lub_string_arena_add(arena, &this->prompt);
+	for (i = 0; i < this->nspacec; i++)
+		clish_nspace_freeze(this->nspacev[i], arena);
+	clish_hotkeyv_freeze(this->hotkeys, arena);
+
+	cmd = lub_bintree_findfirst(&this->tree);
+	for (lub_bintree_iterator_init(&iter, &this->tree, cmd);
+		cmd; cmd = lub_bintree_iterator_next(&iter))
+		clish_command_freeze(cmd, arena);
+	/* The lookups don't splay the tree after that */
+	lub_bintree_freeze(&this->tree);
+}
+
 /*--------------------------------------------------------- */
 clish_command_t *clish_view_new_command(clish_view_t * this,
 	const char *name, const char *help)
@@ -129,6 +166,7 @@ clish_command_t *clish_view_new_command(clish_view_t * this,
 	/* allocate the memory for a new parameter definition */
 	clish_command_t *cmd = clish_command_new(name, help);
 	assert(cmd);
+	clish_view_changed();
 
 	/* if this is a command other than the startup command... */
 	if (NULL != help) {
@@ -149,47 +187,35 @@ clish_command_t *clish_view_new_command(clish_view_t * this,
  * NB this comparison is case insensitive.
  *
  * this - the view instance upon which to operate
- * line - the command line to analyse 
+ * argv - the words of command line to analyse
  */
+clish_command_t *clish_view_resolve_prefix_argv(clish_view_t * this,
+	const lub_argv_t *argv, bool_t inherit)
+{
+	return clish_view_trie_resolve(this, argv, inherit);
+}
+
+/*--------------------------------------------------------- */
 clish_command_t *clish_view_resolve_prefix(clish_view_t * this,
 	const char *line, bool_t inherit)
 {
-	clish_command_t *result = NULL, *cmd;
-	char *buffer = NULL;
+	clish_command_t *result;
 	lub_argv_t *argv;
-	unsigned i;
 
 	/* create a vector of arguments */
 	argv = lub_argv_new(line, 0);
-
-	for (i = 0; i < lub_argv__get_count(argv); i++) {
-		/* set our buffer to be that of the first "i" arguments  */
-		lub_string_cat(&buffer, lub_argv__get_arg(argv, i));
-
-		/* set the result to the longest match */
-		cmd = clish_view_find_command(this, buffer, inherit);
-
-		/* job done */
-		if (!cmd)
-			break;
-		result = cmd;
-
-		/* ready for the next word */
-		lub_string_cat(&buffer, " ");
-	}
-
-	/* free up our dynamic storage */
-	lub_string_free(buffer);
+	result = clish_view_resolve_prefix_argv(this, argv, inherit);
 	lub_argv_delete(argv);
 
 	return result;
 }
 
 /*--------------------------------------------------------- */
-clish_command_t *clish_view_resolve_command(clish_view_t *this,
-	const char *line, bool_t inherit)
+clish_command_t *clish_view_resolve_command_argv(clish_view_t *this,
+	const lub_argv_t *argv, bool_t inherit)
 {
-	clish_command_t *result = clish_view_resolve_prefix(this, line, inherit);
+	clish_command_t *result = clish_view_resolve_prefix_argv(this,
+		argv, inherit);
 
 	if (result) {
 		clish_action_t *action = clish_command__get_action(result);
@@ -209,26 +235,56 @@ clish_command_t *clish_view_resolve_command(clish_view_t *this,
 	return result;
 }
 
+/*--------------------------------------------------------- */
+clish_command_t *clish_view_resolve_command(clish_view_t *this,
+	const char *line, bool_t inherit)
+{
+	clish_command_t *result;
+	lub_argv_t *argv;
+
+	argv = lub_argv_new(line, 0);
+	result = clish_view_resolve_command_argv(this, argv, inherit);
+	lub_argv_delete(argv);
+
+	return result;
+}
+
 /*--------------------------------------------------------- */
 clish_command_t *clish_view_find_command(clish_view_t * this,
 	const char *name, bool_t inherit)
 {
 	clish_command_t *cmd, *result = NULL;
-	clish_nspace_t *nspace;
-	unsigned cnt = clish_view__get_nspace_count(this);
-	int i;
-
-	/* Search the current view */
-	result = lub_bintree_find(&this->tree, name);
-	/* Make command link from command alias */
-	result = clish_command_alias_to_link(result);
-
-	if (inherit) {
-		for (i = cnt - 1; i >= 0; i--) {
-			nspace = clish_view__get_nspace(this, i);
-			cmd = clish_nspace_find_command(nspace, name);
-			/* choose the longest match */
-			result = clish_command_choose_longest(result, cmd);
+	const clish_view_entry_t *entry;
+	clish_view_index_t *index;
+	unsigned int rank = 0;
+	unsigned int i;
+
+	if (!inherit) {
+		/* Search the current view */
+		result = lub_bintree_find(&this->tree, name);
+		/* Make command link from command alias */
+		return clish_command_alias_to_link(result);
+	}
+
+	/* The commands of namespaces without prefix are flattened */
+	index = clish_view_index(this, CLISH_NSPACE_NONE);
+	if ((entry = clish_view_index_find(index, name))) {
+		result = clish_command_alias_to_link(entry->cmd);
+		rank = entry->rank;
+	}
+	for (i = 0; i < index->prefixc; i++) {
+		clish_view_prefix_t *prefix = &index->prefixv[i];
+		cmd = clish_nspace_find_command(prefix->nspace, name);
+		if (!cmd)
+			continue;
+		/* choose the longest match, the lower rank overrides */
+		if (result && (prefix->rank < rank))
+			cmd = clish_command_choose_longest(cmd, result);
+		else
+			cmd = clish_command_choose_longest(result, cmd);
+		if (cmd != result) {
+			result = cmd;
+			rank = prefix->rank;
 		}
 	}
 
@@ -236,22 +292,26 @@ clish_command_t *clish_view_find_command(clish_view_t * this,
 }
 
 /*--------------------------------------------------------- */
-static const clish_command_t *find_next_completion(clish_view_t * this,
-		const char *iter_cmd, const char *line)
+/* The number of words the command must have to complete the line */
+static unsigned completion_words(const char *line)
 {
-	clish_command_t *cmd;
-	const char *name = "";
-	lub_argv_t *largv;
-	unsigned words;
-
-	/* build an argument vector for the line */
-	largv = lub_argv_new(line, 0);
-	words = lub_argv__get_count(largv);
+	unsigned words = lub_argv_wordcount(line);
 
 	/* account for trailing space */
 	if (!*line || lub_ctype_isspace(line[strlen(line) - 1]))
 		words++;
 
+	return words;
+}
+
+/*--------------------------------------------------------- */
+static const clish_command_t *find_next_completion(clish_view_t * this,
+		const char *iter_cmd, const char *line)
+{
+	clish_command_t *cmd;
+	const char *name = "";
+	unsigned words = completion_words(line);
+
 	if (iter_cmd)
 		name = iter_cmd;
 	while ((cmd = lub_bintree_findnext(&this->tree, name))) {
@@ -265,39 +325,158 @@ static const clish_command_t *find_next_completion(clish_view_t * this,
 				break;
 		}
 	}
-	/* clean up the dynamic memory */
-	lub_argv_delete(largv);
 
 	return cmd;
 }
 
+/*--------------------------------------------------------- */
+/* The same as find_next_completion() but the flattened commands of
+ * namespaces without prefix are searched. Only the commands the line
+ * is a prefix of are scanned. The rank of command found is returned
+ * by rank.
+ */
+static const clish_command_t *index_next_completion(clish_view_index_t *index,
+	const char *iter_cmd, const char *line, unsigned int *rank)
+{
+	unsigned words = completion_words(line);
+	unsigned int i, end;
+
+	i = clish_view_index_range(index, line, &end);
+	if (iter_cmd) {
+		unsigned int pos = clish_view_index_upper(index, iter_cmd);
+		if (pos > i)
+			i = pos;
+	}
+	for (; i < end; i++) {
+		if (words != index->entryv[i].words)
+			continue;
+		*rank = index->entryv[i].rank;
+		/* Make command link from command alias */
+		return clish_command_alias_to_link(index->entryv[i].cmd);
+	}
+
+	return NULL;
+}
+
 /*--------------------------------------------------------- */
 const clish_command_t *clish_view_find_next_completion(clish_view_t * this,
 	const char *iter_cmd, const char *line,
 	clish_nspace_visibility_t field, bool_t inherit)
 {
 	const clish_command_t *result, *cmd;
-	clish_nspace_t *nspace;
-	unsigned cnt = clish_view__get_nspace_count(this);
-	int i;
+	clish_view_index_t *index;
+	unsigned int rank = 0;
+	unsigned int i;
 
 	/* ask local view for next command */
-	result = find_next_completion(this, iter_cmd, line);
-
 	if (!inherit)
-		return result;
+		return find_next_completion(this, iter_cmd, line);
 
-	/* ask the imported namespaces for next command */
-	for (i = cnt - 1; i >= 0; i--) {
-		nspace = clish_view__get_nspace(this, i);
-		if (!clish_nspace__get_visibility(nspace, field))
-			continue;
-		cmd = clish_nspace_find_next_completion(nspace,
+	/* The commands of namespaces without prefix are flattened */
+	index = clish_view_index(this, field);
+	result = index_next_completion(index, iter_cmd, line, &rank);
+
+	/* ask the namespaces with prefix for next command */
+	for (i = 0; i < index->prefixc; i++) {
+		clish_view_prefix_t *prefix = &index->prefixv[i];
+		int diff;
+		cmd = clish_nspace_find_next_completion(prefix->nspace,
 			iter_cmd, line, field);
-		if (clish_command_diff(result, cmd) > 0)
+		diff = clish_command_diff(result, cmd);
+		if ((diff > 0) || (cmd && !diff && (prefix->rank < rank))) {
 			result = cmd;
+			rank = prefix->rank;
+		}
+	}
+
+	return result;
+}
+
+/*--------------------------------------------------------- */
+typedef struct {
+	const clish_command_t *cmd;
+	unsigned int rank;
+} clish_view_completion_t;
+
+/*--------------------------------------------------------- */
+static int completion_compare(const void *first, const void *second)
+{
+	const clish_view_completion_t *f = first;
+	const clish_view_completion_t *s = second;
+	int res;
+
+	res = clish_command_diff(f->cmd, s->cmd);
+	if (res)
+		return res;
+
+	return (f->rank < s->rank) ? -1 : (f->rank > s->rank);
+}
+
+/*--------------------------------------------------------- */
+/* Get all the completions of line at once. The commands are the same
+ * clish_view_find_next_completion() returns one by one. The commands of
+ * namespaces without prefix are found by one range scan of the index.
+ * The namespaces with prefix create the commands on demand so they are
+ * iterated. The NULL terminated vector is sorted by name and must be
+ * freed by free().
+ */
+const clish_command_t **clish_view_find_completions(clish_view_t * this,
+	const char *line, clish_nspace_visibility_t field)
+{
+	clish_view_index_t *index = clish_view_index(this, field);
+	clish_view_completion_t *compv;
+	const clish_command_t **result;
+	unsigned words = completion_words(line);
+	unsigned int compc = 0, size;
+	unsigned int i, num, end;
+
+	i = clish_view_index_range(index, line, &end);
+	size = end - i + 1;
+	compv = malloc(size * sizeof(*compv));
+	assert(compv);
+	for (; i < end; i++) {
+		if (words != index->entryv[i].words)
+			continue;
+		compv[compc].cmd = clish_command_alias_to_link(
+			index->entryv[i].cmd);
+		compv[compc++].rank = index->entryv[i].rank;
 	}
 
+	for (i = 0; i < index->prefixc; i++) {
+		clish_view_prefix_t *prefix = &index->prefixv[i];
+		const clish_command_t *cmd = NULL;
+		while ((cmd = clish_nspace_find_next_completion(prefix->nspace,
+			clish_command__get_name(cmd), line, field))) {
+			if (compc == size) {
+				clish_view_completion_t *tmp;
+				size *= 2;
+				tmp = realloc(compv, size * sizeof(*tmp));
+				assert(tmp);
+				compv = tmp;
+			}
+			/* The names must grow to stop the iteration */
+			if (compc && (compv[compc - 1].rank == prefix->rank) &&
+				(clish_command_diff(compv[compc - 1].cmd, cmd) >= 0))
+				break;
+			compv[compc].cmd = cmd;
+			compv[compc++].rank = prefix->rank;
+		}
+	}
+	/* The range of index is sorted already */
+	if (index->prefixc)
+		qsort(compv, compc, sizeof(*compv), completion_compare);
+
+	result = malloc((compc + 1) * sizeof(*result));
+	assert(result);
+	for (num = 0, i = 0; i < compc; i++) {
+		/* The lower rank wins */
+		if (num && !clish_command_diff(result[num - 1], compv[i].cmd))
+			continue;
+		result[num++] = compv[i].cmd;
+	}
+	result[num] = NULL;
+	free(compv);
+
 	return result;
 }
 
@@ -313,6 +492,7 @@ void clish_view_insert_nspace(clish_view_t * this, clish_nspace_t * nspace)
 	this->nspacev = tmp;
 	/* insert reference to the namespace */
 	this->nspacev[this->nspacec++] = nspace;
+	clish_view_changed();
 }
 
 /*--------------------------------------------------------- */
@@ -325,6 +505,29 @@ void clish_view_clean_proxy(clish_view_t * this)
 		clish_nspace_clean_proxy(this->nspacev[i]);
 }
 
+/*--------------------------------------------------------- */
+/* The view content can be built on demand. The loader stores the
+ * definitions of view here and builds the view on first use.
+ */
+void clish_view_insert_def(clish_view_t * this, const void *def)
+{
+	size_t new_size = ((this->defc + 1) * sizeof(void *));
+	const void **tmp;
+
+	tmp = realloc(this->defv, new_size);
+	assert(tmp);
+	this->defv = tmp;
+	this->defv[this->defc++] = def;
+}
+
+/*--------------------------------------------------------- */
+void clish_view_clean_defs(clish_view_t * this)
+{
+	free(this->defv);
+	this->defc = 0;
+	this->defv = NULL;
+}
+
 /*---------------------------------------------------------
  * PUBLIC ATTRIBUTES
  *--------------------------------------------------------- */
@@ -364,6 +567,20 @@ unsigned int clish_view__get_nspace_count(const clish_view_t * this)
 	return this->nspacec;
 }
 
+/*--------------------------------------------------------- */
+const void *clish_view__get_def(const clish_view_t * this, unsigned index)
+{
+	if (index < this->defc)
+		return this->defv[index];
+	return NULL;
+}
+
+/*--------------------------------------------------------- */
+unsigned int clish_view__get_def_count(const clish_view_t * this)
+{
+	return this->defc;
+}
+
 /*--------------------------------------------------------- */
 void clish_view__set_depth(clish_view_t * this, unsigned depth)
 {
@@ -0,0 +1,313 @@
+/*
+ * view_index.c
+ *
+ * The flattened commands of view. The commands of the view and of the
+ * views imported by the namespaces without prefix are merged to the
+ * single array sorted by name. There is the array for each field of
+ * visibility. The namespaces with prefix create the commands on demand
+ * so they are listed separately. The rank is the order the recursive
+ * search meets the command in. The lower rank wins when the commands
+ * of the same name are found. The origin of command is its pview.
+ */
+#include "private.h"
+#include "lub/string.h"
+#include "lub/ctype.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The indexes and tries are rebuilt when any view gets the new command
+ * or namespace because they contain the commands of imported views.
+ */
+static unsigned int view_gen = 1;
+
+/* The imported views on the way to detect the loops */
+typedef struct clish_view_path_s clish_view_path_t;
+struct clish_view_path_s {
+	const clish_view_t *view;
+	const clish_view_path_t *up;
+};
+
+typedef struct {
+	clish_view_index_t *index;
+	clish_nspace_visibility_t field;
+	unsigned int entry_size;
+	unsigned int prefix_size;
+	unsigned int rank;
+} clish_view_build_t;
+
+/*--------------------------------------------------------- */
+static void index_add_entry(clish_view_build_t *build, clish_command_t *cmd,
+	unsigned int rank)
+{
+	clish_view_index_t *index = build->index;
+	clish_view_entry_t *entry;
+
+	if (index->entryc == build->entry_size) {
+		build->entry_size = build->entry_size ?
+			build->entry_size * 2 : 64;
+		entry = realloc(index->entryv,
+			build->entry_size * sizeof(*entry));
+		assert(entry);
+		index->entryv = entry;
+	}
+	entry = &index->entryv[index->entryc++];
+	entry->cmd = cmd;
+	entry->rank = rank;
+	entry->words = lub_argv_wordcount(clish_command__get_name(cmd));
+}
+
+/*--------------------------------------------------------- */
+static void index_add_prefix(clish_view_build_t *build, clish_nspace_t *nspace)
+{
+	clish_view_index_t *index = build->index;
+	clish_view_prefix_t *prefix;
+
+	if (index->prefixc == build->prefix_size) {
+		build->prefix_size = build->prefix_size ?
+			build->prefix_size * 2 : 4;
+		prefix = realloc(index->prefixv,
+			build->prefix_size * sizeof(*prefix));
+		assert(prefix);
+		index->prefixv = prefix;
+	}
+	prefix = &index->prefixv[index->prefixc++];
+	prefix->nspace = nspace;
+	prefix->rank = build->rank++;
+}
+
+/*--------------------------------------------------------- */
+/* The same order as clish_view_find_command() and
+ * clish_view_find_next_completion() use.
+ */
+static void index_add_view(clish_view_build_t *build, clish_view_t *view,
+	bool_t inherit, const clish_view_path_t *up)
+{
+	clish_view_path_t path;
+	const clish_view_path_t *tmp;
+	clish_command_t *cmd;
+	lub_bintree_iterator_t iter;
+	unsigned int rank;
+	int i;
+
+	/* The view imports itself through the other views */
+	for (tmp = up; tmp; tmp = tmp->up) {
+		if (tmp->view == view)
+			return;
+	}
+	path.view = view;
+	path.up = up;
+
+	rank = build->rank++;
+	cmd = lub_bintree_findfirst(&view->tree);
+	for (lub_bintree_iterator_init(&iter, &view->tree, cmd);
+		cmd; cmd = lub_bintree_iterator_next(&iter))
+		index_add_entry(build, cmd, rank);
+	if (!inherit)
+		return;
+
+	for (i = view->nspacec - 1; i >= 0; i--) {
+		clish_nspace_t *nspace = view->nspacev[i];
+		if ((CLISH_NSPACE_NONE != build->field) &&
+			!clish_nspace__get_visibility(nspace, build->field))
+			continue;
+		if (clish_nspace__get_prefix(nspace)) {
+			index_add_prefix(build, nspace);
+			continue;
+		}
+		index_add_view(build, clish_nspace__get_view(nspace),
+			clish_nspace__get_inherit(nspace), &path);
+	}
+}
+
+/*--------------------------------------------------------- */
+static int index_compare(const void *first, const void *second)
+{
+	const clish_view_entry_t *f = first;
+	const clish_view_entry_t *s = second;
+	int res;
+
+	res = lub_string_nocasecmp(clish_command__get_name(f->cmd),
+		clish_command__get_name(s->cmd));
+	if (res)
+		return res;
+
+	return (f->rank < s->rank) ? -1 : (f->rank > s->rank);
+}
+
+/*--------------------------------------------------------- */
+static clish_view_index_t *index_new(clish_view_t *view,
+	clish_nspace_visibility_t field)
+{
+	clish_view_build_t build;
+	clish_view_index_t *index;
+	unsigned int i, num;
+
+	index = calloc(1, sizeof(*index));
+	assert(index);
+	memset(&build, 0, sizeof(build));
+	build.index = index;
+	build.field = field;
+	index_add_view(&build, view, BOOL_TRUE, NULL);
+
+	/* Leave the first command of each name */
+	qsort(index->entryv, index->entryc, sizeof(*index->entryv),
+		index_compare);
+	for (num = 0, i = 0; i < index->entryc; i++) {
+		if (num && !lub_string_nocasecmp(
+			clish_command__get_name(index->entryv[i].cmd),
+			clish_command__get_name(index->entryv[num - 1].cmd)))
+			continue;
+		index->entryv[num++] = index->entryv[i];
+	}
+	index->entryc = num;
+	index->gen = view_gen;
+
+	return index;
+}
+
+/*--------------------------------------------------------- */
+void clish_view_index_free(clish_view_index_t *index)
+{
+	if (!index)
+		return;
+	free(index->entryv);
+	free(index->prefixv);
+	free(index);
+}
+
+/*--------------------------------------------------------- */
+void clish_view_changed(void)
+{
+	view_gen++;
+}
+
+/*--------------------------------------------------------- */
+/* Get the index of field. CLISH_NSPACE_NONE is for the execution so
+ * the visibility of namespaces is not checked.
+ */
+clish_view_index_t *clish_view_index(clish_view_t *this,
+	clish_nspace_visibility_t field)
+{
+	clish_view_index_t *index = this->indexv[field];
+
+	if (index && (index->gen == view_gen))
+		return index;
+	clish_view_index_free(index);
+	index = index_new(this, field);
+	this->indexv[field] = index;
+
+	return index;
+}
+
+/*--------------------------------------------------------- */
+/* The position of the first entry not less than the name */
+unsigned int clish_view_index_lower(const clish_view_index_t *index,
+	const char *name)
+{
+	unsigned int lo = 0, hi = index->entryc;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (lub_string_nocasecmp(clish_command__get_name(
+			index->entryv[mid].cmd), name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*--------------------------------------------------------- */
+/* The position of the first entry greater than the name */
+unsigned int clish_view_index_upper(const clish_view_index_t *index,
+	const char *name)
+{
+	unsigned int pos = clish_view_index_lower(index, name);
+
+	if ((pos < index->entryc) && !lub_string_nocasecmp(
+		clish_command__get_name(index->entryv[pos].cmd), name))
+		pos++;
+
+	return pos;
+}
+
+/*--------------------------------------------------------- */
+/* The name starts with the prefix. The same as lub_string_nocasestr()
+ * returns the name itself.
+ */
+static bool_t index_is_prefix(const char *name, const char *prefix)
+{
+	while (*prefix && *name &&
+		(lub_ctype_tolower(*prefix) == lub_ctype_tolower(*name))) {
+		prefix++;
+		name++;
+	}
+
+	return *prefix ? BOOL_FALSE : BOOL_TRUE;
+}
+
+/*--------------------------------------------------------- */
+/* The names starting with the prefix are sorted together. But the name
+ * can be less than the prefix itself if the char after the prefix is
+ * negative. So the bounds are searched by the prefix test too.
+ */
+unsigned int clish_view_index_range(const clish_view_index_t *index,
+	const char *prefix, unsigned int *end)
+{
+	unsigned int lo = 0, hi = index->entryc;
+	unsigned int start;
+
+	/* The first name starting with the prefix or greater */
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		const char *name = clish_command__get_name(
+			index->entryv[mid].cmd);
+		if (!index_is_prefix(name, prefix) &&
+			(lub_string_nocasecmp(name, prefix) < 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+
+	/* The first name greater and not starting with the prefix */
+	hi = index->entryc;
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (index_is_prefix(clish_command__get_name(
+			index->entryv[mid].cmd), prefix))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*end = lo;
+
+	return start;
+}
+
+/*--------------------------------------------------------- */
+const clish_view_entry_t *clish_view_index_find(
+	const clish_view_index_t *index, const char *name)
+{
+	unsigned int pos = clish_view_index_lower(index, name);
+
+	if ((pos < index->entryc) && !lub_string_nocasecmp(
+		clish_command__get_name(index->entryv[pos].cmd), name))
+		return &index->entryv[pos];
+
+	return NULL;
+}
+
+/*--------------------------------------------------------- */
+/* Build the indexes before the fork so the children share them */
+void clish_view_build_index(clish_view_t *this)
+{
+	unsigned int i;
+
+	for (i = 0; i < CLISH_VIEW_INDEX_NUM; i++)
+		clish_view_index(this, i);
+	clish_view_trie(this);
+}
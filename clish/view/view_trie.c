@@ -0,0 +1,396 @@
+/*
+ * view_trie.c
+ *
+ * The word trie of view. The commands are resolved by one walk over the
+ * words of line. The trie is built from the flattened commands of view
+ * so the imported views are not searched one by one. The namespaces
+ * with prefix are checked against the line and the rest of line is
+ * resolved by the trie of imported view.
+ */
+#include "private.h"
+#include "lub/string.h"
+#include "lub/ctype.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The words of line to resolve */
+typedef struct {
+	const lub_argv_t *argv;
+	unsigned int argc;
+	char *buf; /* The words separated by single space */
+	size_t *offv; /* The offsets of words within the buf */
+} clish_view_line_t;
+
+/*--------------------------------------------------------- */
+static int trie_compare(const char *key, size_t key_len,
+	const char *word, size_t word_len)
+{
+	size_t i;
+
+	for (i = 0; (i < key_len) && (i < word_len); i++) {
+		int res = lub_ctype_tolower(key[i]) - lub_ctype_tolower(word[i]);
+		if (res)
+			return res;
+	}
+	if (key_len == word_len)
+		return 0;
+
+	return (key_len < word_len) ? -1 : 1;
+}
+
+/*--------------------------------------------------------- */
+/* Find the child of node by binary search. The position to insert
+ * the absent child is returned by pos.
+ */
+static clish_view_word_t *trie_child(const clish_view_trie_t *trie,
+	const clish_view_word_t *node, const char *word, size_t len,
+	unsigned int *pos)
+{
+	unsigned int lo = 0, hi = node->childc;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		clish_view_word_t *child = &node->childv[mid];
+		int res = trie_compare(trie->keys + child->key, child->len,
+			word, len);
+		if (!res)
+			return child;
+		if (res < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (pos)
+		*pos = lo;
+
+	return NULL;
+}
+
+/*--------------------------------------------------------- */
+static clish_view_word_t *trie_add_child(clish_view_trie_t *trie,
+	clish_view_word_t *node, const char *word, size_t len)
+{
+	clish_view_word_t *child;
+	unsigned int pos;
+	char *keys;
+
+	if ((child = trie_child(trie, node, word, len, &pos)))
+		return child;
+
+	child = realloc(node->childv, (node->childc + 1) * sizeof(*child));
+	assert(child);
+	node->childv = child;
+	memmove(&child[pos + 1], &child[pos],
+		(node->childc - pos) * sizeof(*child));
+	node->childc++;
+
+	keys = realloc(trie->keys, trie->keys_len + len);
+	assert(keys);
+	trie->keys = keys;
+	memcpy(trie->keys + trie->keys_len, word, len);
+
+	child = &node->childv[pos];
+	memset(child, 0, sizeof(*child));
+	child->key = trie->keys_len;
+	child->len = len;
+	trie->keys_len += len;
+
+	return child;
+}
+
+/*--------------------------------------------------------- */
+/* The lower rank wins so the local commands override the imported
+ * ones and the last namespace overrides the previous ones.
+ */
+static void trie_add_command(clish_view_trie_t *trie,
+	const clish_view_entry_t *entry)
+{
+	clish_view_word_t *node = &trie->root;
+	const char *name = clish_command__get_name(entry->cmd);
+
+	while (*name) {
+		const char *end;
+		if (' ' == *name) {
+			name++;
+			continue;
+		}
+		for (end = name; *end && (' ' != *end); end++);
+		node = trie_add_child(trie, node, name, end - name);
+		name = end;
+	}
+	if (node == &trie->root)
+		return;
+	if (!entry->rank && !node->local)
+		node->local = entry->cmd;
+	if (!node->cmd || (entry->rank < node->rank)) {
+		node->cmd = entry->cmd;
+		node->rank = entry->rank;
+	}
+}
+
+/*--------------------------------------------------------- */
+static void trie_free_node(clish_view_word_t *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < node->childc; i++)
+		trie_free_node(&node->childv[i]);
+	free(node->childv);
+}
+
+/*--------------------------------------------------------- */
+void clish_view_trie_free(clish_view_trie_t *trie)
+{
+	if (!trie)
+		return;
+	trie_free_node(&trie->root);
+	free(trie->keys);
+	free(trie);
+}
+
+/*--------------------------------------------------------- */
+/* The trie is built from the index of execution */
+clish_view_trie_t *clish_view_trie(clish_view_t *this)
+{
+	clish_view_index_t *index = clish_view_index(this, CLISH_NSPACE_NONE);
+	unsigned int i;
+
+	if (this->trie && (this->trie->gen == index->gen))
+		return this->trie;
+	clish_view_trie_free(this->trie);
+	this->trie = calloc(1, sizeof(*this->trie));
+	assert(this->trie);
+	for (i = 0; i < index->entryc; i++)
+		trie_add_command(this->trie, &index->entryv[i]);
+	this->trie->gen = index->gen;
+
+	return this->trie;
+}
+
+/*--------------------------------------------------------- */
+/* Join the words once. The prefix is matched against the words
+ * like clish_view_find_command() gets them.
+ */
+static void line_join(clish_view_line_t *line)
+{
+	size_t len = 0;
+	unsigned int i;
+
+	if (line->buf)
+		return;
+	line->offv = malloc(line->argc * sizeof(*line->offv));
+	assert(line->offv);
+	for (i = 0; i < line->argc; i++)
+		len += strlen(lub_argv__get_arg(line->argv, i)) + 1;
+	line->buf = malloc(len);
+	assert(line->buf);
+	for (len = 0, i = 0; i < line->argc; i++) {
+		const char *arg = lub_argv__get_arg(line->argv, i);
+		size_t arg_len = strlen(arg);
+		line->offv[i] = len;
+		memcpy(line->buf + len, arg, arg_len);
+		len += arg_len;
+		line->buf[len++] = ' ';
+	}
+	line->buf[len - 1] = '\0';
+}
+
+/*--------------------------------------------------------- */
+/* The words from first to end. The char after the words is replaced by
+ * '\0' and it's returned by save.
+ */
+static char *line_words(clish_view_line_t *line, unsigned int first,
+	unsigned int end, char *save)
+{
+	char *stop;
+
+	line_join(line);
+	stop = line->buf + line->offv[end - 1] +
+		strlen(lub_argv__get_arg(line->argv, end - 1));
+	*save = *stop;
+	*stop = '\0';
+
+	return line->buf + line->offv[first];
+}
+
+/*--------------------------------------------------------- */
+static void line_restore(clish_view_line_t *line, unsigned int end,
+	char save)
+{
+	line->buf[line->offv[end - 1] +
+		strlen(lub_argv__get_arg(line->argv, end - 1))] = save;
+}
+
+/*--------------------------------------------------------- */
+static void trie_match(clish_view_t *this, clish_view_line_t *line,
+	unsigned int first, bool_t inherit,
+	clish_command_t **cmdv, bool_t *hitv);
+
+/*--------------------------------------------------------- */
+/* Mark the word counts the namespace with prefix has the command for */
+static void trie_match_prefix(clish_nspace_t *nspace, clish_view_line_t *line,
+	unsigned int first, bool_t *hitv)
+{
+	clish_view_t *view = clish_nspace__get_view(nspace);
+	bool_t inherit = clish_nspace__get_inherit(nspace);
+	bool_t *subv = NULL;
+	unsigned int sub_first = 0;
+	unsigned int i, k;
+
+	for (i = first + 1; i <= line->argc; i++) {
+		size_t len;
+		const char *in_line;
+		char *words;
+		char save;
+
+		if (hitv[i])
+			continue;
+		words = line_words(line, first, i, &save);
+		if (!(len = clish_nspace_match_prefix(nspace, words))) {
+			line_restore(line, i, save);
+			continue;
+		}
+		in_line = words + len;
+		if (' ' == in_line[0])
+			in_line++;
+		/* The prefix command itself */
+		if ('\0' == in_line[0]) {
+			hitv[i] = BOOL_TRUE;
+			line_restore(line, i, save);
+			continue;
+		}
+		for (k = first + 1; k < i; k++) {
+			if (in_line == line->buf + line->offv[k])
+				break;
+		}
+		if (k < i) {
+			/* The rest of line starts from the word */
+			if (!subv) {
+				subv = calloc(line->argc + 1, sizeof(*subv));
+				assert(subv);
+			}
+			if (sub_first != k) {
+				memset(subv, 0, (line->argc + 1) * sizeof(*subv));
+				trie_match(view, line, k, inherit, NULL, subv);
+				sub_first = k;
+			}
+			hitv[i] = subv[i];
+		} else if (clish_view_find_command(view, in_line, inherit)) {
+			/* The prefix ends within the word */
+			hitv[i] = BOOL_TRUE;
+		}
+		line_restore(line, i, save);
+	}
+	free(subv);
+}
+
+/*--------------------------------------------------------- */
+/* Walk the trie from the first word. The commands of trie are stored
+ * to cmdv by the number of words. The commands found through the
+ * namespaces with prefix are marked within hitv only. The cmdv is NULL
+ * for the imported view so all the commands are marked within hitv.
+ */
+static void trie_match(clish_view_t *this, clish_view_line_t *line,
+	unsigned int first, bool_t inherit,
+	clish_command_t **cmdv, bool_t *hitv)
+{
+	clish_view_trie_t *trie = clish_view_trie(this);
+	clish_view_index_t *index = clish_view_index(this, CLISH_NSPACE_NONE);
+	clish_view_word_t *node = &trie->root;
+	unsigned int i;
+
+	for (i = first; i < line->argc; i++) {
+		const char *arg = lub_argv__get_arg(line->argv, i);
+		clish_command_t *cmd;
+
+		if (!(node = trie_child(trie, node, arg, strlen(arg), NULL)))
+			break;
+		cmd = inherit ? node->cmd : node->local;
+		if (!cmd)
+			continue;
+		if (cmdv)
+			cmdv[i + 1] = cmd;
+		else
+			hitv[i + 1] = BOOL_TRUE;
+	}
+	if (!inherit)
+		return;
+	for (i = 0; i < index->prefixc; i++)
+		trie_match_prefix(index->prefixv[i].nspace, line, first, hitv);
+}
+
+/*--------------------------------------------------------- */
+/* The word containing the space can't be found by trie */
+static bool_t line_is_plain(const lub_argv_t *argv)
+{
+	unsigned int i;
+
+	for (i = 0; i < lub_argv__get_count(argv); i++) {
+		if (strchr(lub_argv__get_arg(argv, i), ' '))
+			return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+/*--------------------------------------------------------- */
+/* Resolve the words by the view. The words are looked up one by one
+ * like the buffer of the first words within clish_view_find_command().
+ */
+clish_command_t *clish_view_trie_resolve(clish_view_t *this,
+	const lub_argv_t *argv, bool_t inherit)
+{
+	clish_command_t *result = NULL;
+	clish_view_line_t line;
+	clish_command_t **cmdv;
+	bool_t *hitv;
+	unsigned int i;
+
+	memset(&line, 0, sizeof(line));
+	line.argv = argv;
+	line.argc = lub_argv__get_count(argv);
+	if (!line.argc)
+		return NULL;
+	if (!line_is_plain(argv)) {
+		for (i = 1; i <= line.argc; i++) {
+			char save;
+			char *words = line_words(&line, 0, i, &save);
+			clish_command_t *cmd = clish_view_find_command(this,
+				words, inherit);
+			line_restore(&line, i, save);
+			if (!cmd)
+				break;
+			result = cmd;
+		}
+		goto out;
+	}
+
+	cmdv = calloc(line.argc + 1, sizeof(*cmdv));
+	hitv = calloc(line.argc + 1, sizeof(*hitv));
+	assert(cmdv && hitv);
+	trie_match(this, &line, 0, inherit, cmdv, hitv);
+	/* The longest line all the shorter lines are commands for */
+	for (i = 1; i <= line.argc; i++) {
+		if (!cmdv[i] && !hitv[i])
+			break;
+	}
+	i--;
+	if (i && hitv[i]) {
+		/* Get the proxy command of namespace */
+		char save;
+		char *words = line_words(&line, 0, i, &save);
+		result = clish_view_find_command(this, words, inherit);
+		line_restore(&line, i, save);
+	} else if (i) {
+		result = clish_command_alias_to_link(cmdv[i]);
+	}
+	free(cmdv);
+	free(hitv);
+out:
+	free(line.buf);
+	free(line.offv);
+
+	return result;
+}
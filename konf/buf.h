@@ -36,14 +36,19 @@ size_t konf_buf_bt_offset(void);
 void konf_buf_delete(konf_buf_t *instance);
 int konf_buf_read(konf_buf_t *instance);
 int konf_buf_add(konf_buf_t *instance, void *str, size_t len);
+char * konf_buf_reserve(konf_buf_t *instance, int *len);
+int konf_buf_commit(konf_buf_t *instance, int len);
 char * konf_buf_string(char *instance, int len);
 char * konf_buf_parse(konf_buf_t *instance);
 char * konf_buf_preparse(konf_buf_t *instance);
 int konf_buf_lseek(konf_buf_t *instance, int newpos);
+int konf_buf_shift(konf_buf_t *instance, int len);
 int konf_buf__get_fd(const konf_buf_t *instance);
+char * konf_buf__get_buf(const konf_buf_t *instance);
 int konf_buf__get_len(const konf_buf_t *instance);
 char * konf_buf__dup_line(const konf_buf_t *instance);
 
+konf_buf_t *konf_buftree_find(lub_bintree_t *instance, int fd);
 int konf_buftree_read(lub_bintree_t *instance, int fd);
 char * konf_buftree_parse(lub_bintree_t *instance, int fd);
 void konf_buftree_remove(lub_bintree_t *instance, int fd);
@@ -124,6 +124,29 @@ int konf_buf_add(konf_buf_t *this, void *str, size_t len)
 	return len;
 }
 
+/*--------------------------------------------------------- */
+/* Get the free space at the tail of the buffer. It's used to receive
+ * data right into the buffer from the sources other than fd.
+ * The received data must be accounted by konf_buf_commit().
+ */
+char * konf_buf_reserve(konf_buf_t *this, int *len)
+{
+	konf_buf_realloc(this, 0);
+	*len = this->size - this->pos;
+
+	return this->buf + this->pos;
+}
+
+/*--------------------------------------------------------- */
+int konf_buf_commit(konf_buf_t *this, int len)
+{
+	if ((len < 0) || (len > (this->size - this->pos)))
+		return -1;
+	this->pos += len;
+
+	return len;
+}
+
 /*--------------------------------------------------------- */
 int konf_buf_read(konf_buf_t *this)
 {
@@ -131,10 +154,7 @@ int konf_buf_read(konf_buf_t *this)
 	int buffer_size;
 	int nbytes;
 
-	konf_buf_realloc(this, 0);
-	buffer_size = this->size - this->pos;
-	buffer = this->buf + this->pos;
-
+	buffer = konf_buf_reserve(this, &buffer_size);
 	nbytes = read(this->fd, buffer, buffer_size);
 	if (nbytes > 0)
 		this->pos += nbytes;
@@ -172,8 +192,21 @@ char * konf_buf_parse(konf_buf_t *this)
 	str = konf_buf_string(this->buf, this->pos);
 
 	/* Remove parsed string from the buffer */
-	if (str) {
-		int len = strlen(str) + 1;
+	konf_buf_shift(this, str ? (strlen(str) + 1) : 0);
+
+	return str;
+}
+
+/*--------------------------------------------------------- */
+/* Remove the len bytes from the head of the buffer. It's used by
+ * the consumers working right within the buffer (see konf_buf__get_buf())
+ * to drop the already processed data without copying it.
+ */
+int konf_buf_shift(konf_buf_t *this, int len)
+{
+	if (len > this->pos)
+		len = this->pos;
+	if (len > 0) {
 		memmove(this->buf, &this->buf[len], this->pos - len);
 		this->pos -= len;
 		if (this->rpos >= len)
@@ -190,7 +223,7 @@ char * konf_buf_parse(konf_buf_t *this)
 		this->size -= KONF_BUF_CHUNK;
 	}
 
-	return str;
+	return len;
 }
 
 /*--------------------------------------------------------- */
@@ -221,6 +254,12 @@ int konf_buf__get_fd(const konf_buf_t * this)
 	return this->fd;
 }
 
+/*--------------------------------------------------------- */
+char * konf_buf__get_buf(const konf_buf_t *this)
+{
+	return this->buf;
+}
+
 /*--------------------------------------------------------- */
 int konf_buf__get_len(const konf_buf_t *this)
 {
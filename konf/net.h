@@ -1,11 +1,25 @@
 #ifndef _konf_net_h
 #define _konf_net_h
 
+#include <stdint.h>
 #include <konf/buf.h>
+#include <lub/types.h>
 
 typedef struct konf_client_s konf_client_t;
 
+/* The sink for the streamed data (i.e. dump). The chunk points right
+ * into the receive buffer and contains one or more complete '\n'
+ * terminated lines. The '\0' terminators and the empty line ending
+ * the stream are not passed. It's valid only while the sink is running.
+ * The non-zero return value stops the delivery.
+ */
+typedef int konf_client_sink_fn(void *udata, const char *chunk, size_t len);
+
 #define KONFD_SOCKET_PATH "/tmp/konfd.socket"
+/* The answer error for the stale node handle. The request can be
+ * repeated with the full pwd.
+ */
+#define KONF_CLIENT_ESTALE -2
 
 konf_client_t *konf_client_new(const char *path);
 void konf_client_free(konf_client_t *instance);
@@ -14,7 +28,42 @@ void konf_client_disconnect(konf_client_t *instance);
 int konf_client_reconnect(konf_client_t *instance);
 int konf_client_send(konf_client_t *instance, char *command);
 int konf_client__get_sock(konf_client_t *instance);
+void konf_client__set_shm(konf_client_t *instance, bool_t use_shm);
+bool_t konf_client__get_shm(const konf_client_t *instance);
+uint64_t konf_client__get_handle(const konf_client_t *instance);
+unsigned int konf_client__get_connects(const konf_client_t *instance);
 konf_buf_t * konf_client_recv_data(konf_client_t * instance, konf_buf_t *buf);
 int konf_client_recv_answer(konf_client_t * instance, konf_buf_t **data);
+int konf_client_recv_answer_stream(konf_client_t * instance,
+	konf_client_sink_fn *sink, void *udata);
+
+
+/* Asynchronous (non-blocking) client. The requests are pipelined.
+ * Each request gets the ID and the completion callback. The konfd
+ * answers the requests of the connection in order so the answers are
+ * matched to the requests in the FIFO manner. The streamed data
+ * (i.e. dump) is passed to the request's sink as it's received.
+ */
+typedef struct konf_async_s konf_async_t;
+/* The result is 0 for success and -1 for error (or lost connection) */
+typedef void konf_async_done_fn(void *udata, unsigned int id, int result);
+
+/* The events to wait for. Compatible with poll() and epoll() flags
+ * after conversion by the caller.
+ */
+#define KONF_ASYNC_EV_READ 0x01
+#define KONF_ASYNC_EV_WRITE 0x02
+#define KONF_ASYNC_EV_ERROR 0x04
+
+konf_async_t *konf_async_new(const char *path);
+void konf_async_free(konf_async_t *instance);
+int konf_async_connect(konf_async_t *instance);
+void konf_async_disconnect(konf_async_t *instance);
+int konf_async_request(konf_async_t *instance, const char *command,
+	konf_async_done_fn *done, konf_client_sink_fn *sink, void *udata);
+int konf_async_process(konf_async_t *instance, int events);
+int konf_async__get_fd(const konf_async_t *instance);
+int konf_async__get_events(const konf_async_t *instance);
+unsigned int konf_async__get_pending(const konf_async_t *instance);
 
 #endif
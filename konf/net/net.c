@@ -39,6 +39,10 @@ konf_client_t *konf_client_new(const char *path)
 
 	this->sock = -1; /* socket is not created yet */
 	this->path = strdup(path);
+	this->use_shm = BOOL_FALSE;
+	this->shm = NULL;
+	this->handle = 0;
+	this->connects = 0;
 
 	return this;
 }
@@ -55,6 +59,28 @@ void konf_client_free(konf_client_t *this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+/* Ask daemon for the shm transport. The client stays on the socket
+ * if the daemon doesn't support it.
+ */
+static void konf_client_shm_negotiate(konf_client_t *this)
+{
+	const char *command = "-m";
+	char *answer = NULL;
+
+	if (send(this->sock, command, strlen(command) + 1, MSG_NOSIGNAL) < 0)
+		return;
+	this->shm = konf_shm_recv(this->sock, &answer);
+	if (this->shm && (!answer || strcmp(answer, "-o"))) {
+		konf_shm_free(this->shm);
+		this->shm = NULL;
+	}
+#ifdef DEBUG
+	fprintf(stderr, "SHM: %s\n", this->shm ? "yes" : "no");
+#endif
+	free(answer);
+}
+
 /*--------------------------------------------------------- */
 int konf_client_connect(konf_client_t *this)
 {
@@ -76,7 +102,12 @@ int konf_client_connect(konf_client_t *this)
 	if (connect(this->sock, (struct sockaddr *)&raddr, sizeof(raddr))) {
 		close(this->sock);
 		this->sock = -1;
+		return this->sock;
 	}
+	this->connects++;
+
+	if ((this->sock >= 0) && this->use_shm)
+		konf_client_shm_negotiate(this);
 
 	return this->sock;
 }
@@ -84,6 +115,10 @@ int konf_client_connect(konf_client_t *this)
 /*--------------------------------------------------------- */
 void konf_client_disconnect(konf_client_t *this)
 {
+	if (this->shm) {
+		konf_shm_free(this->shm);
+		this->shm = NULL;
+	}
 	if (this->sock >= 0) {
 		close(this->sock);
 		this->sock = -1;
@@ -103,15 +138,68 @@ int konf_client_send(konf_client_t *this, char *command)
 	if (this->sock < 0)
 		return this->sock;
 
+	if (this->shm)
+		return konf_shm_write(this->shm, KONF_SHM_CLIENT,
+			command, strlen(command) + 1, 1);
+
 	return send(this->sock, command, strlen(command) + 1, MSG_NOSIGNAL);
 }
 
+/*--------------------------------------------------------- */
+/* Receive data from the daemon using the current transport */
+static int konf_client_read(konf_client_t *this, konf_buf_t *buf)
+{
+	char *data;
+	int len;
+	int nbytes;
+
+	if (!this->shm)
+		return konf_buf_read(buf);
+
+	data = konf_buf_reserve(buf, &len);
+	nbytes = konf_shm_read(this->shm, KONF_SHM_CLIENT, data, len, 1);
+	if (nbytes > 0)
+		konf_buf_commit(buf, nbytes);
+
+	return nbytes;
+}
+
 /*--------------------------------------------------------- */
 int konf_client__get_sock(konf_client_t *this)
 {
 	return this->sock;
 }
 
+/*--------------------------------------------------------- */
+/* Enable the shm transport negotiation on the next connect */
+void konf_client__set_shm(konf_client_t *this, bool_t use_shm)
+{
+	this->use_shm = use_shm;
+}
+
+/*--------------------------------------------------------- */
+bool_t konf_client__get_shm(const konf_client_t *this)
+{
+	return this->shm ? BOOL_TRUE : BOOL_FALSE;
+}
+
+/*--------------------------------------------------------- */
+/* The counter of connections. The node handles are valid within the
+ * connection they are given on only because the daemon can be
+ * restarted in between.
+ */
+unsigned int konf_client__get_connects(const konf_client_t *this)
+{
+	return this->connects;
+}
+
+/*--------------------------------------------------------- */
+/* The node handle given by the last answer or 0 */
+uint64_t konf_client__get_handle(const konf_client_t *this)
+{
+	return this->handle;
+}
+
 /*--------------------------------------------------------- */
 konf_buf_t * konf_client_recv_data(konf_client_t * this, konf_buf_t *buf)
 {
@@ -134,7 +222,7 @@ konf_buf_t * konf_client_recv_data(konf_client_t * this, konf_buf_t *buf)
 			}
 			free(str);
 		}
-	} while ((!processed) && (konf_buf_read(buf)) > 0);
+	} while ((!processed) && (konf_client_read(this, buf)) > 0);
 	if (!processed) {
 		konf_buf_delete(data);
 		return NULL;
@@ -144,7 +232,62 @@ konf_buf_t * konf_client_recv_data(konf_client_t * this, konf_buf_t *buf)
 }
 
 /*--------------------------------------------------------- */
-static int process_answer(konf_client_t * this, char *str, konf_buf_t *buf, konf_buf_t **data)
+/* Pass the streamed data to the sink right from the receive buffer.
+ * Only the complete lines are passed and dropped from the buffer.
+ * The '\0' line terminators are replaced by '\n' in place.
+ * The empty line is the end of the stream. Returns 1 if the end of
+ * stream is reached and 0 if more data is needed. The stopped flag is
+ * set when sink asks to stop the delivery. The rest of stream is
+ * skipped then.
+ */
+int konf_client_stream_parse(konf_buf_t *buf,
+	konf_client_sink_fn *sink, void *udata, int *stopped)
+{
+	char *data = konf_buf__get_buf(buf);
+	int len = konf_buf__get_len(buf);
+	int start = 0; /* Start of the current line */
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if ((data[i] != '\n') && (data[i] != '\0'))
+			continue;
+		if (i != start) {
+			/* The sink gets the '\n' terminated lines only */
+			data[i] = '\n';
+			start = i + 1;
+			continue;
+		}
+		/* The empty line. End of stream */
+		if ((start > 0) && !*stopped)
+			*stopped = sink(udata, data, start);
+		konf_buf_shift(buf, i + 1);
+		return 1;
+	}
+	/* Deliver the complete lines and drop them */
+	if ((start > 0) && !*stopped)
+		*stopped = sink(udata, data, start);
+	konf_buf_shift(buf, start);
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+static int recv_stream(konf_client_t * this, konf_buf_t *buf,
+	konf_client_sink_fn *sink, void *udata)
+{
+	int stopped = 0;
+
+	do {
+		if (konf_client_stream_parse(buf, sink, udata, &stopped))
+			return stopped ? -1 : 0;
+	} while (konf_client_read(this, buf) > 0);
+
+	return -1;
+}
+
+/*--------------------------------------------------------- */
+static int process_answer(konf_client_t * this, char *str, konf_buf_t *buf,
+	konf_client_sink_fn *sink, void *udata)
 {
 	int res;
 	konf_query_t *query;
@@ -167,13 +310,15 @@ static int process_answer(konf_client_t * this, char *str, konf_buf_t *buf, konf
 #endif
 	switch (konf_query__get_op(query)) {
 	case KONF_QUERY_OP_OK:
+		this->handle = konf_query__get_handle(query);
 		res = 0;
 		break;
 	case KONF_QUERY_OP_ERROR:
-		res = -1;
+		/* The daemon returns the stale handle back */
+		res = konf_query__get_handle(query) ? KONF_CLIENT_ESTALE : -1;
 		break;
 	case KONF_QUERY_OP_STREAM:
-		if (!(*data = konf_client_recv_data(this, buf)))
+		if (recv_stream(this, buf, sink, udata) < 0)
 			res = -1;
 		else
 			res = 1; /* wait for another answer */
@@ -190,7 +335,8 @@ static int process_answer(konf_client_t * this, char *str, konf_buf_t *buf, konf
 }
 
 /*--------------------------------------------------------- */
-int konf_client_recv_answer(konf_client_t * this, konf_buf_t **data)
+int konf_client_recv_answer_stream(konf_client_t * this,
+	konf_client_sink_fn *sink, void *udata)
 {
 	konf_buf_t *buf;
 	int nbytes;
@@ -201,27 +347,65 @@ int konf_client_recv_answer(konf_client_t * this, konf_buf_t **data)
 	if ((konf_client_connect(this) < 0))
 		return -1;
 
+	this->handle = 0;
 	buf = konf_buf_new(konf_client__get_sock(this));
-	while ((!processed) && (nbytes = konf_buf_read(buf)) > 0) {
+	while ((!processed) && (nbytes = konf_client_read(this, buf)) > 0) {
 		while ((str = konf_buf_parse(buf))) {
-			konf_buf_t *tmpdata = NULL;
-			retval = process_answer(this, str, buf, &tmpdata);
+			retval = process_answer(this, str, buf, sink, udata);
 			free(str);
 			if (retval < 0) {
 				konf_buf_delete(buf);
 				return retval;
 			}
-			if (retval == 0)
+			if (retval == 0) {
 				processed = 1;
-			if (tmpdata) {
-				if (*data)
-					konf_buf_delete(*data);
-				*data = tmpdata;
+				break;
 			}
 		}
 	}
 	konf_buf_delete(buf);
+	/* The connection is lost before the answer. The next request
+	 * connects again.
+	 */
+	if (!processed) {
+		konf_client_disconnect(this);
+		return -1;
+	}
 
 	return retval;
 }
 
+/*--------------------------------------------------------- */
+/* The sink to collect the whole stream within the konf_buf_t */
+static int collect_data(void *udata, const char *chunk, size_t len)
+{
+	konf_buf_t **data = (konf_buf_t **)udata;
+
+	konf_buf_add(*data, (void *)chunk, len);
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+int konf_client_recv_answer(konf_client_t * this, konf_buf_t **data)
+{
+	konf_buf_t *tmpdata;
+	int retval;
+
+	if ((konf_client_connect(this) < 0))
+		return -1;
+
+	tmpdata = konf_buf_new(konf_client__get_sock(this));
+	retval = konf_client_recv_answer_stream(this, collect_data, &tmpdata);
+	if ((retval < 0) || (konf_buf__get_len(tmpdata) == 0)) {
+		konf_buf_delete(tmpdata);
+		return retval;
+	}
+	/* The stream terminator */
+	konf_buf_add(tmpdata, "", 1);
+	if (*data)
+		konf_buf_delete(*data);
+	*data = tmpdata;
+
+	return retval;
+}
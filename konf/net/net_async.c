@@ -0,0 +1,323 @@
+/*
+ * net_async.c
+ *
+ * The asynchronous (non-blocking) client for the konfd daemon. It's
+ * suitable for the poll()/epoll() based event loops.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <sys/un.h>
+#include <fcntl.h>
+
+#include "konf/buf.h"
+#include "konf/query.h"
+#include "lub/list.h"
+#include "private.h"
+
+/* Don't use UNIX_PATH_MAX due to portability issues */
+#define USOCK_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
+
+/* OpenBSD has no MSG_NOSIGNAL flag.
+ * The SIGPIPE must be ignored in application.
+ */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/*--------------------------------------------------------- */
+static int discard_data(void *udata, const char *chunk, size_t len)
+{
+	udata = udata; /* Happy compiler */
+	chunk = chunk;
+	len = len;
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+konf_async_t *konf_async_new(const char *path)
+{
+	konf_async_t *this;
+
+	if (!path)
+		return NULL;
+
+	if (!(this = malloc(sizeof(*this))))
+		return NULL;
+
+	this->sock = -1; /* socket is not created yet */
+	this->path = strdup(path);
+	this->next_id = 1;
+	this->state = KONF_ASYNC_STATE_ANSWER;
+	this->ibuf = NULL;
+	this->obuf = NULL;
+	this->reqs = lub_list_new(NULL);
+
+	return this;
+}
+
+/*--------------------------------------------------------- */
+static void konf_async_complete(konf_async_req_t *req, int result)
+{
+	if (req->done)
+		req->done(req->udata, req->id, result);
+	free(req);
+}
+
+/*--------------------------------------------------------- */
+/* Complete all the pending requests with error. The list is detached
+ * first so the callbacks can issue the new requests.
+ */
+static void konf_async_fail_all(konf_async_t *this)
+{
+	lub_list_t *reqs = this->reqs;
+	lub_list_node_t *iter;
+
+	this->reqs = lub_list_new(NULL);
+	while ((iter = lub_list__get_head(reqs))) {
+		konf_async_req_t *req = lub_list_node__get_data(iter);
+		lub_list_del(reqs, iter);
+		lub_list_node_free(iter);
+		konf_async_complete(req, -1);
+	}
+	lub_list_free(reqs);
+}
+
+/*--------------------------------------------------------- */
+void konf_async_free(konf_async_t *this)
+{
+	if (!this)
+		return;
+	konf_async_disconnect(this);
+	lub_list_free(this->reqs);
+	free(this->path);
+
+	free(this);
+}
+
+/*--------------------------------------------------------- */
+/* The connection to the local UNIX socket is established at once so
+ * the connect() itself is blocking. The socket becomes non-blocking
+ * after that.
+ */
+int konf_async_connect(konf_async_t *this)
+{
+	struct sockaddr_un raddr;
+	int flags;
+
+	if (this->sock >= 0)
+		return this->sock;
+
+	if ((this->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return this->sock;
+
+#ifdef FD_CLOEXEC
+	fcntl(this->sock, F_SETFD, fcntl(this->sock, F_GETFD) | FD_CLOEXEC);
+#endif
+
+	raddr.sun_family = AF_UNIX;
+	strncpy(raddr.sun_path, this->path, USOCK_PATH_MAX);
+	raddr.sun_path[USOCK_PATH_MAX - 1] = '\0';
+	if (connect(this->sock, (struct sockaddr *)&raddr, sizeof(raddr))) {
+		close(this->sock);
+		this->sock = -1;
+		return this->sock;
+	}
+
+	flags = fcntl(this->sock, F_GETFL);
+	fcntl(this->sock, F_SETFL, flags | O_NONBLOCK);
+	this->ibuf = konf_buf_new(this->sock);
+	this->obuf = konf_buf_new(this->sock);
+	this->state = KONF_ASYNC_STATE_ANSWER;
+
+	return this->sock;
+}
+
+/*--------------------------------------------------------- */
+/* Close connection. All the pending requests are completed with
+ * error.
+ */
+void konf_async_disconnect(konf_async_t *this)
+{
+	if (this->sock >= 0) {
+		close(this->sock);
+		this->sock = -1;
+	}
+	if (this->ibuf) {
+		konf_buf_delete(this->ibuf);
+		this->ibuf = NULL;
+	}
+	if (this->obuf) {
+		konf_buf_delete(this->obuf);
+		this->obuf = NULL;
+	}
+	konf_async_fail_all(this);
+}
+
+/*--------------------------------------------------------- */
+/* Queue the request. It will be sent when the socket is writable.
+ * Returns the request ID or -1 on error.
+ */
+int konf_async_request(konf_async_t *this, const char *command,
+	konf_async_done_fn *done, konf_client_sink_fn *sink, void *udata)
+{
+	konf_async_req_t *req;
+
+	if (!command)
+		return -1;
+	if (konf_async_connect(this) < 0)
+		return -1;
+
+	if (!(req = malloc(sizeof(*req))))
+		return -1;
+	req->id = this->next_id++;
+	if (this->next_id > 0x7fffffff)
+		this->next_id = 1;
+	req->done = done;
+	req->sink = sink ? sink : discard_data;
+	req->udata = udata;
+	req->stopped = 0;
+	req->result = 0;
+
+	konf_buf_add(this->obuf, (void *)command, strlen(command) + 1);
+	lub_list_add(this->reqs, req);
+
+	return req->id;
+}
+
+/*--------------------------------------------------------- */
+/* Match the received answers to the pending requests */
+static int konf_async_parse(konf_async_t *this)
+{
+	lub_list_node_t *iter;
+
+	while ((iter = lub_list__get_head(this->reqs))) {
+		konf_async_req_t *req = lub_list_node__get_data(iter);
+		konf_query_t *query;
+		char *str;
+		int result = -1;
+
+		if (KONF_ASYNC_STATE_STREAM == this->state) {
+			if (!konf_client_stream_parse(this->ibuf,
+				req->sink, req->udata, &req->stopped))
+				break;
+			this->state = KONF_ASYNC_STATE_ANSWER;
+			if (req->stopped)
+				req->result = -1;
+			continue;
+		}
+
+		if (!(str = konf_buf_parse(this->ibuf)))
+			break;
+		query = konf_query_new();
+		if (konf_query_parse_str(query, str) < 0) {
+			konf_query_free(query);
+			free(str);
+			return -1;
+		}
+		free(str);
+		switch (konf_query__get_op(query)) {
+		case KONF_QUERY_OP_STREAM:
+			this->state = KONF_ASYNC_STATE_STREAM;
+			konf_query_free(query);
+			continue;
+		case KONF_QUERY_OP_OK:
+			result = req->result;
+			break;
+		default:
+			result = -1;
+			break;
+		}
+		konf_query_free(query);
+
+		lub_list_del(this->reqs, iter);
+		lub_list_node_free(iter);
+		konf_async_complete(req, result);
+		/* The callback can disconnect the client */
+		if (!this->ibuf)
+			return 0;
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* Process the events got from event loop for the konf_async__get_fd()
+ * descriptor. Returns -1 if the connection is lost.
+ */
+int konf_async_process(konf_async_t *this, int events)
+{
+	if (this->sock < 0)
+		return -1;
+
+	if (events & KONF_ASYNC_EV_ERROR)
+		goto fail;
+
+	/* Send the queued requests */
+	if ((events & KONF_ASYNC_EV_WRITE) &&
+		(konf_buf__get_len(this->obuf) > 0)) {
+		ssize_t nbytes = send(this->sock,
+			konf_buf__get_buf(this->obuf),
+			konf_buf__get_len(this->obuf),
+			MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (nbytes > 0)
+			konf_buf_shift(this->obuf, nbytes);
+		else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+			(errno != EINTR))
+			goto fail;
+	}
+
+	/* Receive answers */
+	if (events & KONF_ASYNC_EV_READ) {
+		int nbytes;
+		while ((nbytes = konf_buf_read(this->ibuf)) > 0) {
+			if (konf_async_parse(this) < 0)
+				goto fail;
+			if (this->sock < 0)
+				return -1;
+		}
+		if (0 == nbytes)
+			goto fail;
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+			(errno != EINTR))
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	konf_async_disconnect(this);
+	return -1;
+}
+
+/*--------------------------------------------------------- */
+int konf_async__get_fd(const konf_async_t *this)
+{
+	return this->sock;
+}
+
+/*--------------------------------------------------------- */
+int konf_async__get_events(const konf_async_t *this)
+{
+	int events = 0;
+
+	if (this->sock < 0)
+		return 0;
+	events |= KONF_ASYNC_EV_READ;
+	if (konf_buf__get_len(this->obuf) > 0)
+		events |= KONF_ASYNC_EV_WRITE;
+
+	return events;
+}
+
+/*--------------------------------------------------------- */
+unsigned int konf_async__get_pending(const konf_async_t *this)
+{
+	return lub_list_len(this->reqs);
+}
@@ -2,10 +2,45 @@
 #define _konf_net_private_h
 
 #include "konf/net.h"
+#include "konf/shm.h"
+#include "lub/list.h"
+#include "lub/types.h"
 
 struct konf_client_s {
 	int sock;
 	char *path;
+	bool_t use_shm; /* Try to negotiate the shm transport */
+	konf_shm_t *shm; /* The shm transport if negotiated */
+	uint64_t handle; /* The node handle from the last answer */
+	unsigned int connects; /* The number of connections made */
 };
 
+typedef enum {
+	KONF_ASYNC_STATE_ANSWER, /* Wait for answer */
+	KONF_ASYNC_STATE_STREAM /* Receive the streamed data */
+} konf_async_state_t;
+
+typedef struct konf_async_req_s konf_async_req_t;
+struct konf_async_req_s {
+	unsigned int id;
+	konf_async_done_fn *done;
+	konf_client_sink_fn *sink;
+	void *udata;
+	int stopped; /* The sink asked to stop delivery */
+	int result;
+};
+
+struct konf_async_s {
+	int sock;
+	char *path;
+	unsigned int next_id;
+	konf_async_state_t state;
+	konf_buf_t *ibuf; /* Received data */
+	konf_buf_t *obuf; /* Data to send */
+	lub_list_t *reqs; /* Requests waiting for answer */
+};
+
+int konf_client_stream_parse(konf_buf_t *buf,
+	konf_client_sink_fn *sink, void *udata, int *stopped);
+
 #endif
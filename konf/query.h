@@ -1,6 +1,7 @@
 #ifndef _konf_query_h
 #define _konf_query_h
 
+#include <stdint.h>
 #include <lub/types.h>
 
 typedef enum
@@ -11,7 +12,10 @@ typedef enum
   KONF_QUERY_OP_SET,
   KONF_QUERY_OP_UNSET,
   KONF_QUERY_OP_STREAM,
-  KONF_QUERY_OP_DUMP
+  KONF_QUERY_OP_DUMP,
+  KONF_QUERY_OP_SHM,
+  KONF_QUERY_OP_COPY,
+  KONF_QUERY_OP_WATCH
 } konf_query_op_t;
 
 typedef struct konf_query_s konf_query_t;
@@ -34,5 +38,10 @@ bool_t konf_query__get_seq(konf_query_t *instance);
 unsigned short konf_query__get_seq_num(konf_query_t *instance);
 bool_t konf_query__get_unique(konf_query_t *instance);
 int konf_query__get_depth(konf_query_t *instance);
+const char * konf_query__get_store(konf_query_t *instance);
+const char * konf_query__get_from(konf_query_t *instance);
+uint64_t konf_query__get_handle(konf_query_t *instance);
+bool_t konf_query__get_get_handle(konf_query_t *instance);
+bool_t konf_query__get_json(konf_query_t *instance);
 
 #endif
@@ -17,6 +17,12 @@ struct konf_query_s {
 	bool_t splitter;
 	bool_t unique;
 	int depth;
+	char *store; /* Datastore name */
+	char *from; /* Source datastore name for copy */
+	uint64_t handle; /* The node handle used instead of pwd */
+	bool_t get_handle; /* Ask for the handle of pwd node */
+	bool_t json; /* Dump as JSON Lines */
+	char *buf; /* The parsed words. The strings above point to it. */
 };
 
 #endif
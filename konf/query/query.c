@@ -4,25 +4,63 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <errno.h>
+#include <ctype.h>
 #include <assert.h>
-#if WITH_INTERNAL_GETOPT
-#include "libc/getopt.h"
-#else
-#ifdef HAVE_GETOPT_H
-#include <getopt.h>
-#endif
-#endif
+#include <errno.h>
 
 #include "lub/types.h"
-#include "lub/argv.h"
 #include "lub/string.h"
 #include "private.h"
 
+/* The query options. The parser accepts the getopt_long() syntax:
+ * the short options can be grouped, the option argument can follow
+ * the option within the same word or be the next word, the long
+ * options can be abbreviated, "--" finishes the options. The
+ * non-option words are the pwd elements wherever they are.
+ */
+typedef struct konf_query_opt_s konf_query_opt_t;
+struct konf_query_opt_s {
+	const char *name;
+	char val;
+	bool_t arg;
+};
+
+static const konf_query_opt_t konf_query_opts[] = {
+	{"set",		's', BOOL_FALSE},
+	{"unset",	'u', BOOL_FALSE},
+	{"ok",		'o', BOOL_FALSE},
+	{"error",	'e', BOOL_FALSE},
+	{"dump",	'd', BOOL_FALSE},
+	{"stream",	't', BOOL_FALSE},
+	{"shm",		'm', BOOL_FALSE},
+	{"copy",	'c', BOOL_FALSE},
+	{"watch",	'w', BOOL_FALSE},
+	{"priority",	'p', BOOL_TRUE},
+	{"seq",		'q', BOOL_TRUE},
+	{"pattern",	'r', BOOL_TRUE},
+	{"line",	'l', BOOL_TRUE},
+	{"file",	'f', BOOL_TRUE},
+	{"splitter",	'i', BOOL_FALSE},
+	{"non-unique",	'n', BOOL_FALSE},
+	{"depth",	'h', BOOL_TRUE},
+	{"store",	'D', BOOL_TRUE},
+	{"from",	'F', BOOL_TRUE},
+	{"handle",	'H', BOOL_TRUE},
+	{"get-handle",	'G', BOOL_FALSE},
+	{"json",	'j', BOOL_FALSE},
+	{NULL,		0, BOOL_FALSE}
+};
+
+/* The source of words. The query string is split to the words in
+ * place. The argv is copied to the NUL-separated words.
+ */
+typedef struct konf_query_words_s konf_query_words_t;
+struct konf_query_words_s {
+	char *pos;
+	char *end; /* NULL for the query string */
+};
+
 /*-------------------------------------------------------- */
 konf_query_t *konf_query_new(void)
 {
@@ -43,19 +81,22 @@ konf_query_t *konf_query_new(void)
 	this->splitter = BOOL_TRUE;
 	this->unique = BOOL_TRUE;
 	this->depth = -1;
+	this->store = NULL;
+	this->from = NULL;
+	this->handle = 0;
+	this->get_handle = BOOL_FALSE;
+	this->json = BOOL_FALSE;
+	this->buf = NULL;
 
 	return this;
 }
 
 /*-------------------------------------------------------- */
-void konf_query_add_pwd(konf_query_t *this, char *str)
+static void konf_query_add_pwd(konf_query_t *this, char *str)
 {
 	size_t new_size;
 	char **tmp;
 
-	if (!this)
-		return;
-
 	new_size = ((this->pwdc + 1) * sizeof(char *));
 
 	/* resize the pwd vector */
@@ -63,141 +104,267 @@ void konf_query_add_pwd(konf_query_t *this, char *str)
 	assert(tmp);
 	this->pwd = tmp;
 	/* insert reference to the pwd component */
-	this->pwd[this->pwdc++] = strdup(str);
+	this->pwd[this->pwdc++] = str;
 }
 
 /*-------------------------------------------------------- */
 void konf_query_free(konf_query_t *this)
 {
-	unsigned i;
-
-	free(this->pattern);
-	free(this->line);
-	free(this->path);
-	if (this->pwdc > 0) {
-		for (i = 0; i < this->pwdc; i++)
-			free(this->pwd[i]);
-		free(this->pwd);
-	}
-
+	free(this->pwd);
+	free(this->buf);
 	free(this);
 }
 
 /*-------------------------------------------------------- */
-/* Parse query */
-int konf_query_parse(konf_query_t *this, int argc, char **argv)
+/* Get the next word of the query string. The word is unquoted and
+ * unescaped in place like lub_argv_new() does.
+ */
+static char *konf_query_word(char **pos)
 {
-	int i = 0;
-	int pwdc = 0;
-
-	static const char *shortopts = "suoedtp:q:r:l:f:inh:";
-#ifdef HAVE_GETOPT_LONG
-	static const struct option longopts[] = {
-		{"set",		0, NULL, 's'},
-		{"unset",	0, NULL, 'u'},
-		{"ok",		0, NULL, 'o'},
-		{"error",	0, NULL, 'e'},
-		{"dump",	0, NULL, 'd'},
-		{"stream",	0, NULL, 't'},
-		{"priority",	1, NULL, 'p'},
-		{"seq",		1, NULL, 'q'},
-		{"pattern",	1, NULL, 'r'},
-		{"line",	1, NULL, 'l'},
-		{"file",	1, NULL, 'f'},
-		{"splitter",	0, NULL, 'i'},
-		{"non-unique",	0, NULL, 'n'},
-		{"depth",	1, NULL, 'h'},
-		{NULL,		0, NULL, 0}
-	};
-#endif
-
-	optind = 0; /* It must be 1 for QNX6. This system has no getopt.h */
-	while(1) {
-		int opt;
-#ifdef HAVE_GETOPT_LONG
-		opt = getopt_long(argc, argv, shortopts, longopts, NULL);
-#else
-		opt = getopt(argc, argv, shortopts);
-#endif
-		if (-1 == opt)
-			break;
-		switch (opt) {
-		case 'o':
-			this->op = KONF_QUERY_OP_OK;
-			break;
-		case 'e':
-			this->op = KONF_QUERY_OP_ERROR;
-			break;
-		case 's':
-			this->op = KONF_QUERY_OP_SET;
-			break;
-		case 'u':
-			this->op = KONF_QUERY_OP_UNSET;
-			break;
-		case 'd':
-			this->op = KONF_QUERY_OP_DUMP;
+	char *s = *pos;
+	char *word;
+	char *p;
+	int quoted = 0;
+
+	while (*s && isspace((unsigned char)*s))
+		s++;
+	if ('"' == *s) {
+		quoted = 1;
+		s++;
+	}
+	if (!*s && !quoted) {
+		*pos = s;
+		return NULL;
+	}
+	word = p = s;
+	while (*s) {
+		if ('\\' == *s) {
+			s++;
+			if (*s)
+				*p++ = *s++;
+			continue;
+		}
+		if (!quoted && isspace((unsigned char)*s))
 			break;
-		case 't':
-			this->op = KONF_QUERY_OP_STREAM;
+		/* End of a quoted string */
+		if ('"' == *s)
 			break;
-		case 'p':
-			{
-			long val = 0;
-			char *endptr;
+		*p++ = *s++;
+	}
+	/* Skip the separator or the closing quote */
+	*pos = *s ? s + 1 : s;
+	*p = '\0';
 
-			val = strtol(optarg, &endptr, 0);
-			if (endptr == optarg)
-				break;
-			if ((val > 0xffff) || (val < 0))
-				break;
+	return word;
+}
+
+/*-------------------------------------------------------- */
+static char *konf_query_next(konf_query_words_t *words)
+{
+	char *word;
+
+	if (!words->end)
+		return konf_query_word(&words->pos);
+	if (words->pos >= words->end)
+		return NULL;
+	word = words->pos;
+	words->pos += strlen(word) + 1;
+
+	return word;
+}
+
+/*-------------------------------------------------------- */
+static int konf_query_num(const char *arg, long max, long *val)
+{
+	char *endptr;
+
+	*val = strtol(arg, &endptr, 0);
+	if (endptr == arg)
+		return -1;
+	if ((*val > max) || (*val < 0))
+		return -1;
+
+	return 0;
+}
+
+/*-------------------------------------------------------- */
+/* Apply the option. The arg points to the buffer of query. */
+static void konf_query_opt(konf_query_t *this, char opt, char *arg)
+{
+	long val;
+
+	switch (opt) {
+	case 'o':
+		this->op = KONF_QUERY_OP_OK;
+		break;
+	case 'e':
+		this->op = KONF_QUERY_OP_ERROR;
+		break;
+	case 's':
+		this->op = KONF_QUERY_OP_SET;
+		break;
+	case 'u':
+		this->op = KONF_QUERY_OP_UNSET;
+		break;
+	case 'd':
+		this->op = KONF_QUERY_OP_DUMP;
+		break;
+	case 't':
+		this->op = KONF_QUERY_OP_STREAM;
+		break;
+	case 'm':
+		this->op = KONF_QUERY_OP_SHM;
+		break;
+	case 'c':
+		this->op = KONF_QUERY_OP_COPY;
+		break;
+	case 'w':
+		this->op = KONF_QUERY_OP_WATCH;
+		break;
+	case 'p':
+		if (konf_query_num(arg, 0xffff, &val) == 0)
 			this->priority = (unsigned short)val;
-			break;
-			}
-		case 'q':
-			{
-			long val = 0;
-			char *endptr;
-
-			this->seq = BOOL_TRUE;
-			val = strtol(optarg, &endptr, 0);
-			if (endptr == optarg)
-				break;
-			if ((val > 0xffff) || (val < 0))
-				break;
+		break;
+	case 'q':
+		this->seq = BOOL_TRUE;
+		if (konf_query_num(arg, 0xffff, &val) == 0)
 			this->seq_num = (unsigned short)val;
+		break;
+	case 'r':
+		this->pattern = arg;
+		break;
+	case 'l':
+		this->line = arg;
+		break;
+	case 'f':
+		this->path = arg;
+		break;
+	case 'D':
+		this->store = arg;
+		break;
+	case 'F':
+		this->from = arg;
+		break;
+	case 'H':
+		{
+		unsigned long long uval;
+		char *endptr;
+
+		errno = 0;
+		uval = strtoull(arg, &endptr, 0);
+		if ((endptr == arg) || errno)
 			break;
-			}
-		case 'r':
-			this->pattern = strdup(optarg);
-			break;
-		case 'l':
-			this->line = strdup(optarg);
-			break;
-		case 'f':
-			this->path = strdup(optarg);
-			break;
-		case 'i':
-			this->splitter = BOOL_FALSE;
-			break;
-		case 'n':
-			this->unique = BOOL_FALSE;
+		this->handle = (uint64_t)uval;
+		break;
+		}
+	case 'G':
+		this->get_handle = BOOL_TRUE;
+		break;
+	case 'j':
+		this->json = BOOL_TRUE;
+		break;
+	case 'i':
+		this->splitter = BOOL_FALSE;
+		break;
+	case 'n':
+		this->unique = BOOL_FALSE;
+		break;
+	case 'h':
+		if (konf_query_num(arg, 0xffff, &val) == 0)
+			this->depth = (unsigned short)val;
+		break;
+	default:
+		break;
+	}
+}
+
+/*-------------------------------------------------------- */
+/* The long option. The unknown and ambiguous options are ignored. */
+static void konf_query_long(konf_query_t *this, konf_query_words_t *words,
+	char *name)
+{
+	const konf_query_opt_t *opt;
+	const konf_query_opt_t *found = NULL;
+	unsigned int matches = 0;
+	char *arg = NULL;
+	size_t len = strcspn(name, "=");
+
+	for (opt = konf_query_opts; opt->name; opt++) {
+		if (strncmp(opt->name, name, len))
+			continue;
+		/* The exact match wins over abbreviations */
+		if (strlen(opt->name) == len) {
+			found = opt;
+			matches = 1;
 			break;
-		case 'h':
-			{
-			long val = 0;
-			char *endptr;
+		}
+		found = opt;
+		matches++;
+	}
+	if (matches != 1)
+		return;
 
-			val = strtol(optarg, &endptr, 0);
-			if (endptr == optarg)
-				break;
-			if ((val > 0xffff) || (val < 0))
+	if ('=' == name[len]) {
+		if (!found->arg)
+			return;
+		arg = name + len + 1;
+	} else if (found->arg) {
+		if (!(arg = konf_query_next(words)))
+			return;
+	}
+	konf_query_opt(this, found->val, arg);
+}
+
+/*-------------------------------------------------------- */
+/* The group of short options */
+static void konf_query_short(konf_query_t *this, konf_query_words_t *words,
+	char *str)
+{
+	for (; *str; str++) {
+		const konf_query_opt_t *opt;
+		char *arg;
+
+		for (opt = konf_query_opts; opt->name; opt++)
+			if (opt->val == *str)
 				break;
-			this->depth = (unsigned short)val;
-			break;
-			}
-		default:
-			break;
+		if (!opt->name)
+			continue; /* Unknown option */
+		if (!opt->arg) {
+			konf_query_opt(this, opt->val, NULL);
+			continue;
 		}
+		/* The rest of word or the next word is the argument */
+		if (str[1])
+			arg = str + 1;
+		else if (!(arg = konf_query_next(words)))
+			return;
+		konf_query_opt(this, opt->val, arg);
+		return;
+	}
+}
+
+/*-------------------------------------------------------- */
+/* Parse the words within single pass */
+static int konf_query_parse_words(konf_query_t *this,
+	konf_query_words_t *words)
+{
+	char *word;
+	bool_t opts = BOOL_TRUE;
+
+	while ((word = konf_query_next(words))) {
+		if (!opts || ('-' != word[0]) || ('\0' == word[1])) {
+			konf_query_add_pwd(this, word);
+			continue;
+		}
+		if ('-' != word[1]) {
+			konf_query_short(this, words, word + 1);
+			continue;
+		}
+		if ('\0' == word[2]) {
+			opts = BOOL_FALSE; /* The "--" */
+			continue;
+		}
+		konf_query_long(this, words, word + 2);
 	}
 
 	/* Check options */
@@ -209,36 +376,56 @@ int konf_query_parse(konf_query_t *this, int argc, char **argv)
 		if (!this->line)
 			return -1;
 	}
+	if (KONF_QUERY_OP_COPY == this->op) {
+		if (!this->store || !this->from)
+			return -1;
+	}
 
-	if ((pwdc = argc - optind) < 0)
-		return -1;
+	return 0;
+}
 
-	for (i = 0; i < pwdc; i++)
-		konf_query_add_pwd(this, argv[optind + i]);
+/*-------------------------------------------------------- */
+/* Parse query. The argv[0] is skipped. The query is parsed once. */
+int konf_query_parse(konf_query_t *this, int argc, char **argv)
+{
+	konf_query_words_t words;
+	size_t len = 0;
+	char *p;
+	int i;
 
-	return 0;
+	if (this->buf)
+		return -1;
+	for (i = 1; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+	if (!(this->buf = malloc(len + 1)))
+		return -1;
+	for (i = 1, p = this->buf; i < argc; i++) {
+		size_t size = strlen(argv[i]) + 1;
+		memcpy(p, argv[i], size);
+		p += size;
+	}
+	words.pos = this->buf;
+	words.end = p;
+
+	return konf_query_parse_words(this, &words);
 }
 
 /*-------------------------------------------------------- */
-/* Parse query string */
+/* Parse query string. The query keeps the copy of string and the
+ * parsed strings point to it. The parser is reentrant.
+ */
 int konf_query_parse_str(konf_query_t *this, char *str)
 {
-	int res;
-	lub_argv_t *lub_argv;
-	char **str_argv;
-	int str_argc;
-
-	/* Make args from string */
-	lub_argv = lub_argv_new(str, 0);
-	str_argv = lub_argv__get_argv(lub_argv, "");
-	str_argc = lub_argv__get_count(lub_argv) + 1;
-
-	/* Parse query */
-	res = konf_query_parse(this, str_argc, str_argv);
-	lub_argv__free_argv(str_argv);
-	lub_argv_delete(lub_argv);
-
-	return res;
+	konf_query_words_t words;
+
+	if (this->buf)
+		return -1;
+	if (!(this->buf = strdup(str)))
+		return -1;
+	words.pos = this->buf;
+	words.end = NULL;
+
+	return konf_query_parse_words(this, &words);
 }
 
 /*-------------------------------------------------------- */
@@ -317,3 +504,33 @@ int konf_query__get_depth(konf_query_t *this)
 {
 	return this->depth;
 }
+
+/*-------------------------------------------------------- */
+const char * konf_query__get_store(konf_query_t *this)
+{
+	return this->store;
+}
+
+/*-------------------------------------------------------- */
+const char * konf_query__get_from(konf_query_t *this)
+{
+	return this->from;
+}
+
+/*-------------------------------------------------------- */
+uint64_t konf_query__get_handle(konf_query_t *this)
+{
+	return this->handle;
+}
+
+/*-------------------------------------------------------- */
+bool_t konf_query__get_get_handle(konf_query_t *this)
+{
+	return this->get_handle;
+}
+
+/*-------------------------------------------------------- */
+bool_t konf_query__get_json(konf_query_t *this)
+{
+	return this->json;
+}
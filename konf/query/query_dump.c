@@ -1,6 +1,8 @@
 #include "private.h"
 #include "lub/dump.h"
 
+#include <inttypes.h>
+
 /*-------------------------------------------------------- */
 void konf_query_dump(konf_query_t *this)
 {
@@ -28,6 +30,15 @@ void konf_query_dump(konf_query_t *this)
 	case KONF_QUERY_OP_STREAM:
 		op = "STREAM";
 		break;
+	case KONF_QUERY_OP_SHM:
+		op = "SHM";
+		break;
+	case KONF_QUERY_OP_COPY:
+		op = "COPY";
+		break;
+	case KONF_QUERY_OP_WATCH:
+		op = "WATCH";
+		break;
 	default:
 		op = "UNKNOWN";
 		break;
@@ -43,6 +54,11 @@ void konf_query_dump(konf_query_t *this)
 	lub_dump_printf("splitter  : %s\n", this->splitter ? "true" : "false");
 	lub_dump_printf("unique    : %s\n", this->unique ? "true" : "false");
 	lub_dump_printf("depth     : %d\n", this->depth);
+	lub_dump_printf("store     : %s\n", this->store);
+	lub_dump_printf("from      : %s\n", this->from);
+	lub_dump_printf("handle    : 0x%" PRIx64 "\n", this->handle);
+	lub_dump_printf("get_handle: %s\n", this->get_handle ? "true" : "false");
+	lub_dump_printf("json      : %s\n", this->json ? "true" : "false");
 
 	lub_dump_undent();
 }
@@ -0,0 +1,61 @@
+/*
+ * shm.h
+ */
+ /**
+\ingroup konf
+\defgroup konf_shm shm
+@{
+
+\brief The shared memory transport between konfd and its clients.
+
+The memfd-backed region holds two SPSC byte rings: the requests ring
+(client to daemon) and the answers ring (daemon to client). The data
+within the rings is the same as the data sent over the UNIX socket.
+The eventfd wakeups are used only when the consumer (or the producer
+for full ring) is idle. The transport is negotiated over the existing
+UNIX socket. The socket is kept to detect the peer's death.
+
+*/
+#ifndef _konf_shm_h
+#define _konf_shm_h
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct konf_shm_s konf_shm_t;
+
+typedef enum {
+	KONF_SHM_CLIENT,
+	KONF_SHM_SERVER
+} konf_shm_side_t;
+
+/* The size of each ring */
+#define KONF_SHM_RING_SIZE (64 * 1024)
+
+/*=====================================
+ * SHM INTERFACE
+ *===================================== */
+/*-----------------
+ * meta functions
+ *----------------- */
+konf_shm_t *konf_shm_new(int sock, unsigned int size);
+konf_shm_t *konf_shm_recv(int sock, char **answer);
+/*-----------------
+ * methods
+ *----------------- */
+void konf_shm_free(konf_shm_t *instance);
+int konf_shm_send(konf_shm_t *instance, const char *answer);
+ssize_t konf_shm_write(konf_shm_t *instance, konf_shm_side_t side,
+	const void *data, size_t len, int block);
+ssize_t konf_shm_read(konf_shm_t *instance, konf_shm_side_t side,
+	void *data, size_t len, int block);
+int konf_shm_idle(konf_shm_t *instance, konf_shm_side_t side);
+/*-----------------
+ * attributes
+ *----------------- */
+int konf_shm__get_wait_fd(const konf_shm_t *instance, konf_shm_side_t side);
+int konf_shm__get_sock(const konf_shm_t *instance);
+void konf_shm__set_sock(konf_shm_t *instance, int sock);
+
+#endif				/* _konf_shm_h */
+/** @} konf_shm */
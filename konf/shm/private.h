@@ -0,0 +1,49 @@
+/*
+ * konf/shm/private.h
+ */
+#ifndef _konf_shm_private_h
+#define _konf_shm_private_h
+
+#include <stdint.h>
+
+#include "konf/shm.h"
+
+#define KONF_SHM_MAGIC 0x4b534852 /* "KSHR" */
+
+/*---------------------------------------------------------
+ * PRIVATE TYPES
+ *--------------------------------------------------------- */
+/* The ring control block within the shared memory. The head is
+ * written by producer only, the tail is written by consumer only.
+ * The indexes are free running.
+ */
+typedef struct konf_shm_ring_s konf_shm_ring_t;
+struct konf_shm_ring_s {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t rwait; /* Consumer sleeps on empty ring */
+	uint32_t wwait; /* Producer sleeps on full ring */
+	uint32_t offset; /* Data offset from the start of region */
+	uint32_t pad[11]; /* Keep rings on the different cache lines */
+};
+
+typedef struct konf_shm_hdr_s konf_shm_hdr_t;
+struct konf_shm_hdr_s {
+	uint32_t magic;
+	uint32_t size; /* Size of each ring. The power of 2 */
+	uint32_t pad[14];
+	konf_shm_ring_t req; /* Client to server */
+	konf_shm_ring_t ans; /* Server to client */
+};
+
+struct konf_shm_s {
+	konf_shm_hdr_t *hdr;
+	size_t map_size;
+	uint32_t size; /* The private copies, the peer can change the header */
+	char *base[2]; /* The data of rings: requests and answers */
+	int memfd;
+	int efd[2]; /* Wakeup eventfd for each side */
+	int sock; /* The socket to detect peer's death */
+};
+
+#endif
@@ -0,0 +1,478 @@
+/*
+ * shm.c
+ *
+ * This file provides the implementation of a shared memory transport
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_SYS_EVENTFD_H)
+#include <sys/eventfd.h>
+#define KONF_SHM_SUPPORTED 1
+#endif
+
+#include "private.h"
+
+/* OpenBSD has no MSG_NOSIGNAL flag */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define KONF_SHM_FDS 3
+
+/*---------------------------------------------------------
+ * PRIVATE METHODS
+ *--------------------------------------------------------- */
+static void konf_shm_init(konf_shm_t *this)
+{
+	this->hdr = NULL;
+	this->map_size = 0;
+	this->size = 0;
+	this->base[0] = NULL;
+	this->base[1] = NULL;
+	this->memfd = -1;
+	this->efd[KONF_SHM_CLIENT] = -1;
+	this->efd[KONF_SHM_SERVER] = -1;
+	this->sock = -1;
+}
+
+/*--------------------------------------------------------- */
+static konf_shm_ring_t *konf_shm_wring(konf_shm_t *this,
+	konf_shm_side_t side)
+{
+	return (KONF_SHM_CLIENT == side) ? &this->hdr->req : &this->hdr->ans;
+}
+
+/*--------------------------------------------------------- */
+static konf_shm_ring_t *konf_shm_rring(konf_shm_t *this,
+	konf_shm_side_t side)
+{
+	return (KONF_SHM_CLIENT == side) ? &this->hdr->ans : &this->hdr->req;
+}
+
+/*--------------------------------------------------------- */
+/* The data of ring written by the side */
+static char *konf_shm_wbase(konf_shm_t *this, konf_shm_side_t side)
+{
+	return this->base[(KONF_SHM_CLIENT == side) ? 0 : 1];
+}
+
+/*--------------------------------------------------------- */
+static char *konf_shm_rbase(konf_shm_t *this, konf_shm_side_t side)
+{
+	return this->base[(KONF_SHM_CLIENT == side) ? 1 : 0];
+}
+
+/*--------------------------------------------------------- */
+/* The indexes are written by the peer so they can be broken. The
+ * transport must fail then.
+ */
+static int konf_shm_check(const konf_shm_t *this, uint32_t head,
+	uint32_t tail)
+{
+	if ((uint32_t)(head - tail) > this->size) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+static void konf_shm_wakeup(konf_shm_t *this, konf_shm_side_t side)
+{
+	uint64_t one = 1;
+
+	/* The eventfd counter overflow is impossible here */
+	if (write(this->efd[side], &one, sizeof(one)) < 0)
+		return;
+}
+
+/*--------------------------------------------------------- */
+/* Sleep until the peer wakes us up. The socket is checked to
+ * don't sleep forever when the peer is dead.
+ */
+static int konf_shm_sleep(konf_shm_t *this, konf_shm_side_t side)
+{
+	struct pollfd fds[2];
+	uint64_t cnt;
+
+	fds[0].fd = this->efd[side];
+	fds[0].events = POLLIN;
+	fds[1].fd = this->sock;
+	fds[1].events = 0; /* Errors only */
+	while (poll(fds, 2, -1) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	if (fds[1].revents & (POLLHUP | POLLERR | POLLNVAL))
+		return -1;
+	if (fds[0].revents & POLLIN) {
+		if (read(this->efd[side], &cnt, sizeof(cnt)) < 0)
+			return 0;
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+static int konf_shm_map(konf_shm_t *this, int create, unsigned int size)
+{
+	void *map;
+
+	this->map_size = sizeof(konf_shm_hdr_t) + 2 * size;
+	if (create && (ftruncate(this->memfd, this->map_size) < 0))
+		return -1;
+	map = mmap(NULL, this->map_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, this->memfd, 0);
+	if (MAP_FAILED == map)
+		return -1;
+	this->hdr = map;
+	if (create) {
+		memset(this->hdr, 0, sizeof(*this->hdr));
+		this->hdr->size = size;
+		this->hdr->req.offset = sizeof(konf_shm_hdr_t);
+		this->hdr->ans.offset = sizeof(konf_shm_hdr_t) + size;
+		__atomic_store_n(&this->hdr->magic, KONF_SHM_MAGIC,
+			__ATOMIC_RELEASE);
+	}
+	/* The offsets are not taken from the header */
+	this->size = size;
+	this->base[0] = (char *)this->hdr + sizeof(konf_shm_hdr_t);
+	this->base[1] = this->base[0] + size;
+
+	return 0;
+}
+
+/*---------------------------------------------------------
+ * PUBLIC META FUNCTIONS
+ *--------------------------------------------------------- */
+/* Create the shared region for the client connected to the sock.
+ * The size of ring must be the power of 2.
+ */
+konf_shm_t *konf_shm_new(int sock, unsigned int size)
+{
+#ifdef KONF_SHM_SUPPORTED
+	konf_shm_t *this;
+
+	if (!size || (size & (size - 1)))
+		return NULL;
+	if (!(this = malloc(sizeof(*this))))
+		return NULL;
+	konf_shm_init(this);
+	this->sock = sock;
+
+	if ((this->memfd = memfd_create("konfd", MFD_CLOEXEC)) < 0)
+		goto err;
+	if ((this->efd[KONF_SHM_CLIENT] = eventfd(0,
+		EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+		goto err;
+	if ((this->efd[KONF_SHM_SERVER] = eventfd(0,
+		EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+		goto err;
+	if (konf_shm_map(this, 1, size) < 0)
+		goto err;
+
+	return this;
+err:
+	this->sock = -1; /* The socket is not owned */
+	konf_shm_free(this);
+	return NULL;
+#else
+	sock = sock; /* Happy compiler */
+	size = size;
+	return NULL;
+#endif
+}
+
+/*--------------------------------------------------------- */
+/* Receive the answer for shm request. The region descriptors are
+ * attached to the successful answer. Returns NULL if the daemon
+ * doesn't support the shm transport. The answer string is returned
+ * anyway if it was received.
+ */
+konf_shm_t *konf_shm_recv(int sock, char **answer)
+{
+	konf_shm_t *this;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char buf[64];
+	char cbuf[CMSG_SPACE(sizeof(int) * KONF_SHM_FDS)];
+	int fds[KONF_SHM_FDS];
+	struct stat st;
+	ssize_t nbytes;
+	int nfds = 0;
+	int i;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf) - 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	*answer = NULL;
+	do {
+		nbytes = recvmsg(sock, &msg, 0);
+	} while ((nbytes < 0) && (EINTR == errno));
+	if (nbytes <= 0)
+		return NULL;
+	buf[nbytes] = '\0';
+	*answer = strdup(buf);
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level != SOL_SOCKET) ||
+			(cmsg->cmsg_type != SCM_RIGHTS))
+			continue;
+		nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (nfds > KONF_SHM_FDS)
+			nfds = KONF_SHM_FDS;
+		memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+		break;
+	}
+	if (nfds != KONF_SHM_FDS) {
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		return NULL;
+	}
+
+	if (!(this = malloc(sizeof(*this))))
+		goto err;
+	konf_shm_init(this);
+	this->memfd = fds[0];
+	this->efd[KONF_SHM_CLIENT] = fds[1];
+	this->efd[KONF_SHM_SERVER] = fds[2];
+	if ((fstat(this->memfd, &st) < 0) ||
+		(st.st_size < (off_t)sizeof(konf_shm_hdr_t)))
+		goto err_free;
+	/* Map the header to get the size of rings */
+	if (konf_shm_map(this, 0, 0) < 0)
+		goto err_free;
+	if ((__atomic_load_n(&this->hdr->magic, __ATOMIC_ACQUIRE) !=
+		KONF_SHM_MAGIC) || !this->hdr->size ||
+		(this->hdr->size & (this->hdr->size - 1)) ||
+		(st.st_size < (off_t)(sizeof(konf_shm_hdr_t) +
+		2 * (size_t)this->hdr->size)))
+		goto err_free;
+	i = this->hdr->size;
+	munmap(this->hdr, this->map_size);
+	this->hdr = NULL;
+	if (konf_shm_map(this, 0, i) < 0)
+		goto err_free;
+	this->sock = sock;
+
+	return this;
+
+err_free:
+	konf_shm_free(this);
+	return NULL;
+err:
+	for (i = 0; i < KONF_SHM_FDS; i++)
+		close(fds[i]);
+	return NULL;
+}
+
+/*---------------------------------------------------------
+ * PUBLIC METHODS
+ *--------------------------------------------------------- */
+void konf_shm_free(konf_shm_t *this)
+{
+	if (!this)
+		return;
+	if (this->hdr)
+		munmap(this->hdr, this->map_size);
+	if (this->memfd >= 0)
+		close(this->memfd);
+	if (this->efd[KONF_SHM_CLIENT] >= 0)
+		close(this->efd[KONF_SHM_CLIENT]);
+	if (this->efd[KONF_SHM_SERVER] >= 0)
+		close(this->efd[KONF_SHM_SERVER]);
+	free(this);
+}
+
+/*--------------------------------------------------------- */
+/* Send the answer with attached region descriptors to the client */
+int konf_shm_send(konf_shm_t *this, const char *answer)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(int) * KONF_SHM_FDS)];
+	int fds[KONF_SHM_FDS];
+
+	fds[0] = this->memfd;
+	fds[1] = this->efd[KONF_SHM_CLIENT];
+	fds[2] = this->efd[KONF_SHM_SERVER];
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	iov.iov_base = (void *)answer;
+	iov.iov_len = strlen(answer) + 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	return sendmsg(this->sock, &msg, MSG_NOSIGNAL);
+}
+
+/*--------------------------------------------------------- */
+/* Write the data to the ring. The blocking write sleeps while the ring
+ * is full. The non-blocking write returns the number of bytes that fit.
+ * The consumer wakes the writer up when it frees the space then.
+ */
+ssize_t konf_shm_write(konf_shm_t *this, konf_shm_side_t side,
+	const void *data, size_t len, int block)
+{
+	konf_shm_ring_t *ring = konf_shm_wring(this, side);
+	uint32_t size = this->size;
+	char *base = konf_shm_wbase(this, side);
+	const char *src = data;
+	size_t left = len;
+
+	while (left > 0) {
+		uint32_t head = ring->head;
+		uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		uint32_t avail, pos, chunk;
+
+		if (konf_shm_check(this, head, tail) < 0)
+			return -1;
+		avail = size - (head - tail);
+		pos = head & (size - 1);
+		if (0 == avail) {
+			/* Ring is full. Sleep until consumer frees space */
+			__atomic_store_n(&ring->wwait, 1, __ATOMIC_SEQ_CST);
+			tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+			if (konf_shm_check(this, head, tail) < 0)
+				return -1;
+			if ((head - tail) < size)
+				continue;
+			if (!block)
+				break;
+			if (konf_shm_sleep(this, side) < 0)
+				return -1;
+			continue;
+		}
+		chunk = (left < avail) ? left : avail;
+		if (chunk > (size - pos)) {
+			memcpy(base + pos, src, size - pos);
+			memcpy(base, src + (size - pos), chunk - (size - pos));
+		} else {
+			memcpy(base + pos, src, chunk);
+		}
+		__atomic_store_n(&ring->head, head + chunk, __ATOMIC_SEQ_CST);
+		src += chunk;
+		left -= chunk;
+		/* Wake up the idle consumer */
+		if (__atomic_load_n(&ring->rwait, __ATOMIC_SEQ_CST) &&
+			__atomic_exchange_n(&ring->rwait, 0, __ATOMIC_SEQ_CST))
+			konf_shm_wakeup(this, !side);
+	}
+
+	return len - left;
+}
+
+/*--------------------------------------------------------- */
+/* Read the available data from the ring. The blocking read sleeps
+ * until some data is available. The non-blocking read returns 0 if
+ * the ring is empty.
+ */
+ssize_t konf_shm_read(konf_shm_t *this, konf_shm_side_t side,
+	void *data, size_t len, int block)
+{
+	konf_shm_ring_t *ring = konf_shm_rring(this, side);
+	uint32_t size = this->size;
+	char *base = konf_shm_rbase(this, side);
+	uint32_t head, tail, avail, pos, chunk;
+
+	if (0 == len)
+		return 0;
+
+	while (1) {
+		tail = ring->tail;
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (konf_shm_check(this, head, tail) < 0)
+			return -1;
+		if (head != tail)
+			break;
+		if (!block)
+			return 0;
+		/* Ring is empty. Sleep until producer writes something */
+		if (konf_shm_idle(this, side))
+			continue;
+		if (konf_shm_sleep(this, side) < 0)
+			return -1;
+	}
+
+	avail = head - tail;
+	pos = tail & (size - 1);
+	chunk = (len < avail) ? len : avail;
+	if (chunk > (size - pos)) {
+		memcpy(data, base + pos, size - pos);
+		memcpy((char *)data + (size - pos), base, chunk - (size - pos));
+	} else {
+		memcpy(data, base + pos, chunk);
+	}
+	__atomic_store_n(&ring->tail, tail + chunk, __ATOMIC_SEQ_CST);
+	/* Wake up the producer waiting for the free space */
+	if (__atomic_load_n(&ring->wwait, __ATOMIC_SEQ_CST) &&
+		__atomic_exchange_n(&ring->wwait, 0, __ATOMIC_SEQ_CST))
+		konf_shm_wakeup(this, !side);
+
+	return chunk;
+}
+
+/*--------------------------------------------------------- */
+/* Tell the producer that consumer is going to sleep on the
+ * konf_shm__get_wait_fd(). Returns non-zero if the ring has
+ * data already so the consumer must not sleep.
+ */
+int konf_shm_idle(konf_shm_t *this, konf_shm_side_t side)
+{
+	konf_shm_ring_t *ring = konf_shm_rring(this, side);
+
+	__atomic_store_n(&ring->rwait, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != ring->tail) {
+		__atomic_store_n(&ring->rwait, 0, __ATOMIC_SEQ_CST);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+int konf_shm__get_wait_fd(const konf_shm_t *this, konf_shm_side_t side)
+{
+	return this->efd[side];
+}
+
+/*--------------------------------------------------------- */
+int konf_shm__get_sock(const konf_shm_t *this)
+{
+	return this->sock;
+}
+
+/*--------------------------------------------------------- */
+/* The region can be handed over to the other socket */
+void konf_shm__set_sock(konf_shm_t *this, int sock)
+{
+	this->sock = sock;
+}
@@ -20,11 +20,15 @@ Use it to implement config in memory.
 #include "lub/list.h"
 
 typedef struct konf_tree_s konf_tree_t;
+typedef struct konf_tree_json_s konf_tree_json_t;
 
 #define KONF_ENTRY_OK 0xffff
 #define KONF_ENTRY_DIRTY 0xfffe
 #define KONF_ENTRY_NEW 0xfffd
 
+/* The callback to invalidate the handle of node on the node deletion */
+typedef void konf_tree_release_fn(konf_tree_t *instance);
+
 /*=====================================
  * CONF INTERFACE
  *===================================== */
@@ -32,14 +36,21 @@ typedef struct konf_tree_s konf_tree_t;
  * meta functions
  *----------------- */
 konf_tree_t *konf_tree_new(const char *line, unsigned short priority);
+konf_tree_t *konf_tree_clone(const konf_tree_t *instance);
+konf_tree_t *konf_tree_load(FILE *stream);
+void konf_tree_release_hook(konf_tree_release_fn *fn);
+void konf_tree_compact(unsigned int min_siblings);
 
 /*-----------------
  * methods
  *----------------- */
 void konf_tree_delete(konf_tree_t * instance);
+int konf_tree_save(const konf_tree_t *instance, FILE *stream);
 void konf_tree_fprintf(konf_tree_t * instance, FILE * stream,
 	const char *pattern, int top_depth, int depth,
 	bool_t seq, unsigned char prev_pri_hi);
+void konf_tree_fprintf_json(konf_tree_t *instance, FILE *stream,
+	const char *pattern, int top_depth, int depth);
 konf_tree_t *konf_tree_new_conf(konf_tree_t * instance,
 	const char *line, unsigned short priority,
 	bool_t seq, unsigned short seq_num);
@@ -50,6 +61,13 @@ int konf_tree_del_pattern(konf_tree_t * instance,
 	const char *pattern, unsigned short priority,
 	bool_t seq, unsigned short seq_num);
 
+/*-----------------
+ * JSON Lines decoder
+ *----------------- */
+konf_tree_json_t *konf_tree_json_new(konf_tree_t *root);
+void konf_tree_json_free(konf_tree_json_t *instance);
+int konf_tree_json_parse(konf_tree_json_t *instance, const char *str);
+
 /*-----------------
  * attributes
  *----------------- */
@@ -63,8 +81,12 @@ void konf_tree__set_seq_num(konf_tree_t * instance, unsigned short seq_num);
 unsigned short konf_tree__get_sub_num(const konf_tree_t * instance);
 void konf_tree__set_sub_num(konf_tree_t * instance, unsigned short sub_num);
 const char * konf_tree__get_line(const konf_tree_t * instance);
+const char * konf_tree__get_line_buf(const konf_tree_t * instance,
+	char **buf, size_t *size);
 void konf_tree__set_depth(konf_tree_t * instance, int depth);
 int konf_tree__get_depth(const konf_tree_t * instance);
+unsigned int konf_tree__get_handle(const konf_tree_t * instance);
+void konf_tree__set_handle(konf_tree_t * instance, unsigned int handle);
 
 #endif				/* _konf_tree_h */
 /** @} clish_conf */
@@ -11,14 +11,32 @@
 /*---------------------------------------------------------
  * PRIVATE TYPES
  *--------------------------------------------------------- */
+/* The line prefix shared by the siblings of compacted section */
+typedef struct konf_tree_prefix_s {
+	unsigned int ref;
+	char str[];
+} konf_tree_prefix_t;
+
 struct konf_tree_s {
 	lub_list_t *list;
-	char *line;
+	konf_tree_prefix_t *prefix; /* NULL if the line is not front-coded */
+	union {
+		char *line; /* The whole line or the suffix after shared prefix */
+		char tail[sizeof(char *)]; /* The short suffix within node */
+	};
 	unsigned short priority;
 	unsigned short seq_num;
 	unsigned short sub_num;
-	bool_t splitter;
+	unsigned short shared:14; /* The length of the shared prefix */
+	unsigned short inline_tail:1; /* The suffix is within the tail field */
+	unsigned short splitter:1;
 	int depth;
+	unsigned int handle; /* The handle given by the tree user or 0 */
 };
 
+/*---------------------------------------------------------
+ * PRIVATE METHODS
+ *--------------------------------------------------------- */
+lub_list_node_t *konf_tree_add(konf_tree_t *instance, konf_tree_t *conf);
+
 #endif
@@ -16,9 +16,98 @@
 #include <sys/types.h>
 #include <regex.h>
 
+/* The handle release callback is common for all trees */
+static konf_tree_release_fn *release_hook = NULL;
+
+/* The sections having so many children keep the lines front-coded.
+ * Zero means the compact mode is off.
+ */
+static unsigned int compact_min = 0;
+
+/* The shorter prefix doesn't pay for the pointer to it */
+#define KONF_TREE_SHARED_MIN 8
+
 /*---------------------------------------------------------
  * PRIVATE META FUNCTIONS
  *--------------------------------------------------------- */
+/* Get the line or the suffix of front-coded line */
+static inline const char *konf_tree_suffix(const konf_tree_t *this)
+{
+	return this->inline_tail ? this->tail : this->line;
+}
+
+/*--------------------------------------------------------- */
+/* Get the char of the line. The front-coded line consists of
+ * the shared prefix and the own suffix.
+ */
+static inline unsigned char konf_tree_char(const konf_tree_t *this,
+	unsigned int i)
+{
+	if (!this->prefix)
+		return this->line[i];
+	if (i < this->shared)
+		return this->prefix->str[i];
+	return konf_tree_suffix(this)[i - this->shared];
+}
+
+/*--------------------------------------------------------- */
+/* Compare the lines of two nodes without the decoding */
+static int konf_tree_linecmp(const konf_tree_t *f, const konf_tree_t *s)
+{
+	unsigned int i = 0;
+
+	if (!f->prefix && !s->prefix)
+		return strcmp(f->line, s->line);
+	/* The siblings often share the same prefix */
+	if (f->prefix && (f->prefix == s->prefix))
+		i = (f->shared < s->shared) ? f->shared : s->shared;
+	while (1) {
+		unsigned char cf = konf_tree_char(f, i);
+		unsigned char cs = konf_tree_char(s, i);
+		if ((cf != cs) || ('\0' == cf))
+			return (cf - cs);
+		i++;
+	}
+}
+
+/*--------------------------------------------------------- */
+/* Compare the line of node with the string */
+static int konf_tree_strcmp(const konf_tree_t *this, const char *str)
+{
+	if (this->prefix) {
+		int res = strncmp(this->prefix->str, str, this->shared);
+		if (res)
+			return res;
+		str += this->shared;
+	}
+	return strcmp(konf_tree_suffix(this), str);
+}
+
+/*--------------------------------------------------------- */
+/* Get the whole line of node. The front-coded line is decoded
+ * to the buffer.
+ */
+static const char *konf_tree_line(const konf_tree_t *this,
+	char **buf, size_t *size)
+{
+	size_t len;
+
+	if (!this->prefix)
+		return this->line;
+	len = this->shared + strlen(konf_tree_suffix(this)) + 1;
+	if (len > *size) {
+		char *tmp = realloc(*buf, len);
+		assert(tmp);
+		*buf = tmp;
+		*size = len;
+	}
+	memcpy(*buf, this->prefix->str, this->shared);
+	strcpy(*buf + this->shared, konf_tree_suffix(this));
+
+	return *buf;
+}
+
+/*--------------------------------------------------------- */
 static int konf_tree_compare(const void *first, const void *second)
 {
 	const konf_tree_t *f = (const konf_tree_t *)first;
@@ -34,7 +123,7 @@ static int konf_tree_compare(const void *first, const void *second)
 	if (f->sub_num != s->sub_num)
 		return (f->sub_num - s->sub_num);
 	/* Line check */
-	return strcmp(f->line, s->line);
+	return konf_tree_linecmp(f, s);
 }
 
 /*---------------------------------------------------------
@@ -44,12 +133,16 @@ static void konf_tree_init(konf_tree_t * this, const char *line,
 	unsigned short priority)
 {
 	/* set up defaults */
+	this->prefix = NULL;
 	this->line = strdup(line);
+	this->shared = 0;
+	this->inline_tail = 0;
 	this->priority = priority;
 	this->seq_num = 0;
 	this->sub_num = KONF_ENTRY_OK;
 	this->splitter = BOOL_TRUE;
 	this->depth = -1;
+	this->handle = 0;
 
 	/* initialise the list of commands for this conf */
 	this->list = lub_list_new(konf_tree_compare);
@@ -60,6 +153,10 @@ static void konf_tree_fini(konf_tree_t * this)
 {
 	lub_list_node_t *iter;
 
+	/* The node is not available by handle any more */
+	if (this->handle && release_hook)
+		release_hook(this);
+
 	/* delete each conf held by this conf */
 	
 	while ((iter = lub_list__get_head(this->list))) {
@@ -72,8 +169,145 @@ static void konf_tree_fini(konf_tree_t * this)
 	lub_list_free(this->list);
 
 	/* free our memory */
-	free(this->line);
+	if (!this->inline_tail)
+		free(this->line);
 	this->line = NULL;
+	/* The clone of other datastore can drop the last reference */
+	if (this->prefix &&
+		!__atomic_sub_fetch(&this->prefix->ref, 1, __ATOMIC_ACQ_REL))
+		free(this->prefix);
+	this->prefix = NULL;
+}
+
+/*--------------------------------------------------------- */
+/* Front-code the line of node. The prefix of neighbour sibling is
+ * used if it's long enough. Else the line becomes the new prefix
+ * for the following siblings. The short suffix is kept within node.
+ */
+static void konf_tree_encode(konf_tree_t *this,
+	const konf_tree_t *prev, const konf_tree_t *next)
+{
+	const konf_tree_t *near[] = {prev, next};
+	konf_tree_prefix_t *prefix = NULL;
+	size_t shared = 0;
+	char *suffix = NULL;
+	unsigned int i;
+
+	if (this->prefix)
+		return;
+	for (i = 0; i < sizeof(near) / sizeof(near[0]); i++) {
+		size_t len = 0;
+		if (!near[i] || !near[i]->prefix)
+			continue;
+		while ((len < 0x3fff) && this->line[len] &&
+			(this->line[len] == near[i]->prefix->str[len]))
+			len++;
+		if ((len >= KONF_TREE_SHARED_MIN) && (len > shared)) {
+			prefix = near[i]->prefix;
+			shared = len;
+		}
+	}
+	if (prefix) {
+		__atomic_add_fetch(&prefix->ref, 1, __ATOMIC_RELAXED);
+	} else {
+		shared = strlen(this->line);
+		if ((shared < KONF_TREE_SHARED_MIN) || (shared > 0x3fff))
+			return;
+		if (!(prefix = malloc(sizeof(*prefix) + shared + 1)))
+			return;
+		prefix->ref = 1;
+		memcpy(prefix->str, this->line, shared + 1);
+	}
+	if ((strlen(this->line + shared) >= sizeof(this->tail)) &&
+		!(suffix = strdup(this->line + shared))) {
+		if (!__atomic_sub_fetch(&prefix->ref, 1, __ATOMIC_RELAXED))
+			free(prefix);
+		return;
+	}
+	if (suffix) {
+		free(this->line);
+		this->line = suffix;
+	} else {
+		char *line = this->line;
+		strcpy(this->tail, line + shared);
+		free(line);
+		this->inline_tail = 1;
+	}
+	this->prefix = prefix;
+	this->shared = shared;
+}
+
+/*--------------------------------------------------------- */
+/* Decode the front-coded line back. The node keeps the whole line. */
+static void konf_tree_decode(konf_tree_t *this)
+{
+	char *line = NULL;
+	size_t size = 0;
+
+	if (!this->prefix)
+		return;
+	konf_tree_line(this, &line, &size);
+	if (!this->inline_tail)
+		free(this->line);
+	this->line = line;
+	this->inline_tail = 0;
+	if (!__atomic_sub_fetch(&this->prefix->ref, 1, __ATOMIC_ACQ_REL))
+		free(this->prefix);
+	this->prefix = NULL;
+	this->shared = 0;
+}
+
+/*--------------------------------------------------------- */
+/* Add the child to the sorted list. The large list is compacted. */
+lub_list_node_t *konf_tree_add(konf_tree_t *this, konf_tree_t *conf)
+{
+	lub_list_node_t *node = lub_list_add(this->list, conf);
+	lub_list_node_t *iter;
+	konf_tree_t *prev = NULL;
+
+	if (!compact_min || (lub_list_len(this->list) < compact_min))
+		return node;
+	/* The list becomes large. Encode all children. */
+	if (lub_list_len(this->list) == compact_min) {
+		for (iter = lub_list__get_head(this->list);
+			iter; iter = lub_list_node__get_next(iter)) {
+			konf_tree_t *cur;
+			cur = (konf_tree_t *)lub_list_node__get_data(iter);
+			konf_tree_encode(cur, prev, NULL);
+			prev = cur;
+		}
+		return node;
+	}
+	konf_tree_encode(conf,
+		lub_list_node__get_prev(node) ? (konf_tree_t *)
+		lub_list_node__get_data(lub_list_node__get_prev(node)) : NULL,
+		lub_list_node__get_next(node) ? (konf_tree_t *)
+		lub_list_node__get_data(lub_list_node__get_next(node)) : NULL);
+
+	return node;
+}
+
+/*--------------------------------------------------------- */
+static int konf_tree_save_level(const konf_tree_t *this, FILE *stream,
+	unsigned int level)
+{
+	lub_list_node_t *iter;
+
+	if (fprintf(stream, "%u %u %u %u %d %d %.*s%s\n", level,
+		this->priority, this->seq_num, this->sub_num,
+		this->splitter ? 1 : 0, this->depth,
+		this->shared, this->prefix ? this->prefix->str : "",
+		konf_tree_suffix(this)) < 0)
+		return -1;
+	for(iter = lub_list__get_head(this->list);
+		iter; iter = lub_list_node__get_next(iter)) {
+		if (konf_tree_save_level(
+			(konf_tree_t *)lub_list_node__get_data(iter),
+			stream, level + 1) < 0)
+			return -1;
+	}
+
+	return 0;
 }
 
 /*---------------------------------------------------------
@@ -91,6 +325,126 @@ konf_tree_t *konf_tree_new(const char *line, unsigned short priority)
 	return this;
 }
 
+/*--------------------------------------------------------- */
+/* Load the tree saved by konf_tree_save(). The nodes are saved in
+ * order so they are appended to the tail of lists without the search.
+ */
+konf_tree_t *konf_tree_load(FILE *stream)
+{
+	konf_tree_t *root = NULL;
+	konf_tree_t **stack = NULL;
+	unsigned int stack_size = 0;
+	char *str = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	while ((len = getline(&str, &size, stream)) > 0) {
+		konf_tree_t *conf;
+		unsigned int level, priority, seq_num, sub_num;
+		int splitter, depth;
+		int pos = 0;
+
+		if ('\n' == str[len - 1])
+			str[--len] = '\0';
+		/* The empty line is the end of tree */
+		if (0 == len)
+			break;
+		if ((sscanf(str, "%u %u %u %u %d %d%n", &level, &priority,
+			&seq_num, &sub_num, &splitter, &depth, &pos) < 6) ||
+			(str[pos] != ' '))
+			goto err;
+		/* The parent must be loaded already */
+		if ((level > stack_size) || ((level > 0) && !root) ||
+			((0 == level) && root))
+			goto err;
+		if (!(conf = konf_tree_new(str + pos + 1, priority)))
+			goto err;
+		conf->seq_num = seq_num;
+		conf->sub_num = sub_num;
+		conf->splitter = splitter ? BOOL_TRUE : BOOL_FALSE;
+		conf->depth = depth;
+		if (0 == level)
+			root = conf;
+		else
+			konf_tree_add(stack[level - 1], conf);
+		if (level == stack_size) {
+			konf_tree_t **tmp;
+			tmp = realloc(stack, (stack_size + 1) * sizeof(*tmp));
+			if (!tmp)
+				goto err;
+			stack = tmp;
+			stack_size++;
+		}
+		stack[level] = conf;
+	}
+	free(str);
+	free(stack);
+
+	return root;
+err:
+	free(str);
+	free(stack);
+	if (root)
+		konf_tree_delete(root);
+	return NULL;
+}
+
+/*--------------------------------------------------------- */
+/* Set the callback to call when the node having the handle is deleted */
+void konf_tree_release_hook(konf_tree_release_fn *fn)
+{
+	release_hook = fn;
+}
+
+/*--------------------------------------------------------- */
+/* Set the number of siblings to front-code their lines */
+void konf_tree_compact(unsigned int min_siblings)
+{
+	compact_min = min_siblings;
+}
+
+/*--------------------------------------------------------- */
+/* Deep copy of the tree. Each node gets its own copy of the line or
+ * of the suffix of front-coded line. Only the refcounted prefixes are
+ * shared with source. They are never changed so the trees don't
+ * depend on each other. The children are already sorted so each one
+ * is added after the tail of new list by single compare. The handles
+ * are not copied.
+ */
+konf_tree_t *konf_tree_clone(const konf_tree_t *src)
+{
+	konf_tree_t *this;
+	lub_list_node_t *iter;
+
+	if (!(this = konf_tree_new(konf_tree_suffix(src), src->priority)))
+		return NULL;
+	if (src->prefix) {
+		if (src->inline_tail) {
+			free(this->line);
+			memcpy(this->tail, src->tail, sizeof(this->tail));
+			this->inline_tail = 1;
+		}
+		this->prefix = src->prefix;
+		__atomic_add_fetch(&this->prefix->ref, 1, __ATOMIC_RELAXED);
+		this->shared = src->shared;
+	}
+	this->seq_num = src->seq_num;
+	this->sub_num = src->sub_num;
+	this->splitter = src->splitter;
+	this->depth = src->depth;
+
+	for(iter = lub_list__get_head(src->list);
+		iter; iter = lub_list_node__get_next(iter)) {
+		konf_tree_t *conf;
+		conf = konf_tree_clone(
+			(konf_tree_t *)lub_list_node__get_data(iter));
+		assert(conf);
+		lub_list_add(this->list, conf);
+	}
+
+	return this;
+}
+
 /*---------------------------------------------------------
  * PUBLIC METHODS
  *--------------------------------------------------------- */
@@ -100,6 +454,20 @@ void konf_tree_delete(konf_tree_t * this)
 	free(this);
 }
 
+/*--------------------------------------------------------- */
+/* Save the whole tree with all attributes of nodes to the stream.
+ * The saved tree ends with an empty line.
+ */
+int konf_tree_save(const konf_tree_t *this, FILE *stream)
+{
+	if (konf_tree_save_level(this, stream, 0) < 0)
+		return -1;
+	if (fprintf(stream, "\n") < 0)
+		return -1;
+
+	return 0;
+}
+
 /*--------------------------------------------------------- */
 void konf_tree_fprintf(konf_tree_t *this, FILE *stream,
 	const char *pattern, int top_depth, int depth,
@@ -109,8 +477,10 @@ void konf_tree_fprintf(konf_tree_t *this, FILE *stream,
 	lub_list_node_t *iter;
 	unsigned char pri = 0;
 	regex_t regexp;
+	char *buf = NULL;
+	size_t size = 0;
 
-	if (this->line && (*(this->line) != '\0') &&
+	if ((this->prefix || (this->line && (*(this->line) != '\0'))) &&
 		(this->depth > top_depth) &&
 		((depth < 0 ) || (this->depth <= (top_depth + depth)))) {
 		char *space = NULL;
@@ -127,7 +497,9 @@ void konf_tree_fprintf(konf_tree_t *this, FILE *stream,
 		fprintf(stream, "%s", space ? space : "");
 		if (seq && (konf_tree__get_seq_num(this) != 0))
 			fprintf(stream, "%u ", konf_tree__get_seq_num(this));
-		fprintf(stream, "%s\n", this->line);
+		if (this->prefix)
+			fprintf(stream, "%.*s", this->shared, this->prefix->str);
+		fprintf(stream, "%s\n", konf_tree_suffix(this));
 		free(space);
 	}
 
@@ -140,13 +512,15 @@ void konf_tree_fprintf(konf_tree_t *this, FILE *stream,
 	for(iter = lub_list__get_head(this->list);
 		iter; iter = lub_list_node__get_next(iter)) {
 		conf = (konf_tree_t *)lub_list_node__get_data(iter);
-		if (pattern && (0 != regexec(&regexp, conf->line, 0, NULL, 0)))
+		if (pattern && (0 != regexec(&regexp,
+			konf_tree_line(conf, &buf, &size), 0, NULL, 0)))
 			continue;
 		konf_tree_fprintf(conf, stream, NULL, top_depth, depth, seq, pri);
 		pri = konf_tree__get_priority_hi(conf);
 	}
 	if (pattern)
 		regfree(&regexp);
+	free(buf);
 }
 
 /*-------------------------------------------------------- */
@@ -207,7 +581,7 @@ konf_tree_t *konf_tree_new_conf(konf_tree_t * this,
 	}
 
 	/* Insert it into the list */
-	node = lub_list_add(this->list, newconf);
+	node = konf_tree_add(this, newconf);
 
 	if (seq) {
 		normalize_seq(this, priority, node);
@@ -244,7 +618,7 @@ konf_tree_t *konf_tree_find_conf(konf_tree_t * this,
 			if (seq_num > conf->seq_num)
 				break;
 		}
-		if (!strcmp(conf->line, line))
+		if (!konf_tree_strcmp(conf, line))
 			return conf;
 	} while ((iter = lub_list_node__get_prev(iter)));
 
@@ -263,6 +637,8 @@ int konf_tree_del_pattern(konf_tree_t *this,
 	lub_list_node_t *tmp;
 	regex_t regexp;
 	int del_cnt = 0; /* how many strings were deleted */
+	char *buf = NULL;
+	size_t size = 0;
 
 	if (seq && (0 == priority))
 		return -1;
@@ -287,9 +663,10 @@ int konf_tree_del_pattern(konf_tree_t *this,
 			continue;
 		if (seq && (0 == seq_num) && (0 == conf->seq_num))
 			continue;
-		if (0 != regexec(&regexp, conf->line, 0, NULL, 0))
+		if (0 != regexec(&regexp,
+			konf_tree_line(conf, &buf, &size), 0, NULL, 0))
 			continue;
-		if (unique && line && !strcmp(conf->line, line)) {
+		if (unique && line && !konf_tree_strcmp(conf, line)) {
 			res++;
 			continue;
 		}
@@ -303,6 +680,7 @@ int konf_tree_del_pattern(konf_tree_t *this,
 	lub_list_node_free(tmp);
 
 	regfree(&regexp);
+	free(buf);
 
 	if (seq && (del_cnt != 0))
 		normalize_seq(this, priority, NULL);
@@ -331,13 +709,13 @@ unsigned char konf_tree__get_priority_lo(const konf_tree_t * this)
 /*--------------------------------------------------------- */
 bool_t konf_tree__get_splitter(const konf_tree_t * this)
 {
-	return this->splitter;
+	return this->splitter ? BOOL_TRUE : BOOL_FALSE;
 }
 
 /*--------------------------------------------------------- */
 void konf_tree__set_splitter(konf_tree_t *this, bool_t splitter)
 {
-	this->splitter = splitter;
+	this->splitter = splitter ? 1 : 0;
 }
 
 /*--------------------------------------------------------- */
@@ -365,11 +743,27 @@ void konf_tree__set_sub_num(konf_tree_t * this, unsigned short sub_num)
 }
 
 /*--------------------------------------------------------- */
+/* The line is valid while the node exists. The front-coded node is
+ * decoded back on the first call so it changes the node. The readers
+ * of the tree that run concurrently use konf_tree__get_line_buf().
+ */
 const char * konf_tree__get_line(const konf_tree_t * this)
 {
+	konf_tree_decode((konf_tree_t *)this);
+
 	return this->line;
 }
 
+/*--------------------------------------------------------- */
+/* Get the line of any node. The front-coded line is decoded to the
+ * caller's buffer that is grown as needed. The caller frees it.
+ */
+const char * konf_tree__get_line_buf(const konf_tree_t * this,
+	char **buf, size_t *size)
+{
+	return konf_tree_line(this, buf, size);
+}
+
 /*--------------------------------------------------------- */
 void konf_tree__set_depth(konf_tree_t * this, int depth)
 {
@@ -381,3 +775,15 @@ int konf_tree__get_depth(const konf_tree_t * this)
 {
 	return this->depth;
 }
+
+/*--------------------------------------------------------- */
+unsigned int konf_tree__get_handle(const konf_tree_t * this)
+{
+	return this->handle;
+}
+
+/*--------------------------------------------------------- */
+void konf_tree__set_handle(konf_tree_t * this, unsigned int handle)
+{
+	this->handle = handle;
+}
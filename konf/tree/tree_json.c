@@ -0,0 +1,404 @@
+/*
+ * tree_json.c
+ *
+ * The JSON Lines export of konf_tree and the streaming decoder for it.
+ * Each node is a single line:
+ * {"line":"...","priority":N,"seq_num":N,"depth":N,"splitter":B,"children":N}
+ * The node is followed by the lines of its children.
+ */
+
+#include "private.h"
+#include "lub/string.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <regex.h>
+
+/* The decoder keeps the chain of nodes waiting for the children */
+typedef struct konf_tree_json_level_s {
+	konf_tree_t *conf;
+	unsigned int children; /* The number of children to receive */
+} konf_tree_json_level_t;
+
+struct konf_tree_json_s {
+	konf_tree_t *root;
+	konf_tree_json_level_t *stack;
+	unsigned int stack_num;
+	unsigned int stack_size;
+};
+
+/*---------------------------------------------------------
+ * PRIVATE METHODS
+ *--------------------------------------------------------- */
+static void json_fprint_node(konf_tree_t *this, FILE *stream,
+	unsigned int children)
+{
+	char *buf = NULL;
+	size_t size = 0;
+
+	fputs("{\"line\":", stream);
+	lub_string_fprint_json(stream, konf_tree__get_line_buf(this, &buf, &size));
+	free(buf);
+	fprintf(stream, ",\"priority\":%u,\"seq_num\":%u,\"depth\":%d,"
+		"\"splitter\":%s,\"children\":%u}\n",
+		this->priority, this->seq_num, this->depth,
+		this->splitter ? "true" : "false", children);
+}
+
+/*--------------------------------------------------------- */
+static void json_fprint_level(konf_tree_t *this, FILE *stream,
+	int top_depth, int depth)
+{
+	lub_list_node_t *iter;
+	unsigned int children = 0;
+
+	/* The children deeper than limit are not exported */
+	if ((depth < 0) || (this->depth < (top_depth + depth)))
+		children = lub_list_len(this->list);
+	json_fprint_node(this, stream, children);
+	if (!children)
+		return;
+	for (iter = lub_list__get_head(this->list);
+		iter; iter = lub_list_node__get_next(iter))
+		json_fprint_level((konf_tree_t *)lub_list_node__get_data(iter),
+			stream, top_depth, depth);
+}
+
+/*--------------------------------------------------------- */
+static const char *json_skip_space(const char *p)
+{
+	while ((' ' == *p) || ('\t' == *p) || ('\r' == *p) || ('\n' == *p))
+		p++;
+	return p;
+}
+
+/*--------------------------------------------------------- */
+/* Append the UTF-8 encoding of code point */
+static void json_cat_utf8(char **str, unsigned long cp)
+{
+	char tmp[5];
+	unsigned int len = 0;
+
+	if (cp < 0x80) {
+		tmp[len++] = (char)cp;
+	} else if (cp < 0x800) {
+		tmp[len++] = (char)(0xc0 | (cp >> 6));
+		tmp[len++] = (char)(0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		tmp[len++] = (char)(0xe0 | (cp >> 12));
+		tmp[len++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		tmp[len++] = (char)(0x80 | (cp & 0x3f));
+	} else {
+		tmp[len++] = (char)(0xf0 | (cp >> 18));
+		tmp[len++] = (char)(0x80 | ((cp >> 12) & 0x3f));
+		tmp[len++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		tmp[len++] = (char)(0x80 | (cp & 0x3f));
+	}
+	lub_string_catn(str, tmp, len);
+}
+
+/*--------------------------------------------------------- */
+static int json_hex4(const char *p, unsigned long *val)
+{
+	unsigned int i;
+
+	*val = 0;
+	for (i = 0; i < 4; i++) {
+		char c = p[i];
+		*val <<= 4;
+		if ((c >= '0') && (c <= '9'))
+			*val |= c - '0';
+		else if ((c >= 'a') && (c <= 'f'))
+			*val |= c - 'a' + 10;
+		else if ((c >= 'A') && (c <= 'F'))
+			*val |= c - 'A' + 10;
+		else
+			return -1;
+	}
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* Parse the JSON string. The p points to the opening quote. */
+static const char *json_parse_str(const char *p, char **str)
+{
+	const char *start;
+
+	*str = NULL;
+	lub_string_cat(str, "");
+	p++;
+	while (*p != '"') {
+		unsigned long cp;
+		start = p;
+		while (*p && (*p != '"') && (*p != '\\'))
+			p++;
+		lub_string_catn(str, start, p - start);
+		if ('\0' == *p)
+			goto err;
+		if ('"' == *p)
+			break;
+		/* Escape sequence */
+		p++;
+		switch (*p) {
+		case '"':
+		case '\\':
+		case '/':
+			lub_string_catn(str, p, 1);
+			break;
+		case 'b':
+			lub_string_cat(str, "\b");
+			break;
+		case 'f':
+			lub_string_cat(str, "\f");
+			break;
+		case 'n':
+			lub_string_cat(str, "\n");
+			break;
+		case 'r':
+			lub_string_cat(str, "\r");
+			break;
+		case 't':
+			lub_string_cat(str, "\t");
+			break;
+		case 'u':
+			if (json_hex4(p + 1, &cp) < 0)
+				goto err;
+			p += 4;
+			/* The surrogate pair */
+			if ((cp >= 0xd800) && (cp < 0xdc00)) {
+				unsigned long lo;
+				if ((p[1] != '\\') || (p[2] != 'u') ||
+					(json_hex4(p + 3, &lo) < 0) ||
+					(lo < 0xdc00) || (lo > 0xdfff))
+					goto err;
+				cp = 0x10000 + ((cp - 0xd800) << 10) +
+					(lo - 0xdc00);
+				p += 6;
+			}
+			if (!cp)
+				goto err;
+			json_cat_utf8(str, cp);
+			break;
+		default:
+			goto err;
+		}
+		p++;
+	}
+
+	return p + 1;
+err:
+	lub_string_free(*str);
+	*str = NULL;
+	return NULL;
+}
+
+/*--------------------------------------------------------- */
+/* Skip the value of unknown member. The nested values are not used. */
+static const char *json_skip_value(const char *p)
+{
+	if ('"' == *p) {
+		char *str = NULL;
+		p = json_parse_str(p, &str);
+		lub_string_free(str);
+		return p;
+	}
+	while (*p && (*p != ',') && (*p != '}') &&
+		(*p != '{') && (*p != '['))
+		p++;
+	if (('{' == *p) || ('[' == *p))
+		return NULL;
+	return p;
+}
+
+/*---------------------------------------------------------
+ * PUBLIC METHODS
+ *--------------------------------------------------------- */
+/* Export the subtree as JSON Lines. The nodes are printed while
+ * traversing the tree so the memory doesn't depend on the tree size.
+ * The node itself is not printed like by konf_tree_fprintf().
+ */
+void konf_tree_fprintf_json(konf_tree_t *this, FILE *stream,
+	const char *pattern, int top_depth, int depth)
+{
+	lub_list_node_t *iter;
+	regex_t regexp;
+	char *buf = NULL;
+	size_t size = 0;
+
+	if ((depth >= 0) && (this->depth >= (top_depth + depth)))
+		return;
+
+	if (pattern)
+		if (regcomp(&regexp, pattern, REG_EXTENDED | REG_ICASE) != 0)
+			return;
+
+	for (iter = lub_list__get_head(this->list);
+		iter; iter = lub_list_node__get_next(iter)) {
+		konf_tree_t *conf = (konf_tree_t *)lub_list_node__get_data(iter);
+		if (pattern && (0 != regexec(&regexp,
+			konf_tree__get_line_buf(conf, &buf, &size), 0, NULL, 0)))
+			continue;
+		json_fprint_level(conf, stream, top_depth, depth);
+	}
+	if (pattern)
+		regfree(&regexp);
+	free(buf);
+}
+
+/*--------------------------------------------------------- */
+/* Create the streaming decoder. The decoded nodes are added to the
+ * root node.
+ */
+konf_tree_json_t *konf_tree_json_new(konf_tree_t *root)
+{
+	konf_tree_json_t *this;
+
+	if (!(this = malloc(sizeof(*this))))
+		return NULL;
+	this->root = root;
+	this->stack = NULL;
+	this->stack_num = 0;
+	this->stack_size = 0;
+
+	return this;
+}
+
+/*--------------------------------------------------------- */
+void konf_tree_json_free(konf_tree_json_t *this)
+{
+	free(this->stack);
+	free(this);
+}
+
+/*--------------------------------------------------------- */
+/* Decode the single line of JSON Lines export and add the node to the
+ * tree. The memory of decoder depends on the depth of tree only.
+ */
+int konf_tree_json_parse(konf_tree_json_t *this, const char *str)
+{
+	const char *p = json_skip_space(str);
+	char *line = NULL;
+	unsigned long priority = 0;
+	unsigned long seq_num = 0;
+	long depth = -1;
+	unsigned long children = 0;
+	bool_t splitter = BOOL_TRUE;
+	konf_tree_t *parent;
+	konf_tree_t *conf;
+
+	/* The empty line is allowed */
+	if ('\0' == *p)
+		return 0;
+	if (*p++ != '{')
+		return -1;
+	while (1) {
+		char *key = NULL;
+		char *endptr;
+
+		p = json_skip_space(p);
+		if ('}' == *p)
+			break;
+		if ('"' != *p)
+			goto err;
+		if (!(p = json_parse_str(p, &key)))
+			goto err;
+		p = json_skip_space(p);
+		if (*p++ != ':') {
+			lub_string_free(key);
+			goto err;
+		}
+		p = json_skip_space(p);
+		if (!strcmp(key, "line")) {
+			lub_string_free(line);
+			if (('"' != *p) || !(p = json_parse_str(p, &line))) {
+				lub_string_free(key);
+				goto err;
+			}
+		} else if (!strcmp(key, "splitter")) {
+			if (!strncmp(p, "true", 4)) {
+				splitter = BOOL_TRUE;
+				p += 4;
+			} else if (!strncmp(p, "false", 5)) {
+				splitter = BOOL_FALSE;
+				p += 5;
+			} else {
+				lub_string_free(key);
+				goto err;
+			}
+		} else if (!strcmp(key, "priority") ||
+			!strcmp(key, "seq_num") ||
+			!strcmp(key, "children")) {
+			unsigned long val = strtoul(p, &endptr, 10);
+			if ((endptr == p) || ('-' == *p)) {
+				lub_string_free(key);
+				goto err;
+			}
+			p = endptr;
+			if (!strcmp(key, "priority"))
+				priority = val;
+			else if (!strcmp(key, "seq_num"))
+				seq_num = val;
+			else
+				children = val;
+		} else if (!strcmp(key, "depth")) {
+			depth = strtol(p, &endptr, 10);
+			if (endptr == p) {
+				lub_string_free(key);
+				goto err;
+			}
+			p = endptr;
+		} else if (!(p = json_skip_value(p))) {
+			lub_string_free(key);
+			goto err;
+		}
+		lub_string_free(key);
+		p = json_skip_space(p);
+		if (',' == *p)
+			p++;
+		else if (*p != '}')
+			goto err;
+	}
+	if (!line || (priority > 0xffff) || (seq_num > 0xffff))
+		goto err;
+
+	/* Find the parent waiting for the children */
+	while (this->stack_num &&
+		!this->stack[this->stack_num - 1].children)
+		this->stack_num--;
+	if (this->stack_num) {
+		parent = this->stack[this->stack_num - 1].conf;
+		this->stack[this->stack_num - 1].children--;
+	} else {
+		parent = this->root;
+	}
+
+	if (!(conf = konf_tree_new(line, (unsigned short)priority)))
+		goto err;
+	lub_string_free(line);
+	conf->seq_num = (unsigned short)seq_num;
+	conf->splitter = splitter ? 1 : 0;
+	conf->depth = (int)depth;
+	konf_tree_add(parent, conf);
+
+	if (children) {
+		if (this->stack_num == this->stack_size) {
+			konf_tree_json_level_t *tmp;
+			tmp = realloc(this->stack,
+				(this->stack_size + 1) * sizeof(*tmp));
+			assert(tmp);
+			this->stack = tmp;
+			this->stack_size++;
+		}
+		this->stack[this->stack_num].conf = conf;
+		this->stack[this->stack_num].children = children;
+		this->stack_num++;
+	}
+
+	return 0;
+err:
+	lub_string_free(line);
+	return -1;
+}
@@ -183,6 +183,8 @@ struct lub_bintree_s {
 	/** internal */ size_t node_offset;
 	/** internal */ lub_bintree_compare_fn *compareFn;
 	/** internal */ lub_bintree_getkey_fn *getkeyFn;
+	/** internal */ void **frozenv;
+	/** internal */ size_t frozenc;
 };
 
 /**
@@ -459,5 +461,45 @@ extern void lub_bintree_dump(
 	 */
 				    lub_bintree_t * tree);
 
+/**
+ * This operation makes the tree read-only for the search operations.
+ * The frozen tree keeps the sorted array of "clientnodes" so the find,
+ * findfirst, findlast, findnext, findprevious and iterator operations
+ * don't modify the tree. The frozen tree can be read by many threads and
+ * its memory stays shared after fork.
+ *
+ * \pre The tree must be initialised
+ *
+ * \post The insert or remove operation thaws the tree.
+ */
+extern void lub_bintree_freeze(
+	/** 
+	 * the "tree" instance to invoke this operation upon
+	 */
+				      lub_bintree_t * tree);
+
+/**
+ * This operation returns the tree to the splaying mode.
+ *
+ * \pre The tree must be initialised
+ */
+extern void lub_bintree_thaw(
+	/** 
+	 * the "tree" instance to invoke this operation upon
+	 */
+				    lub_bintree_t * tree);
+
+/**
+ * This operation checks if the tree is frozen.
+ *
+ * \return
+ * 1 if the tree is frozen, 0 otherwise.
+ */
+extern int lub_bintree_is_frozen(
+	/** 
+	 * the "tree" instance to invoke this operation upon
+	 */
+					const lub_bintree_t * tree);
+
 #endif				/* _lub_bintree_h */
 /** @} */
@@ -35,6 +35,14 @@
 /*--------------------------------------------------------- */
 void *lub_bintree_find(lub_bintree_t * this, const void *clientkey)
 {
+	if (this->frozenv) {
+		size_t i = lub_bintree_frozen_bound(this, clientkey);
+		if ((i < this->frozenc) &&
+		    (this->compareFn(this->frozenv[i], clientkey) == 0))
+			return this->frozenv[i];
+		return NULL;
+	}
+
 	this->root = lub_bintree_splay(this, this->root, clientkey);
 
 	if (NULL != this->root) {
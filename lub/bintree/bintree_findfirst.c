@@ -40,6 +40,9 @@ void *lub_bintree_findfirst(lub_bintree_t * this)
 {
 	lub_bintree_compare_fn *client_compare = this->compareFn;
 
+	if (this->frozenv)
+		return this->frozenv[0];
+
 	/*
 	 * put dummy functions in place
 	 * This will make the search faster and direct it to the left most
@@ -41,6 +41,9 @@ void *lub_bintree_findlast(lub_bintree_t * this)
 {
 	lub_bintree_compare_fn *client_compare = this->compareFn;
 
+	if (this->frozenv)
+		return this->frozenv[this->frozenc - 1];
+
 	/*
 	 * put dummy functions in place
 	 * This will make the search faster and direct it to the right most
@@ -40,6 +40,14 @@ void *lub_bintree_findnext(lub_bintree_t * this, const void *clientkey)
 	lub_bintree_node_t *t = this->root;
 	int comp;
 
+	if (this->frozenv) {
+		size_t i = lub_bintree_frozen_bound(this, clientkey);
+		if ((i < this->frozenc) &&
+		    (this->compareFn(this->frozenv[i], clientkey) == 0))
+			i++;
+		return (i < this->frozenc) ? this->frozenv[i] : NULL;
+	}
+
 	/*
 	 * have a look for a direct match
 	 */
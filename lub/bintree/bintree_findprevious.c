@@ -40,6 +40,11 @@ void *lub_bintree_findprevious(lub_bintree_t * this, const void *clientkey)
 	lub_bintree_node_t *t = this->root;
 	int comp;
 
+	if (this->frozenv) {
+		size_t i = lub_bintree_frozen_bound(this, clientkey);
+		return i ? this->frozenv[i - 1] : NULL;
+	}
+
 	/*
 	 * have a look for a direct match
 	 */
@@ -0,0 +1,79 @@
+/*********************** -*- Mode: C -*- ***********************
+ * File            : bintree_freeze.c
+ *---------------------------------------------------------------
+ * Description
+ * ===========
+ * These operations freeze and thaw a tree. The frozen tree keeps the
+ * sorted array of "clientnodes" and the search operations use the
+ * binary search within it. So the lookups don't splay the tree and
+ * don't write anything. The node links are left untouched so
+ * the thaw only drops the array.
+ *
+ * tree - the "tree" instance to invoke this operation upon
+ *---------------------------------------------------------------
+ */
+#include <assert.h>
+#include <stdlib.h>
+
+#include "private.h"
+
+/*--------------------------------------------------------- */
+void lub_bintree_freeze(lub_bintree_t * this)
+{
+	lub_bintree_iterator_t iter;
+	void *clientnode;
+	void **nodev = NULL;
+	size_t nodec = 0;
+	size_t size = 0;
+
+	if (this->frozenv)
+		return;
+	/* the tree is searched by splaying till the array is complete */
+	clientnode = lub_bintree_findfirst(this);
+	for (lub_bintree_iterator_init(&iter, this, clientnode);
+		clientnode; clientnode = lub_bintree_iterator_next(&iter)) {
+		if (nodec == size) {
+			void **tmp;
+			size = size ? size * 2 : 16;
+			tmp = realloc(nodev, size * sizeof(*tmp));
+			assert(tmp);
+			nodev = tmp;
+		}
+		nodev[nodec++] = clientnode;
+	}
+	this->frozenv = nodev;
+	this->frozenc = nodec;
+}
+
+/*--------------------------------------------------------- */
+void lub_bintree_thaw(lub_bintree_t * this)
+{
+	free(this->frozenv);
+	this->frozenv = NULL;
+	this->frozenc = 0;
+}
+
+/*--------------------------------------------------------- */
+int lub_bintree_is_frozen(const lub_bintree_t * this)
+{
+	return this->frozenv ? 1 : 0;
+}
+
+/*--------------------------------------------------------- */
+size_t lub_bintree_frozen_bound(const lub_bintree_t * this,
+	const void *clientkey)
+{
+	size_t lo = 0, hi = this->frozenc;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (this->compareFn(this->frozenv[mid], clientkey) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*--------------------------------------------------------- */
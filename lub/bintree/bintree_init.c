@@ -47,6 +47,8 @@ lub_bintree_init(lub_bintree_t * this,
 	this->node_offset = node_offset;
 	this->compareFn = compareFn;
 	this->getkeyFn = getkeyFn;
+	this->frozenv = NULL;
+	this->frozenc = 0;
 }
 
 /*--------------------------------------------------------- */
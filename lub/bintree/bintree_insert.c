@@ -49,6 +49,8 @@ int lub_bintree_insert(lub_bintree_t * this, void *clientnode)
 	lub_bintree_key_t key;
 
 	assert(clientnode);
+	/* the frozen tree returns to the splaying mode */
+	lub_bintree_thaw(this);
 	if (NULL != clientnode) {
 		/* obtain the control block from the clientnode */
 		new = lub_bintree_getnode(this, clientnode);
@@ -53,6 +53,9 @@ void lub_bintree_remove(lub_bintree_t * this, void *clientnode)
 	lub_bintree_key_t key;
 	int comp;
 
+	/* the frozen tree returns to the splaying mode */
+	lub_bintree_thaw(this);
+
 	/* get the key from the node */
 	this->getkeyFn(clientnode, &key);
 
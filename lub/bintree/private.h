@@ -69,3 +69,12 @@ extern lub_bintree_node_t *lub_bintree_splay(const lub_bintree_t * tree,
 #define lub_bintree_compare(this,node,key)\
 (this)->compareFn(lub_bintree_getclientnode(this,node),key)
 /*------------------------------------------------------------ */
+/* This operation searches the frozen tree. It returns the index of
+ * the first "clientnode" which is not less than the key.
+ *
+ * this - the tree to invoke this operation upon
+ * key  - the key to search with
+ */
+extern size_t lub_bintree_frozen_bound(const lub_bintree_t * this,
+				       const void *clientkey);
+/*------------------------------------------------------------ */
@@ -32,6 +32,7 @@ If a "const char *" is returned then the client has no responsiblity for releasi
 #define _lub_string_h
 
 #include <stddef.h>
+#include <stdio.h>
 
 #include "lub/c_decl.h"
 #include "lub/types.h"
@@ -268,6 +269,28 @@ char *lub_string_ndecode(const char *string, unsigned int len);
 char *lub_string_encode(const char *string, const char *escape_chars);
 
 char *lub_string_tolower(const char *str);
+
+/**
+ * This operation prints the string as the quoted JSON string.
+ * The '"', '\\' and the control characters are escaped.
+ */
+void lub_string_fprint_json(FILE *stream, const char *string);
+
+/*
+ * The frozen string arena. The string fields are registered by
+ * lub_string_arena_add() and then lub_string_arena_freeze() moves the
+ * unique strings to the single read-only block and repoints the fields.
+ * The lub_string_free() ignores the frozen strings so the owners don't
+ * need to know about freezing. The arena must be freed after the owners.
+ */
+typedef struct lub_string_arena_s lub_string_arena_t;
+
+lub_string_arena_t *lub_string_arena_new(void);
+void lub_string_arena_free(lub_string_arena_t *instance);
+void lub_string_arena_add(lub_string_arena_t *instance, char **field);
+int lub_string_arena_freeze(lub_string_arena_t *instance);
+size_t lub_string_arena__get_size(const lub_string_arena_t *instance);
+bool_t lub_string_is_frozen(const char *string);
 unsigned int lub_string_equal_part(const char *str1, const char *str2,
 	bool_t utf8);
 
@@ -0,0 +1,286 @@
+/*
+ * string_arena.c
+ *
+ * The frozen strings. The string fields are registered at first, then
+ * the unique strings are copied to the single read-only block, the
+ * fields are repointed and the original strings are freed. The frozen
+ * block is shared by the forked processes because nobody writes it.
+ */
+#include "private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef struct {
+	char *str; /* The original string */
+	unsigned int hash;
+	size_t offset; /* The offset within the frozen block */
+} lub_string_arena_entry_t;
+
+typedef struct {
+	char **field;
+	unsigned int index; /* The entry of string */
+} lub_string_arena_field_t;
+
+struct lub_string_arena_s {
+	lub_string_arena_t *next; /* The list of frozen arenas */
+	lub_string_arena_field_t *fieldv; /* The registered fields */
+	unsigned int fieldc;
+	unsigned int field_size; /* The allocated number of fields */
+	lub_string_arena_entry_t *entryv;
+	unsigned int entryc;
+	unsigned int entry_size;
+	unsigned int *hashv; /* The open addressing table of entry+1 */
+	unsigned int hash_size;
+	char **origv; /* The open addressing table of strings to free */
+	unsigned int origc;
+	unsigned int orig_size;
+	size_t size; /* The size of unique strings */
+	char *data;
+	size_t data_size; /* The mapped size */
+};
+
+/* The frozen arenas to recognize the frozen strings */
+static lub_string_arena_t *frozen = NULL;
+
+/*--------------------------------------------------------- */
+static unsigned int arena_hash(const char *str)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*str)
+		hash = (hash ^ (unsigned char)*str++) * 16777619u;
+
+	return hash;
+}
+
+/*--------------------------------------------------------- */
+static void arena_rehash(lub_string_arena_t *this)
+{
+	unsigned int i;
+
+	free(this->hashv);
+	this->hash_size = this->hash_size ? this->hash_size * 2 : 256;
+	this->hashv = calloc(this->hash_size, sizeof(*this->hashv));
+	assert(this->hashv);
+	for (i = 0; i < this->entryc; i++) {
+		unsigned int pos = this->entryv[i].hash & (this->hash_size - 1);
+		while (this->hashv[pos])
+			pos = (pos + 1) & (this->hash_size - 1);
+		this->hashv[pos] = i + 1;
+	}
+}
+
+/*--------------------------------------------------------- */
+/* Find the entry of the same string or add the new one */
+static unsigned int arena_entry(lub_string_arena_t *this, char *str)
+{
+	unsigned int hash = arena_hash(str);
+	unsigned int pos;
+	lub_string_arena_entry_t *entry;
+
+	if (2 * (this->entryc + 1) > this->hash_size)
+		arena_rehash(this);
+	for (pos = hash & (this->hash_size - 1); this->hashv[pos];
+		pos = (pos + 1) & (this->hash_size - 1)) {
+		entry = &this->entryv[this->hashv[pos] - 1];
+		if ((entry->hash == hash) && !strcmp(entry->str, str))
+			return this->hashv[pos] - 1;
+	}
+
+	if (this->entryc == this->entry_size) {
+		this->entry_size = this->entry_size ? this->entry_size * 2 : 64;
+		entry = realloc(this->entryv,
+			this->entry_size * sizeof(*this->entryv));
+		assert(entry);
+		this->entryv = entry;
+	}
+	entry = &this->entryv[this->entryc];
+	entry->str = str;
+	entry->hash = hash;
+	entry->offset = this->size;
+	this->size += strlen(str) + 1;
+	this->hashv[pos] = this->entryc + 1;
+
+	return this->entryc++;
+}
+
+/*--------------------------------------------------------- */
+static unsigned int arena_ptr_hash(const char *str, unsigned int size)
+{
+	unsigned long ptr = (unsigned long)str;
+
+	return (unsigned int)((ptr >> 4) * 2654435761u) & (size - 1);
+}
+
+/*--------------------------------------------------------- */
+/* Remember the original string. The fields can share the same string
+ * but it must be freed once.
+ */
+static void arena_orig(lub_string_arena_t *this, char *str)
+{
+	unsigned int pos;
+
+	if (2 * (this->origc + 1) > this->orig_size) {
+		char **old = this->origv;
+		unsigned int old_size = this->orig_size;
+		unsigned int i;
+
+		this->orig_size = old_size ? old_size * 2 : 256;
+		this->origv = calloc(this->orig_size, sizeof(*this->origv));
+		assert(this->origv);
+		for (i = 0; i < old_size; i++) {
+			if (!old[i])
+				continue;
+			pos = arena_ptr_hash(old[i], this->orig_size);
+			while (this->origv[pos])
+				pos = (pos + 1) & (this->orig_size - 1);
+			this->origv[pos] = old[i];
+		}
+		free(old);
+	}
+	for (pos = arena_ptr_hash(str, this->orig_size); this->origv[pos];
+		pos = (pos + 1) & (this->orig_size - 1)) {
+		if (this->origv[pos] == str)
+			return;
+	}
+	this->origv[pos] = str;
+	this->origc++;
+}
+
+/*--------------------------------------------------------- */
+/* Free the registration data */
+static void arena_clean(lub_string_arena_t *this)
+{
+	free(this->fieldv);
+	free(this->entryv);
+	free(this->hashv);
+	free(this->origv);
+	this->fieldv = NULL;
+	this->entryv = NULL;
+	this->hashv = NULL;
+	this->fieldc = 0;
+	this->field_size = 0;
+	this->entryc = 0;
+	this->entry_size = 0;
+	this->hash_size = 0;
+	this->origv = NULL;
+	this->origc = 0;
+	this->orig_size = 0;
+}
+
+/*--------------------------------------------------------- */
+lub_string_arena_t *lub_string_arena_new(void)
+{
+	lub_string_arena_t *this;
+
+	this = calloc(1, sizeof(*this));
+	assert(this);
+
+	return this;
+}
+
+/*--------------------------------------------------------- */
+/* Register the string field. The field must not be changed till
+ * lub_string_arena_freeze(). The fields can share the same string.
+ */
+void lub_string_arena_add(lub_string_arena_t *this, char **field)
+{
+	lub_string_arena_field_t *fieldv;
+
+	if (!*field || lub_string_is_frozen(*field))
+		return;
+	if (this->fieldc == this->field_size) {
+		this->field_size = this->field_size ? this->field_size * 2 : 64;
+		fieldv = realloc(this->fieldv,
+			this->field_size * sizeof(*fieldv));
+		assert(fieldv);
+		this->fieldv = fieldv;
+	}
+	fieldv = &this->fieldv[this->fieldc++];
+	fieldv->field = field;
+	fieldv->index = arena_entry(this, *field);
+	arena_orig(this, *field);
+}
+
+/*--------------------------------------------------------- */
+/* Copy the strings to the frozen block, repoint the fields and free
+ * the original strings.
+ */
+int lub_string_arena_freeze(lub_string_arena_t *this)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned int i;
+	void *data;
+
+	if (this->data || !this->size) {
+		arena_clean(this);
+		return 0;
+	}
+	if (page <= 0)
+		page = 4096;
+	this->data_size = (this->size + page - 1) & ~((size_t)page - 1);
+	data = mmap(NULL, this->data_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == data)
+		return -1;
+	this->data = data;
+	for (i = 0; i < this->entryc; i++)
+		strcpy(this->data + this->entryv[i].offset,
+			this->entryv[i].str);
+	mprotect(this->data, this->data_size, PROT_READ);
+
+	this->next = frozen;
+	frozen = this;
+	for (i = 0; i < this->fieldc; i++)
+		*this->fieldv[i].field = this->data +
+			this->entryv[this->fieldv[i].index].offset;
+	for (i = 0; i < this->orig_size; i++)
+		free(this->origv[i]);
+	arena_clean(this);
+
+	return 0;
+}
+
+/*--------------------------------------------------------- */
+/* The frozen strings must not be used after free */
+void lub_string_arena_free(lub_string_arena_t *this)
+{
+	lub_string_arena_t **tmp;
+
+	if (!this)
+		return;
+	for (tmp = &frozen; *tmp; tmp = &(*tmp)->next) {
+		if (*tmp == this) {
+			*tmp = this->next;
+			break;
+		}
+	}
+	if (this->data)
+		munmap(this->data, this->data_size);
+	arena_clean(this);
+	free(this);
+}
+
+/*--------------------------------------------------------- */
+size_t lub_string_arena__get_size(const lub_string_arena_t *this)
+{
+	return this->size;
+}
+
+/*--------------------------------------------------------- */
+bool_t lub_string_is_frozen(const char *string)
+{
+	lub_string_arena_t *arena;
+
+	for (arena = frozen; arena; arena = arena->next) {
+		if ((string >= arena->data) &&
+			(string < arena->data + arena->data_size))
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
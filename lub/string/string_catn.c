@@ -22,7 +22,14 @@ void lub_string_catn(char **string, const char *text, size_t len)
 		length = initlen + len + 1;
 
 		/* allocate the memory for the result */
-		q = realloc(*string, length);
+		if (*string && lub_string_is_frozen(*string)) {
+			/* The frozen string is read-only */
+			q = malloc(length);
+			if (q)
+				memcpy(q, *string, initlen);
+		} else {
+			q = realloc(*string, length);
+		}
 		if (NULL != q) {
 			*string = q;
 			/* move to the end of the initial string */
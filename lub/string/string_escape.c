@@ -4,6 +4,7 @@
 #include "private.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 
 const char *lub_string_esc_default = "`|$<>&()#;\\\"!";
@@ -91,3 +92,37 @@ char *lub_string_encode(const char *string, const char *escape_chars)
 }
 
 /*--------------------------------------------------------- */
+
+/*--------------------------------------------------------- */
+void lub_string_fprint_json(FILE *stream, const char *string)
+{
+	const unsigned char *p;
+
+	fputc('"', stream);
+	for (p = (const unsigned char *)string; *p; p++) {
+		switch (*p) {
+		case '"':
+			fputs("\\\"", stream);
+			break;
+		case '\\':
+			fputs("\\\\", stream);
+			break;
+		case '\n':
+			fputs("\\n", stream);
+			break;
+		case '\r':
+			fputs("\\r", stream);
+			break;
+		case '\t':
+			fputs("\\t", stream);
+			break;
+		default:
+			if (*p < 0x20)
+				fprintf(stream, "\\u%04x", *p);
+			else
+				fputc(*p, stream);
+			break;
+		}
+	}
+	fputc('"', stream);
+}
@@ -8,6 +8,9 @@
 /*--------------------------------------------------------- */
 void lub_string_free(char *ptr)
 {
+	/* The frozen strings are released with the arena */
+	if (lub_string_is_frozen(ptr))
+		return;
 	free(ptr);
 }
 
@@ -1524,6 +1524,12 @@ FILE *tinyrl__get_istream(const tinyrl_t * this)
 	return tinyrl_vt100__get_istream(this->term);
 }
 
+/*-------------------------------------------------------- */
+void tinyrl__set_ostream(tinyrl_t * this, FILE * ostream)
+{
+	tinyrl_vt100__set_ostream(this->term, ostream);
+}
+
 /*-------------------------------------------------------- */
 FILE *tinyrl__get_ostream(const tinyrl_t * this)
 {
@@ -102,6 +102,7 @@ extern const char *tinyrl__get_line(const tinyrl_t * instance);
 extern void tinyrl__set_istream(tinyrl_t * instance, FILE * istream);
 extern bool_t tinyrl__get_isatty(const tinyrl_t * instance);
 extern FILE *tinyrl__get_istream(const tinyrl_t * instance);
+extern void tinyrl__set_ostream(tinyrl_t * instance, FILE * ostream);
 extern FILE *tinyrl__get_ostream(const tinyrl_t * instance);
 extern bool_t tinyrl__get_utf8(const tinyrl_t * instance);
 extern void tinyrl__set_utf8(tinyrl_t * instance, bool_t utf8);
@@ -106,6 +106,8 @@ extern void tinyrl_vt100__set_timeout(tinyrl_vt100_t *instance, int timeout);
 extern void
 tinyrl_vt100__set_istream(tinyrl_vt100_t * instance, FILE * istream);
 extern FILE *tinyrl_vt100__get_istream(const tinyrl_vt100_t * instance);
+extern void
+tinyrl_vt100__set_ostream(tinyrl_vt100_t * instance, FILE * ostream);
 extern FILE *tinyrl_vt100__get_ostream(const tinyrl_vt100_t * instance);
 
 extern tinyrl_vt100_escape_t
@@ -399,6 +399,12 @@ FILE *tinyrl_vt100__get_istream(const tinyrl_vt100_t * this)
 	return this->istream;
 }
 
+/*-------------------------------------------------------- */
+void tinyrl_vt100__set_ostream(tinyrl_vt100_t * this, FILE * ostream)
+{
+	this->ostream = ostream;
+}
+
 /*-------------------------------------------------------- */
 FILE *tinyrl_vt100__get_ostream(const tinyrl_vt100_t * this)
 {